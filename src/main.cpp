@@ -1,10 +1,15 @@
 #include "render/Animation.h"
+#include "render/Profiler.h"
+#include "render/ShaderCache.h"
 #include <GLFW/glfw3.h>
 #include <args/Args.h>
 #include <args/Parser.h>
 #include <event/Loop.h>
 #include <log/Log.h>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <future>
 #include <thread>
 #include <memory>
 #include <signal.h>
@@ -36,28 +41,176 @@ static void PrintGLFWError(int code, const char* message) {
     Log(Log::Info) << "GLFW error: " << code << " - " << message;
 }
 
-#ifdef ANIMATION_USE_THREAD
-static void animationThread(Animation* animation, GLFWwindow* window)
+// dawn only notices fence completion from Device::Tick(), or over the wire
+// when the returns are handled, both in Animation::tick(). While frames are
+// in flight the loop wakes up this often to call it, the fence completion
+// itself is posted into the loop by Animation.
+static constexpr auto kFenceTickInterval = 1ms;
+// while nothing changes there are no fences to wait for, anything that
+// needs a frame posts into the loop and wakes it up
+static constexpr auto kIdleTickInterval = 100ms;
+
+static std::string tracePath;
+
+static void logFrameStats(Animation* animation)
+{
+    const std::chrono::duration<double, std::milli> stall = animation->gpuStallTime();
+    Log(Log::Info) << "gpu stalls:" << animation->gpuStallCount() << "total" << stall.count() << "ms";
+
+    const std::chrono::duration<double> idle = animation->idleTime();
+    const DamageTracker& damage = animation->damage();
+    const double partialSaved = damage.partialFullPixels()
+        ? 100.0 * (1.0 - static_cast<double>(damage.partialPixels()) / damage.partialFullPixels()) : 0.0;
+    Log(Log::Info) << "on demand:" << animation->frameCount() << "frames," << animation->framesSkipped()
+                   << "skipped over" << idle.count() << "s idle," << damage.fullFrames() << "full and"
+                   << damage.partialFrames() << "partial redraws, partial redraws saved" << partialSaved << "% of pixels";
+
+    animation->textureCache().logStats();
+    const ObjectCache& objects = animation->objectCache();
+    Log(Log::Info) << "object cache:" << objects.hits() << "hits," << objects.misses() << "misses";
+    GpuMemory::instance().logStats();
+
+    if (const ResolutionScaler* scaler = animation->resolutionScaler())
+        Log(Log::Info) << "dynamic resolution: scale" << scaler->scale() << ", lowest" << scaler->minScaleSeen()
+                       << "," << scaler->changes() << "changes";
+
+    if (const FrameCapture* capture = animation->frameCapture())
+        capture->logStats();
+
+    if (animation->videoFramesUploaded())
+        Log(Log::Info) << "video:" << animation->videoFramesUploaded() << "frames uploaded";
+
+    if (const StreamingTexture* sequence = animation->sequencePlayer())
+        Log(Log::Info) << "sequence:" << sequence->presentedCount() << "frames presented," << sequence->droppedCount()
+                       << "dropped," << sequence->lateCount() << "late";
+
+    if (const WireConnection* wire = animation->wireConnection())
+        Log(Log::Info) << "wire:" << wire->flushCount() << "flushes," << wire->bytesSent() << "bytes sent";
+
+    Profiler& profiler = Profiler::instance();
+    if (profiler.enabled())
+        profiler.logStats();
+    if (!tracePath.empty())
+        profiler.writeTrace(tracePath);
+}
+
+// Runs the animation without a window as fast as the fences allow and
+// reports throughput. Used on machines without a display or gpu.
+static int headlessLoop(Animation* animation, int maxFrames)
 {
-    // glfwMakeContextCurrent(window);
     std::shared_ptr<event::Loop> loop = event::Loop::create();
     atomic_store(&animationLoopPtr, loop);
 
-    animation->init();
+    animation->init(loop);
+    if (!animation->start()) {
+        loop.reset();
+        atomic_store(&animationLoopPtr, loop);
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto intervalStart = start;
+    uint64_t intervalStartFrame = 0;
 
     for (;;) {
-        // printf("waiting for fence\n");
-        while (!animation->fenceCompleted()) {
-            loop->execute(5ms);
-            animation->tick();
+        loop->execute(animation->isIdle() ? animation->idleTimeout(kIdleTickInterval) : 0ms);
+        animation->tick();
+
+        const uint64_t frames = animation->frameCount();
+        const auto now = std::chrono::steady_clock::now();
+        const std::chrono::duration<double> interval = now - intervalStart;
+        if (interval.count() >= 1.0) {
+            Log(Log::Info) << "headless:" << ((frames - intervalStartFrame) / interval.count()) << "fps,"
+                           << GpuMemory::instance().totalBytes() << "bytes of gpu memory";
+            intervalStart = now;
+            intervalStartFrame = frames;
         }
-        // printf("fence signaled\n");
-        animation->frame();
-        animation->signalFence();
-        if (loop->stopped())
+
+        if (loop->stopped() || (maxFrames > 0 && frames >= static_cast<uint64_t>(maxFrames)))
             break;
     }
 
+    animation->flushCapture();
+
+    const uint64_t frames = animation->frameCount();
+    const std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+    Log(Log::Info) << "headless:" << frames << "frames in" << total.count() << "s,"
+                   << (total.count() > 0 ? frames / total.count() : 0.0) << "fps";
+    logFrameStats(animation);
+
+    loop.reset();
+    atomic_store(&animationLoopPtr, loop);
+
+    return 0;
+}
+
+// Draws the sprite grid sampling only the base level and then the generated
+// mip chain, and reports the frame rate of each. With many small sprites the
+// difference is dominated by texture sampling bandwidth.
+static int mipBenchmark(Animation* animation, int framesPerPhase)
+{
+    std::shared_ptr<event::Loop> loop = event::Loop::create();
+    atomic_store(&animationLoopPtr, loop);
+
+    animation->init(loop);
+    if (!animation->start()) {
+        loop.reset();
+        atomic_store(&animationLoopPtr, loop);
+        return 1;
+    }
+
+    while (!animation->contentReady() && !loop->stopped()) {
+        loop->execute(kFenceTickInterval);
+        animation->tick();
+    }
+
+    auto runPhase = [&](bool mipmaps) -> double {
+        animation->setMipmapsEnabled(mipmaps);
+        const uint64_t first = animation->frameCount();
+        const auto start = std::chrono::steady_clock::now();
+        while (!loop->stopped() && animation->frameCount() - first < static_cast<uint64_t>(framesPerPhase)) {
+            loop->execute(0ms);
+            animation->tick();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() > 0 ? (animation->frameCount() - first) / elapsed.count() : 0.0;
+    };
+
+    const double without = runPhase(false);
+    const double with = runPhase(true);
+    Log(Log::Info) << "mip benchmark: without mips" << without << "fps, with mips" << with << "fps";
+
+    loop.reset();
+    atomic_store(&animationLoopPtr, loop);
+
+    return 0;
+}
+
+#ifdef ANIMATION_USE_THREAD
+// initialized is set once the asset loads have started, created tells
+// whether the window's thread could then set up the surface
+static void animationThread(Animation* animation, GLFWwindow* window, std::promise<void>* initialized, std::future<bool> created)
+{
+    // glfwMakeContextCurrent(window);
+    std::shared_ptr<event::Loop> loop = event::Loop::create();
+    atomic_store(&animationLoopPtr, loop);
+
+    animation->init(loop);
+    initialized->set_value();
+    if (!created.get() || !animation->start()) {
+        loop.reset();
+        atomic_store(&animationLoopPtr, loop);
+        glfwSetWindowShouldClose(window, 1);
+        return;
+    }
+
+    while (!loop->stopped()) {
+        loop->execute(animation->isIdle() ? animation->idleTimeout(kIdleTickInterval) : kFenceTickInterval);
+        animation->tick();
+    }
+
+    logFrameStats(animation);
+
     loop.reset();
     atomic_store(&animationLoopPtr, loop);
 
@@ -76,6 +229,9 @@ int main(int argc, char** argv)
     Log::Level level = Log::Debug;
     int width = 1280;
     int height = 720;
+    int frames = 0;
+    bool benchMipmaps = false;
+    AnimationOptions options;
 
     if (args.has<int>("width"))
         width = args.value<int>("width");
@@ -94,9 +250,148 @@ int main(int argc, char** argv)
         else if (slevel == "fatal")
             level = Log::Fatal;
     }
+    if (args.has<bool>("headless"))
+        options.headless = args.value<bool>("headless");
+    if (args.has<bool>("cpu"))
+        options.preferCpuAdapter = args.value<bool>("cpu");
+    if (args.has<int>("frames"))
+        frames = args.value<int>("frames");
+    if (args.has<int>("sprites"))
+        options.spriteCount = std::max(args.value<int>("sprites"), 0);
+    if (args.has<bool>("animate"))
+        options.animate = args.value<bool>("animate");
+    if (args.has<bool>("on-demand"))
+        options.onDemand = args.value<bool>("on-demand");
+    if (args.has<bool>("mipmaps"))
+        options.mipmaps = args.value<bool>("mipmaps");
+    if (args.has<bool>("wire")) {
+        // the gpu lives in a forked server process, only offscreen
+        // rendering can be done from there
+        options.wire = args.value<bool>("wire");
+        if (options.wire)
+            options.headless = true;
+    }
+    if (args.has<std::string>("capture")) {
+        // reading back a swapchain isn't supported, capture offscreen
+        options.capturePath = args.value<std::string>("capture");
+        options.headless = true;
+    }
+    if (args.has<std::string>("video"))
+        options.video = args.value<std::string>("video");
+    if (args.has<int>("video-width"))
+        options.videoWidth = std::max(args.value<int>("video-width"), 0);
+    if (args.has<int>("video-height"))
+        options.videoHeight = std::max(args.value<int>("video-height"), 0);
+    if (args.has<int>("video-fps"))
+        options.videoFrameRate = static_cast<float>(std::max(args.value<int>("video-fps"), 1));
+    if (args.has<std::string>("sequence"))
+        options.sequence = args.value<std::string>("sequence");
+    if (args.has<int>("sequence-fps"))
+        options.sequenceFrameRate = static_cast<float>(std::max(args.value<int>("sequence-fps"), 1));
+    if (args.has<bool>("stats-overlay"))
+        options.statsOverlay = args.value<bool>("stats-overlay");
+    if (args.has<bool>("bench-mipmaps"))
+        benchMipmaps = args.value<bool>("bench-mipmaps");
+    if (args.has<std::string>("assets")) {
+        // comma separated list of urls
+        const auto& sassets = args.value<std::string>("assets");
+        size_t pos = 0;
+        while (pos <= sassets.size()) {
+            const size_t comma = std::min(sassets.find(',', pos), sassets.size());
+            if (comma > pos)
+                options.assets.push_back(sassets.substr(pos, comma - pos));
+            pos = comma + 1;
+        }
+    }
+    if (args.has<int>("decode-threads"))
+        options.decodeThreads = std::max(args.value<int>("decode-threads"), 0);
+    if (args.has<int>("max-decodes"))
+        options.maxDecodesInFlight = std::max(args.value<int>("max-decodes"), 0);
+    if (args.has<int>("record-threads"))
+        options.recordThreads = std::max(args.value<int>("record-threads"), 0);
+    if (args.has<bool>("dynamic-resolution"))
+        options.dynamicResolution = args.value<bool>("dynamic-resolution");
+    if (args.has<int>("target-fps"))
+        options.targetFrameRate = static_cast<float>(std::max(args.value<int>("target-fps"), 1));
+    if (args.has<int>("texture-budget")) {
+        // in megabytes
+        options.textureBudget = static_cast<uint64_t>(std::max(args.value<int>("texture-budget"), 1)) * 1024 * 1024;
+    }
+    if (args.has<int>("page-interval")) {
+        // in milliseconds
+        options.pageInterval = std::max(args.value<int>("page-interval"), 0) / 1000.0f;
+    }
+    if (args.has<int>("frames-in-flight"))
+        options.framesInFlight = std::max(args.value<int>("frames-in-flight"), 1);
+    if (args.has<std::string>("backend")) {
+        const auto& sbackend = args.value<std::string>("backend");
+        if (sbackend == "null")
+            options.backendType = wgpu::BackendType::Null;
+        else if (sbackend == "vulkan")
+            options.backendType = wgpu::BackendType::Vulkan;
+        else if (sbackend == "metal")
+            options.backendType = wgpu::BackendType::Metal;
+    }
 
     Log::initialize(level);
 
+    if (args.has<std::string>("capture-format")) {
+        const auto& sformat = args.value<std::string>("capture-format");
+        if (!FrameCapture::parseFormat(sformat, &options.captureFormat)) {
+            Log(Log::Error) << "unknown capture format" << sformat << "(raw, png)";
+            return 1;
+        }
+    }
+
+    if (args.has<std::string>("video-format")) {
+        const auto& sformat = args.value<std::string>("video-format");
+        if (!VideoTexture::parseFormat(sformat, &options.videoFormat)) {
+            Log(Log::Error) << "unknown video format" << sformat << "(nv12, i420)";
+            return 1;
+        }
+    }
+
+    if (args.has<std::string>("shader-cache"))
+        ShaderCache::instance().setDirectory(args.value<std::string>("shader-cache"));
+    if (args.has<bool>("profile"))
+        Profiler::instance().setEnabled(args.value<bool>("profile"));
+    if (args.has<std::string>("trace")) {
+        // chrome trace_event json, written when the animation stops
+        tracePath = args.value<std::string>("trace");
+        Profiler::instance().setTracing(true);
+    }
+
+    if (benchMipmaps) {
+        // the null backend samples nothing, both phases would measure the
+        // same empty frames
+        if (options.backendType == wgpu::BackendType::Null) {
+            Log(Log::Error) << "mip benchmark needs a backend that renders";
+            return 1;
+        }
+        options.headless = true;
+        options.mipmaps = true;
+        // keep the per frame instance upload out of the comparison, and
+        // render every frame even though nothing moves
+        options.animate = false;
+        options.onDemand = false;
+        if (!options.spriteCount)
+            options.spriteCount = 4096;
+        Animation animation;
+        if (!animation.create(nullptr, width, height, options))
+            return 1;
+        return mipBenchmark(&animation, frames > 0 ? frames : 500);
+    }
+
+    if (options.headless) {
+        // counting frames only makes sense when they're rendered back to back
+        if (frames > 0)
+            options.onDemand = false;
+        Animation animation;
+        if (!animation.create(nullptr, width, height, options))
+            return 1;
+        return headlessLoop(&animation, frames);
+    }
+
     glfwSetErrorCallback(PrintGLFWError);
     if (!glfwInit()) {
         return 1;
@@ -111,12 +406,19 @@ int main(int argc, char** argv)
 #ifdef ANIMATION_USE_THREAD
     // make the animation thread
     Animation animation;
-    animation.create(window, width, height);
+    if (!animation.create(window, width, height, options))
+        return 1;
 
     std::shared_ptr<event::Loop> loop = event::Loop::create();
     atomic_store(&mainLoopPtr, loop);
 
-    std::thread thread = std::thread(animationThread, &animation, window);
+    // init() starts the asset loads on the animation thread before the
+    // surface waits for the device here, so they overlap its creation
+    std::promise<void> initialized;
+    std::promise<bool> created;
+    std::thread thread = std::thread(animationThread, &animation, window, &initialized, created.get_future());
+    initialized.get_future().wait();
+    created.set_value(animation.finishCreate());
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
         loop->execute(50ms);
@@ -129,8 +431,11 @@ int main(int argc, char** argv)
     std::shared_ptr<event::Loop> loop = event::Loop::create();
 
     Animation animation;
-    animation.create(window, width, height);
-    animation.init();
+    if (!animation.create(window, width, height, options))
+        return 1;
+    animation.init(loop);
+    if (!animation.finishCreate())
+        return 1;
 
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
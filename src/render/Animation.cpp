@@ -1,11 +1,26 @@
 #include "Animation.h"
+#include "AssetLoader.h"
 #include "Constants.h"
+#include "MipGenerator.h"
+#include "ObjectCache.h"
+#include "Profiler.h"
+#include "ResolutionScaler.h"
+#include "ShaderCache.h"
+#include "SpriteBatch.h"
+#include "StagingRing.h"
+#include "StreamingTexture.h"
+#include "TextureCache.h"
+#include "UniformArena.h"
+#include "VideoTexture.h"
 #include "Utils.h"
 #include <log/Log.h>
 #include <dawn/dawn_proc.h>
 #include <shaderc/shaderc.hpp>
 #include <memory>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <glm/vec4.hpp>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -35,47 +50,224 @@ static void PrintDeviceError(WGPUErrorType errorType, const char* message, void*
     Log(Log::Error) << errorTypeName << "error:" << message;
 }
 
-#ifdef __APPLE__
-static constexpr wgpu::BackendType backendType = wgpu::BackendType::Metal;
-#else
-static constexpr wgpu::BackendType backendType = wgpu::BackendType::Vulkan;
-#endif
-
 struct UniformGeometry
 {
     glm::vec4 geometry;
 };
 
-void Animation::create(GLFWwindow* window, int w, int h)
+// the largest rect of the content's aspect ratio centered in the target
+static glm::vec4 letterbox(uint32_t contentWidth, uint32_t contentHeight, uint32_t targetWidth, uint32_t targetHeight)
+{
+    const float contentAspect = static_cast<float>(contentWidth) / contentHeight;
+    const float targetAspect = static_cast<float>(targetWidth) / targetHeight;
+    if (contentAspect > targetAspect) {
+        const float h = targetAspect / contentAspect;
+        return { -1.0f, h, 1.0f, -h };
+    }
+    const float w = contentAspect / targetAspect;
+    return { -w, 1.0f, w, -1.0f };
+}
+
+// the image quad, its geometry comes out of the uniform arena
+static const char* kQuadVertexSource = R"(
+    #version 450
+
+    layout(set = 0, binding = 2) uniform UniformBufferObject {
+        vec4 geometry;
+    } ubo;
+    layout(location = 0) out vec2 fragUV;
+
+    vec2 positions[4] = vec2[](
+        vec2(-1.0, +1.0),
+        vec2(+1.0, +1.0),
+        vec2(-1.0, -1.0),
+        vec2(+1.0, -1.0)
+    );
+
+    void main() {
+        vec2 position = positions[gl_VertexIndex];
+        int x = position.x == -1.0 ? 0 : 2;
+        int y = position.y == +1.0 ? 1 : 3;
+        gl_Position = vec4(ubo.geometry[x], ubo.geometry[y], 0.0, 1.0);
+        fragUV = vec2(x == 0 ? 0.0 : 1.0, y == 1 ? 0.0 : 1.0);
+    })";
+
+static const char* kQuadFragmentSource = R"(
+    #version 450
+    layout(set = 0, binding = 0) uniform sampler mySampler;
+    layout(set = 0, binding = 1) uniform texture2D myTexture;
+
+    layout(location = 0) in vec2 fragUV;
+    layout(location = 0) out vec4 fragColor;
+    void main() {
+        fragColor = texture(sampler2D(myTexture, mySampler), fragUV);
+    })";
+
+// fullscreen triangle for clearing the scissored area of partial redraws
+static const char* kClearVertexSource = R"(
+    #version 450
+    vec2 positions[3] = vec2[](
+        vec2(-1.0, +1.0),
+        vec2(+3.0, +1.0),
+        vec2(-1.0, -3.0)
+    );
+
+    void main() {
+        gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    })";
+
+static const char* kClearFragmentSource = R"(
+    #version 450
+    layout(location = 0) out vec4 fragColor;
+    void main() {
+        fragColor = vec4(0.0, 0.0, 0.0, 0.0);
+    })";
+
+// stretches the dynamic resolution scene target over the backbuffer
+static const char* kUpscaleVertexSource = R"(
+    #version 450
+    layout(location = 0) out vec2 fragUV;
+    vec2 positions[3] = vec2[](
+        vec2(-1.0, +1.0),
+        vec2(+3.0, +1.0),
+        vec2(-1.0, -3.0)
+    );
+
+    void main() {
+        gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+        fragUV = vec2(positions[gl_VertexIndex].x, -positions[gl_VertexIndex].y) * 0.5 + 0.5;
+    })";
+
+static const char* kUpscaleFragmentSource = R"(
+    #version 450
+    layout(set = 0, binding = 0) uniform sampler mySampler;
+    layout(set = 0, binding = 1) uniform texture2D myTexture;
+
+    layout(location = 0) in vec2 fragUV;
+    layout(location = 0) out vec4 fragColor;
+    void main() {
+        fragColor = texture(sampler2D(myTexture, mySampler), fragUV);
+    })";
+
+// how long flushCapture() waits for the last frames to be read back
+static constexpr auto kCaptureFlushTimeout = 5s;
+
+// compiles what the first frames need into the shader cache while the
+// device is being created, modules created afterwards are memory hits
+static void warmShaders(const AnimationOptions& options)
+{
+    ShaderCache& cache = ShaderCache::instance();
+    if (options.spriteCount == 0) {
+        cache.compile(SingleShaderStage::Vertex, kQuadVertexSource);
+        cache.compile(SingleShaderStage::Fragment, kQuadFragmentSource);
+    }
+    cache.compile(SingleShaderStage::Vertex, kClearVertexSource);
+    cache.compile(SingleShaderStage::Fragment, kClearFragmentSource);
+    if (options.dynamicResolution) {
+        cache.compile(SingleShaderStage::Vertex, kUpscaleVertexSource);
+        cache.compile(SingleShaderStage::Fragment, kUpscaleFragmentSource);
+    }
+    MipGenerator::warmShaders();
+    if (options.spriteCount > 0)
+        SpriteBatch::warmShaders();
+    if (!options.video.empty())
+        VideoTexture::warmShaders(options.videoFormat);
+    if (!options.sequence.empty())
+        StreamingTexture::warmShaders();
+    if (options.statsOverlay)
+        StatsOverlay::warmShaders();
+}
+
+Animation::~Animation()
+{
+    if (deviceSetup.joinable())
+        deviceSetup.join();
+    if (shaderWarmup.joinable())
+        shaderWarmup.join();
+}
+
+bool Animation::create(GLFWwindow* window, int w, int h, const AnimationOptions& opts)
 {
     Log(Log::Info) << "go me";
+    createTime = std::chrono::steady_clock::now();
 
     width = w;
     height = h;
 
     mWindow = window;
+    options = opts;
 
-    instance = std::make_unique<dawn_native::Instance>();
-    instance->DiscoverDefaultAdapters();
+    // a swapchain's images can't be copied from
+    if (!options.capturePath.empty() && !options.headless) {
+        Log(Log::Error) << "frame capture requires headless";
+        return false;
+    }
 
-    dawn_native::Adapter backendAdapter;
-    {
-        std::vector<dawn_native::Adapter> adapters = instance->GetAdapters();
-        auto adapterIt = std::find_if(adapters.begin(), adapters.end(),
-                                      [](const dawn_native::Adapter adapter) -> bool {
-                                          wgpu::AdapterProperties properties;
-                                          adapter.GetProperties(&properties);
-                                          return properties.backendType == backendType;
-                                      });
-        assert(adapterIt != adapters.end());
-        backendAdapter = *adapterIt;
+    if (options.wire) {
+        // the server only has the offscreen ring, a swapchain would need
+        // the window handed across the process boundary
+        if (!options.headless) {
+            Log(Log::Error) << "wire rendering requires headless";
+            return false;
+        }
+        // forked before any of the threads below exist
+        wire = WireConnection::spawn(options.backendType, options.preferCpuAdapter);
+        if (!wire)
+            return false;
+        backendDevice = wire->device();
+        backendProcs = wire->procs();
+    } else {
+        // adapter discovery and device creation are the slowest part of
+        // startup, they overlap shader compilation and the asset loads
+        // started by init()
+        instance = std::make_unique<dawn_native::Instance>();
+        deviceSetup = std::thread([this]() {
+            const auto start = std::chrono::steady_clock::now();
+            instance->DiscoverDefaultAdapters();
+            dawn_native::Adapter backendAdapter;
+            if (SelectAdapter(*instance, options.backendType, options.preferCpuAdapter, &backendAdapter)) {
+                backendDevice = backendAdapter.CreateDevice();
+                backendProcs = dawn_native::GetProcs();
+            }
+            Profiler::instance().record("device", start, std::chrono::steady_clock::now());
+        });
     }
+    shaderWarmup = std::thread([this]() {
+        const auto start = std::chrono::steady_clock::now();
+        warmShaders(options);
+        Profiler::instance().record("shaders", start, std::chrono::steady_clock::now());
+    });
 
-    WGPUDevice backendDevice = backendAdapter.CreateDevice();
-    DawnProcTable backendProcs = dawn_native::GetProcs();
+    // everything init() needs, the rest waits for the device
+    inFlight.resize(std::max<uint32_t>(options.framesInFlight, 1));
+    // a texture can be evicted once no frame in flight or about to be
+    // recorded has used it
+    textures = std::make_unique<TextureCache>(options.textureBudget, static_cast<uint32_t>(inFlight.size()) + 1);
+    // offscreen textures keep what was drawn into them, a swapchain's
+    // images are treated as undefined
+    damageTracker = std::make_unique<DamageTracker>(width, height, options.headless ? kOffscreenTextureCount : 0);
+    damageTracker->damageAll();
+    return true;
+}
 
-    binding = makeBackendBinding(window, backendDevice);
+bool Animation::finishCreate()
+{
+    if (deviceSetup.joinable())
+        deviceSetup.join();
+    if (!backendDevice) {
+        Log(Log::Error) << "unable to create a device";
+        return false;
+    }
+
+    if (options.headless) {
+        offscreen = std::make_shared<OffscreenBinding>(backendDevice, kOffscreenTextureCount);
+        binding = offscreen;
+    } else {
+        binding = makeBackendBinding(mWindow, backendDevice);
+    }
 
+    // every buffer and texture created from here on is accounted for
+    backendProcs = GpuMemory::instance().install(backendProcs);
     dawnProcSetProcs(&backendProcs);
     backendProcs.deviceSetUncapturedErrorCallback(backendDevice, PrintDeviceError, nullptr);
     device = wgpu::Device::Acquire(backendDevice);
@@ -91,196 +283,1030 @@ void Animation::create(GLFWwindow* window, int w, int h)
     };
 
     queue = device.CreateQueue();
-    swapchain = GetSwapChain(device);
-    swapchain.Configure(GetPreferredSwapChainTextureFormat(), wgpu::TextureUsage::OutputAttachment, width, height);
+    objects = std::make_shared<ObjectCache>(device);
+    staging = std::make_unique<StagingRing>(device);
+    uniforms = std::make_unique<UniformArena>(device, *staging);
+    mipGenerator = std::make_unique<MipGenerator>(device, *objects);
+    if (offscreen) {
+        offscreen->Configure(GetPreferredSwapChainTextureFormat(),
+                             wgpu::TextureUsage::OutputAttachment | wgpu::TextureUsage::CopySrc,
+                             width, height);
+    } else {
+        swapchain = GetSwapChain(device);
+        swapchain.Configure(GetPreferredSwapChainTextureFormat(), wgpu::TextureUsage::OutputAttachment, width, height);
+    }
+
+    depthStencilView = CreateDefaultDepthStencilView(device, width, height);
+
+    // wire commands all go through one serializer, record on this thread
+    recorder = std::make_unique<SceneRecorder>(device, GetPreferredSwapChainTextureFormat(),
+                                               wgpu::TextureFormat::Depth24PlusStencil8,
+                                               options.wire ? 1 : options.recordThreads);
+
+    {
+        // partial redraws load the previous contents, LoadOp::Clear can't
+        // be limited to the scissor rect so the damaged area is cleared with
+        // a fullscreen triangle instead
+        wgpu::ShaderModule vsModule = objects->shaderModule(SingleShaderStage::Vertex, kClearVertexSource);
+        wgpu::ShaderModule fsModule = objects->shaderModule(SingleShaderStage::Fragment, kClearFragmentSource);
+
+        ComboRenderPipelineDescriptor descriptor(device);
+        descriptor.layout = objects->pipelineLayout(nullptr);
+        descriptor.vertexStage.module = vsModule;
+        descriptor.cFragmentStage.module = fsModule;
+        descriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleList;
+        descriptor.depthStencilState = &descriptor.cDepthStencilState;
+        descriptor.cDepthStencilState.format = wgpu::TextureFormat::Depth24PlusStencil8;
+        descriptor.cColorStates[0].format = GetPreferredSwapChainTextureFormat();
+        clearPipeline = objects->renderPipeline(descriptor);
+    }
+
+    if (options.dynamicResolution) {
+        // the scene goes into a target sized by the scaler, stretched over
+        // the backbuffer by a fullscreen triangle
+        wgpu::ShaderModule vsModule = objects->shaderModule(SingleShaderStage::Vertex, kUpscaleVertexSource);
+        wgpu::ShaderModule fsModule = objects->shaderModule(SingleShaderStage::Fragment, kUpscaleFragmentSource);
+
+        upscaleLayout = objects->bindGroupLayout({
+                {0, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+                {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture}
+            });
+
+        ComboRenderPipelineDescriptor descriptor(device);
+        descriptor.layout = objects->pipelineLayout(&upscaleLayout);
+        descriptor.vertexStage.module = vsModule;
+        descriptor.cFragmentStage.module = fsModule;
+        descriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleList;
+        descriptor.cColorStates[0].format = GetPreferredSwapChainTextureFormat();
+        upscalePipeline = objects->renderPipeline(descriptor);
+
+        const auto target = std::chrono::duration<double>(1.0 / std::max(options.targetFrameRate, 1.0f));
+        scaler = std::make_unique<ResolutionScaler>(std::chrono::duration_cast<std::chrono::nanoseconds>(target));
+        resizeSceneTarget();
+    }
+
+    // the quad's pipeline doesn't depend on the image, it's ready before
+    // the image is. The sprite batch draws instead of the quad and brings
+    // its own.
+    if (options.spriteCount == 0)
+        initPipelines();
+
+    if (!options.video.empty() && !initVideo())
+        return false;
+    if (!options.sequence.empty() && !initSequence())
+        return false;
+
+    if (!options.capturePath.empty()) {
+        capture = std::make_unique<FrameCapture>(device, GetPreferredSwapChainTextureFormat(), width, height,
+                                                 options.capturePath, options.captureFormat);
+        if (!capture->isValid())
+            return false;
+    }
+
+    if (options.statsOverlay) {
+        overlay = std::make_unique<StatsOverlay>(device, *objects, *staging, GetPreferredSwapChainTextureFormat(),
+                                                 width, height, options.targetFrameRate);
+        if (!overlay->isValid())
+            return false;
+    }
 
     wgpu::FenceDescriptor descriptor;
     descriptor.initialValue = fenceValue;
     fence = queue.CreateFence(&descriptor);
+
+    if (shaderWarmup.joinable())
+        shaderWarmup.join();
+    {
+        const ShaderCache& cache = ShaderCache::instance();
+        Log(Log::Info) << "shader cache:" << cache.memoryHits() << "memory hits,"
+                       << cache.diskHits() << "disk hits," << cache.misses() << "misses";
+        Log(Log::Info) << "object cache:" << objects->hits() << "hits," << objects->misses() << "misses";
+    }
+    const std::chrono::duration<double, std::milli> ready = std::chrono::steady_clock::now() - createTime;
+    Log(Log::Info) << "startup: device and pipelines ready after" << ready.count() << "ms";
+
+    startTime = std::chrono::steady_clock::now();
+
+    return true;
 }
 
-void Animation::init()
+void Animation::init(const std::shared_ptr<event::Loop>& l)
 {
-    fetch = net::Fetch::create();
-    decoder = image::Decoder::create();
+    loop = l;
+
+    std::vector<std::string> sources = options.assets;
+    if (sources.empty())
+        sources.push_back("https://www.google.com/images/branding/googlelogo/2x/googlelogo_color_272x92dp.png");
 
-    fetch->fetch("https://www.google.com/images/branding/googlelogo/2x/googlelogo_color_272x92dp.png").then([this](std::shared_ptr<buffer::Buffer>&& buffer) -> auto& {
-        if (!buffer) {
-            return reckoning::then::rejected<image::Decoder::Image>("no buffer from fetch");
+    assetLoader = std::make_unique<AssetLoader>(options.decodeThreads, options.maxDecodesInFlight);
+    assetLoader->setReadyCallback([this]() {
+        assetsReady = true;
+        requestFrame();
+    });
+    assetLoader->setFailedCallback([this](uint32_t id) {
+        // a first load that failed never made it into the cache
+        textures->reloadFailed(id);
+        requestFrame();
+    });
+    textures->setReloadCallback([this](uint32_t id, const TextureCache::Source& source) {
+        assetLoader->reload(id, source.source, source.pack, source.packIndex);
+    });
+    assetLoader->load(l, sources);
+}
+
+void Animation::uploadAssets()
+{
+    // decoded images are handed over by the loader's workers, their uploads
+    // all end up in this frame's staging submit
+    AssetLoader::Asset asset;
+    uint32_t i = 0;
+    for (; i < kMaxAssetUploadsPerFrame && assetLoader->next(asset); ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        if (options.spriteCount > 0) {
+            // the sprite batch copies the first image into its own texture
+            // array and draws nothing else, a cached texture of it would
+            // only take up the memory twice
+            if (!contentReady())
+                initContent(asset);
+            assetLoader->uploaded(asset, std::chrono::steady_clock::now() - start);
+            asset = AssetLoader::Asset();
+            continue;
         }
-        return decoder->decode(std::move(buffer), kTextureRowPitchAlignment);
-    }).then([this](image::Decoder::Image&& image) -> void {
-        if (!image.data) {
-            return;
+        // reloads come back under the id they had before
+        if (!textures->contains(asset.id))
+            assetIds.push_back(asset.id);
+        textures->insert(asset.id, createImageTexture(asset),
+                         TextureCache::textureSize(asset.width, asset.height, imageMipLevelCount(asset)),
+                         { asset.source, asset.pack, asset.packIndex });
+        if (!contentReady())
+            initContent(asset);
+        assetLoader->uploaded(asset, std::chrono::steady_clock::now() - start);
+        asset = AssetLoader::Asset();
+    }
+    // stopping at the cap means there may be more
+    assetsReady = i == kMaxAssetUploadsPerFrame;
+}
+
+uint32_t Animation::imageMipLevelCount(const AssetLoader::Asset& image) const
+{
+    // packs come with their mip chain, whether or not it was built
+    if (image.pack)
+        return image.pack->entry(image.packIndex).mipLevelCount;
+    // The quad covers the output, so its texture is only minified when the
+    // image is larger than that, a chain for a smaller one would never be
+    // sampled. The sprite batch has a chain of its own and no cached
+    // textures, its cells are what --mipmaps is mostly for.
+    if (!options.mipmaps
+        || (image.width <= static_cast<uint32_t>(width) && image.height <= static_cast<uint32_t>(height)))
+        return 1;
+    return MipGenerator::levelCount(image.width, image.height);
+}
+
+wgpu::Texture Animation::createImageTexture(const AssetLoader::Asset& image)
+{
+    wgpu::TextureDescriptor descriptor;
+    descriptor.dimension = wgpu::TextureDimension::e2D;
+    descriptor.size.width = image.width;
+    descriptor.size.height = image.height;
+    descriptor.size.depth = 1;
+    descriptor.arrayLayerCount = 1;
+    descriptor.sampleCount = 1;
+    descriptor.format = wgpu::TextureFormat::RGBA8Unorm;
+    descriptor.mipLevelCount = imageMipLevelCount(image);
+    descriptor.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::Sampled;
+    if (descriptor.mipLevelCount > 1 && !image.pack)
+        descriptor.usage |= wgpu::TextureUsage::OutputAttachment;
+    wgpu::Texture imageTexture = device.CreateTexture(&descriptor);
+
+    // recorded ahead of the render pass of the next frame
+    if (image.pack) {
+        const TexturePackEntry& entry = image.pack->entry(image.packIndex);
+        for (uint32_t level = 0; level < entry.mipLevelCount; ++level) {
+            staging->uploadTexture(image.pack->level(image.packIndex, level), entry.levelBytesPerRow[level],
+                                   TexturePack::levelWidth(entry, level), TexturePack::levelHeight(entry, level),
+                                   imageTexture, level);
         }
+        return imageTexture;
+    }
 
-        auto GetPreferredSwapChainTextureFormat = [this]() {
-            return static_cast<wgpu::TextureFormat>(binding->GetPreferredSwapChainTextureFormat());
-        };
-
-        // auto initBuffers = [this]() {
-            // static const uint32_t indexData[3] = {
-            //     0, 1, 2,
-            // };
-            // indexBuffer = CreateBufferFromData(device, indexData, sizeof(indexData),
-            //                                    wgpu::BufferUsage::Index);
-
-            // static const float vertexData[12] = {
-            //     0.0f, 0.5f, 0.0f, 1.0f,
-            //     -0.5f, -0.5f, 0.0f, 1.0f,
-            //     0.5f, -0.5f, 0.0f, 1.0f,
-            // };
-            // vertexBuffer = CreateBufferFromData(device, vertexData, sizeof(vertexData),
-            //                                     wgpu::BufferUsage::Vertex);
-        // };
+    staging->uploadTexture(image.pixels, image.bytesPerRow, image.width, image.height, imageTexture);
+    if (descriptor.mipLevelCount > 1)
+        pendingMips.push_back({ imageTexture, descriptor.mipLevelCount, 0 });
 
-        auto initTextures = [this, &image]() {
-            wgpu::TextureDescriptor descriptor;
-            descriptor.dimension = wgpu::TextureDimension::e2D;
-            descriptor.size.width = image.width;
-            descriptor.size.height = image.height;
-            descriptor.size.depth = 1;
-            descriptor.arrayLayerCount = 1;
-            descriptor.sampleCount = 1;
-            descriptor.format = wgpu::TextureFormat::RGBA8Unorm;
-            descriptor.mipLevelCount = 1;
-            descriptor.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::Sampled;
-            texture = device.CreateTexture(&descriptor);
-
-            wgpu::SamplerDescriptor samplerDesc = GetDefaultSamplerDescriptor();
-            sampler = device.CreateSampler(&samplerDesc);
-
-            wgpu::Buffer stagingBuffer = CreateBufferFromData(
-                device, image.data->data(), static_cast<uint32_t>(image.data->size()), wgpu::BufferUsage::CopySrc);
-            wgpu::BufferCopyView bufferCopyView = CreateBufferCopyView(stagingBuffer, 0, image.bpl, 0);
-            wgpu::TextureCopyView textureCopyView = CreateTextureCopyView(texture, 0, 0, {0, 0, 0});
-            wgpu::Extent3D copySize = {image.width, image.height, 1};
-
-            wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
-            encoder.CopyBufferToTexture(&bufferCopyView, &textureCopyView, &copySize);
-
-            wgpu::CommandBuffer copy = encoder.Finish();
-            queue.Submit(1, &copy);
-        };
-
-        // initBuffers();
-        initTextures();
-
-        // wgpu::ShaderModule vsModule =
-        // CreateShaderModule(device, SingleShaderStage::Vertex, R"(
-        // #version 450
-        // layout(location = 0) in vec4 pos;
-        // void main() {
-        //     gl_Position = pos;
-        // })");
-
-        wgpu::ShaderModule vsModule =
-        CreateShaderModule(device, SingleShaderStage::Vertex, R"(
-        #version 450
-
-        layout(set = 0, binding = 2) uniform UniformBufferObject {
-            vec4 geometry;
-        } ubo;
-
-        vec2 positions[4] = vec2[](
-            vec2(-1.0, +1.0),
-            vec2(+1.0, +1.0),
-            vec2(-1.0, -1.0),
-            vec2(+1.0, -1.0)
-        );
-
-        void main() {
-            vec2 position = positions[gl_VertexIndex];
-            int x = position.x == -1.0 ? 0 : 2;
-            int y = position.y == +1.0 ? 1 : 3;
-            gl_Position = vec4(ubo.geometry[x], ubo.geometry[y], 0.0, 1.0);
-        })");
-
-        wgpu::ShaderModule fsModule =
-        CreateShaderModule(device, SingleShaderStage::Fragment, R"(
-        #version 450
-        layout(set = 0, binding = 0) uniform sampler mySampler;
-        layout(set = 0, binding = 1) uniform texture2D myTexture;
-
-        layout(location = 0) out vec4 fragColor;
-        void main() {
-            fragColor = texture(sampler2D(myTexture, mySampler), gl_FragCoord.xy / vec2(1280.0, 720.0));
-        })");
-
-        auto bgl = MakeBindGroupLayout(
-            device, {
-                {0, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
-                {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture},
-                {2, wgpu::ShaderStage::Vertex, wgpu::BindingType::UniformBuffer}
-            });
+    return imageTexture;
+}
 
-        wgpu::PipelineLayout pl = MakeBasicPipelineLayout(device, &bgl);
+void Animation::initPipelines()
+{
+    auto GetPreferredSwapChainTextureFormat = [this]() {
+        return static_cast<wgpu::TextureFormat>(binding->GetPreferredSwapChainTextureFormat());
+    };
 
-        depthStencilView = CreateDefaultDepthStencilView(device, width, height);
+    sampler = objects->sampler(GetDefaultSamplerDescriptor());
 
-        ComboRenderPipelineDescriptor descriptor(device);
-        descriptor.layout = MakeBasicPipelineLayout(device, &bgl);
-        descriptor.vertexStage.module = vsModule;
-        descriptor.cFragmentStage.module = fsModule;
-        descriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleStrip;
-        // descriptor.cVertexState.vertexBufferCount = 1;
-        // descriptor.cVertexState.cVertexBuffers[0].arrayStride = 4 * sizeof(float);
-        // descriptor.cVertexState.cVertexBuffers[0].attributeCount = 1;
-        // descriptor.cVertexState.cAttributes[0].format = wgpu::VertexFormat::Float4;
-        descriptor.depthStencilState = &descriptor.cDepthStencilState;
-        descriptor.cDepthStencilState.format = wgpu::TextureFormat::Depth24PlusStencil8;
-        descriptor.cColorStates[0].format = GetPreferredSwapChainTextureFormat();
-        descriptor.cColorStates[0].colorBlend.srcFactor = wgpu::BlendFactor::SrcAlpha;
-        descriptor.cColorStates[0].colorBlend.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+    // wgpu::ShaderModule vsModule =
+    // CreateShaderModule(device, SingleShaderStage::Vertex, R"(
+    // #version 450
+    // layout(location = 0) in vec4 pos;
+    // void main() {
+    //     gl_Position = pos;
+    // })");
 
-        pipeline = device.CreateRenderPipeline(&descriptor);
+    wgpu::ShaderModule vsModule = objects->shaderModule(SingleShaderStage::Vertex, kQuadVertexSource);
 
-        wgpu::TextureView view = texture.CreateView();
+    wgpu::ShaderModule fsModule = objects->shaderModule(SingleShaderStage::Fragment, kQuadFragmentSource);
 
-        UniformGeometry geom = { { -1.0, 1.0, 1.0, -1.0 } };
+    contentLayout = objects->bindGroupLayout({
+        {0, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+        {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture},
+        {2, wgpu::ShaderStage::Vertex, wgpu::BindingType::UniformBuffer, true}
+    });
 
-        wgpu::Buffer ubo = CreateBufferFromData(
-            device, &geom, sizeof(geom), wgpu::BufferUsage::Uniform);
+    ComboRenderPipelineDescriptor descriptor(device);
+    descriptor.layout = objects->pipelineLayout(&contentLayout);
+    descriptor.vertexStage.module = vsModule;
+    descriptor.cFragmentStage.module = fsModule;
+    descriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleStrip;
+    // descriptor.cVertexState.vertexBufferCount = 1;
+    // descriptor.cVertexState.cVertexBuffers[0].arrayStride = 4 * sizeof(float);
+    // descriptor.cVertexState.cVertexBuffers[0].attributeCount = 1;
+    // descriptor.cVertexState.cAttributes[0].format = wgpu::VertexFormat::Float4;
+    descriptor.depthStencilState = &descriptor.cDepthStencilState;
+    descriptor.cDepthStencilState.format = wgpu::TextureFormat::Depth24PlusStencil8;
+    descriptor.cColorStates[0].format = GetPreferredSwapChainTextureFormat();
+    descriptor.cColorStates[0].colorBlend.srcFactor = wgpu::BlendFactor::SrcAlpha;
+    descriptor.cColorStates[0].colorBlend.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
 
-        bindGroup = MakeBindGroup(device, bgl, {
-                {0, sampler},
-                {1, view},
-                {2, ubo}
-            });
+    pipeline = objects->renderPipeline(descriptor);
+}
+
+void Animation::initContent(const AssetLoader::Asset& image)
+{
+    // auto initBuffers = [this]() {
+        // static const uint32_t indexData[3] = {
+        //     0, 1, 2,
+        // };
+        // indexBuffer = CreateBufferFromData(device, indexData, sizeof(indexData),
+        //                                    wgpu::BufferUsage::Index);
 
-        ComboRenderBundleEncoderDescriptor bundleDescriptor;
-        bundleDescriptor.colorFormatsCount = 1;
-        bundleDescriptor.cColorFormats[0] = GetPreferredSwapChainTextureFormat();
-        bundleDescriptor.depthStencilFormat = wgpu::TextureFormat::Depth24PlusStencil8;
+        // static const float vertexData[12] = {
+        //     0.0f, 0.5f, 0.0f, 1.0f,
+        //     -0.5f, -0.5f, 0.0f, 1.0f,
+        //     0.5f, -0.5f, 0.0f, 1.0f,
+        // };
+        // vertexBuffer = CreateBufferFromData(device, vertexData, sizeof(vertexData),
+        //                                     wgpu::BufferUsage::Vertex);
+    // };
+
+    auto initTextures = [this, &image]() {
+        texture = textures->acquire(image.id);
+        contentAsset = pageTarget = image.id;
+    };
+
+    // the batch samples its own texture array, none of the quad's
+    // texture, pipeline, uniforms or bundle are built
+    if (options.spriteCount > 0) {
+        initSprites(image);
+        contentInitialized = true;
+        addMediaLayers();
+        damageTracker->damageAll();
+        return;
+    }
+
+    // initBuffers();
+    initTextures();
+
+    wgpu::TextureView view = texture.CreateView();
+
+    // the geometry lives in a slot of the shared uniform arena, bound
+    // through a dynamic offset
+    geometryOffset = uniforms->allocate();
+    if (geometryOffset == UniformArena::kInvalidOffset)
+        return;
+    UniformGeometry geom = { { -1.0, 1.0, 1.0, -1.0 } };
+    uniforms->write(geometryOffset, geom);
+    if (options.animate) {
+        // breathe in and out every two seconds
+        const glm::vec4 inset = { -0.9f, 0.9f, 0.9f, -0.9f };
+        geometryTimeline.addTrack({
+            { 0.0f, geom.geometry, Timeline::Easing::EaseInOut },
+            { 1.0f, inset, Timeline::Easing::EaseInOut },
+            { 2.0f, geom.geometry, Timeline::Easing::Linear }
+        }, 0.0f, true);
+    }
+
+    bindGroup = MakeBindGroup(device, contentLayout, {
+            {0, sampler},
+            {1, view},
+            {2, uniforms->buffer(), 0, uniforms->bindingSize()}
+        }, frameArena);
 
-        wgpu::RenderBundleEncoder renderBundleEncoder = device.CreateRenderBundleEncoder(&bundleDescriptor);
+    contentLayer = recorder->addLayer([this](const wgpu::RenderBundleEncoder& renderBundleEncoder) {
         renderBundleEncoder.SetPipeline(pipeline);
-        renderBundleEncoder.SetBindGroup(0, bindGroup);
+        renderBundleEncoder.SetBindGroup(0, bindGroup, 1, &geometryOffset);
         // renderBundleEncoder.SetVertexBuffer(0, vertexBuffer);
         // renderBundleEncoder.SetIndexBuffer(indexBuffer);
         // renderBundleEncoder.DrawIndexed(3, 1, 0, 0, 0);
         renderBundleEncoder.Draw(4, 1, 0, 0);
-        wgpu::RenderBundle bundle = renderBundleEncoder.Finish();
+    }, { image.id });
+    nextPage = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<float>(options.pageInterval));
+    contentInitialized = true;
+    addMediaLayers();
+    damageTracker->damageAll();
+}
 
-        bundles.push_back(bundle);
-    });
+void Animation::initSprites(const AssetLoader::Asset& image)
+{
+    spriteBatch = std::make_unique<SpriteBatch>(
+        device, *objects, *staging,
+        static_cast<wgpu::TextureFormat>(binding->GetPreferredSwapChainTextureFormat()),
+        wgpu::TextureFormat::Depth24PlusStencil8,
+        image.width, image.height, 1,
+        options.mipmaps ? MipGenerator::levelCount(image.width, image.height) : 1);
+    if (!spriteBatch->isValid()) {
+        spriteBatch.reset();
+        return;
+    }
+
+    const glm::vec4 uvRect = spriteBatch->uploadLayer(0, image.pixels, image.bytesPerRow, image.width, image.height);
+    if (spriteBatch->mipLevelCount() > 1)
+        pendingMips.push_back({ spriteBatch->texture(), spriteBatch->mipLevelCount(), 0 });
+
+    // lay the sprites out in a grid covering the target
+    const uint32_t count = options.spriteCount;
+    const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    const uint32_t rows = (count + columns - 1) / columns;
+    const float w = 2.0f / columns;
+    const float h = 2.0f / rows;
+    for (uint32_t i = 0; i < count; ++i) {
+        const float left = -1.0f + (i % columns) * w;
+        const float top = 1.0f - (i / columns) * h;
+        const glm::vec4 geometry = { left, top, left + w, top - h };
+        spriteBatch->add({ geometry, uvRect, { 0.0f, 1.0f, 0.0f, 0.0f } });
+        spriteBounds = i ? glm::vec4(std::min(spriteBounds.x, geometry.x), std::max(spriteBounds.y, geometry.y),
+                                     std::max(spriteBounds.z, geometry.z), std::min(spriteBounds.w, geometry.w))
+                         : geometry;
+
+        if (options.animate) {
+            // bob by a quarter of a cell, staggered along the grid
+            const glm::vec4 raised = { left, top + h * 0.25f, left + w, top - h * 0.75f };
+            spriteTimeline.addTrack({
+                { 0.0f, geometry, Timeline::Easing::EaseOut },
+                { 0.5f, raised, Timeline::Easing::EaseIn },
+                { 1.0f, geometry, Timeline::Easing::Linear }
+            }, (i % columns) * 0.02f + (i / columns) * 0.01f, true);
+            spriteBounds.y = std::max(spriteBounds.y, raised.y);
+        }
+    }
+
+    // a layer per run of sprites, so recording a big batch is spread
+    // over the recorder's threads
+    for (uint32_t first = 0; first < count; first += kSpritesPerSceneLayer) {
+        recorder->addLayer([this, first](const wgpu::RenderBundleEncoder& encoder) {
+            spriteBatch->encode(encoder, first, kSpritesPerSceneLayer);
+        });
+    }
+    spriteGeneration = spriteBatch->generation();
+    Log(Log::Info) << "sprite batch:" << count << "sprites in" << columns << "x" << rows << ","
+                   << recorder->layerCount() << "layers";
 }
 
 void Animation::frame()
 {
-    wgpu::TextureView backbufferView = swapchain.GetCurrentTextureView();
-    ComboRenderPassDescriptor renderPass({backbufferView}, depthStencilView);
+    Profiler::Scope frameScope("frame");
+    const auto frameStart = std::chrono::steady_clock::now();
+    backbufferWait = std::chrono::nanoseconds::zero();
+
+    frameArena.reset();
+    staging->retire(fence.GetCompletedValue());
+    if (capture)
+        capture->retire(fence.GetCompletedValue());
+    if (sequence)
+        sequence->retire(fence.GetCompletedValue());
+
+    {
+        Profiler::Scope scope("upload");
+        if (assetLoader)
+            uploadAssets();
+        pageContent();
+        updateVideo();
+        if (sequence) {
+            const double time = currentTime();
+            sequenceFrame = sequenceFrameAt(time);
+            // nothing to redraw before the scene and its layer are there
+            if (sequence->advance(time) && sequenceLayer != kNoLayer) {
+                damageTracker->damage(sequenceGeometry);
+                recorder->invalidate(sequenceLayer);
+            }
+        }
+        animate();
+        if (spriteBatch) {
+            spriteBatch->update();
+            // every layer draws sprites
+            if (spriteBatch->generation() != spriteGeneration) {
+                spriteGeneration = spriteBatch->generation();
+                recorder->invalidateAll();
+            }
+        }
+        if (overlay) {
+            const auto now = std::chrono::steady_clock::now();
+            overlay->addFrame(now);
+            if (overlay->due(now)) {
+                overlay->update(now, GpuMemory::instance().stats());
+                damageTracker->damage(overlay->rect());
+            }
+        }
+        uniforms->update();
+    }
+
+    // empty when this frame only carries uploads
+    const DamageTracker::Rect region = damageTracker->redraw(offscreen ? offscreen->GetCurrentIndex() : 0);
+
+    wgpu::CommandBuffer commands;
+    {
+        Profiler::Scope scope("encode");
+        wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+        // pending uploads, retired once this frame's fence has passed
+        staging->record(encoder, fenceValue + 1);
+        // the sequence's frame goes straight from its own upload buffer
+        if (sequence)
+            sequence->record(encoder, fenceValue + 1);
+        for (const PendingMips& mips : pendingMips) {
+            mipGenerator->generate(encoder, mips.texture, wgpu::TextureFormat::RGBA8Unorm, mips.levelCount, mips.arrayLayer);
+        }
+        pendingMips.clear();
+        if (!region.empty()) {
+            const bool partial = region.width < damageTracker->width() || region.height < damageTracker->height();
+            // the scene target keeps its contents, so only the damaged
+            // area of it is redrawn as well
+            const DamageTracker::Rect sceneRegion = scaler ? scaleRegion(region) : region;
+            ComboRenderPassDescriptor renderPass({scaler ? sceneView : currentBackbufferView()}, depthStencilView);
+            if (partial)
+                renderPass.cColorAttachments[0].loadOp = wgpu::LoadOp::Load;
+
+            const std::vector<wgpu::RenderBundle>* bundles;
+            {
+                Profiler::Scope recordScope("record");
+                bundles = &recorder->bundles();
+            }
+
+            wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPass);
+            if (partial) {
+                pass.SetScissorRect(sceneRegion.x, sceneRegion.y, sceneRegion.width, sceneRegion.height);
+                pass.SetPipeline(clearPipeline);
+                pass.Draw(3, 1, 0, 0);
+            }
+            if (!bundles->empty()) {
+                pass.ExecuteBundles(bundles->size(), bundles->data());
+            }
+            pass.EndPass();
+
+            if (scaler) {
+                ComboRenderPassDescriptor upscalePass({currentBackbufferView()});
+                if (partial)
+                    upscalePass.cColorAttachments[0].loadOp = wgpu::LoadOp::Load;
+                wgpu::RenderPassEncoder upscale = encoder.BeginRenderPass(&upscalePass);
+                if (partial)
+                    upscale.SetScissorRect(region.x, region.y, region.width, region.height);
+                upscale.SetPipeline(upscalePipeline);
+                upscale.SetBindGroup(0, upscaleBindGroup);
+                upscale.Draw(3, 1, 0, 0);
+                upscale.EndPass();
+            }
+            // over the output, whatever the scene's resolution
+            if (overlay) {
+                ComboRenderPassDescriptor overlayPass({currentBackbufferView()});
+                overlayPass.cColorAttachments[0].loadOp = wgpu::LoadOp::Load;
+                wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&overlayPass);
+                if (partial)
+                    pass.SetScissorRect(region.x, region.y, region.width, region.height);
+                overlay->encode(pass);
+                pass.EndPass();
+            }
+            // read back once this frame's fence has passed, dropped when
+            // the readback falls behind
+            if (capture)
+                capture->record(encoder, offscreen->GetCurrentTexture(), fenceValue + 1);
+        }
+        commands = encoder.Finish();
+    }
+
+    // whatever the scene's bundles sample stays resident
+    for (uint32_t layer = 0; layer < recorder->layerCount(); ++layer) {
+        for (uint32_t id : recorder->resources(layer)) {
+            textures->touch(id);
+        }
+    }
+    textures->endFrame();
 
-    wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
     {
-        wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPass);
-        if (!bundles.empty()) {
-            pass.ExecuteBundles(bundles.size(), &bundles[0]);
+        Profiler::Scope scope("submit");
+        queue.Submit(1, &commands);
+    }
+    if (scaler) {
+        InFlightFrame& slot = inFlight[frameIndex];
+        slot.submitted = std::chrono::steady_clock::now();
+        slot.cpuTime = slot.submitted - frameStart - backbufferWait;
+        slot.pending = true;
+        slot.done = false;
+        // upload only frames say nothing about what the scene costs
+        slot.rendered = !region.empty();
+    }
+    if (!region.empty()) {
+        Profiler::Scope scope("present");
+        present();
+    }
+}
+
+void Animation::animate()
+{
+    Profiler::Scope scope("animate");
+    const double time = currentTime();
+
+    // evaluated straight into the uniform arena and the sprite instances,
+    // damaging where things were and where they are now
+    if (geometryOffset != UniformArena::kInvalidOffset && !geometryTimeline.idle(time)) {
+        glm::vec4* geometry = static_cast<glm::vec4*>(uniforms->edit(geometryOffset, sizeof(UniformGeometry)));
+        damageTracker->damage(*geometry);
+        geometryTimeline.evaluate(time, geometry, kUniformSlotSize);
+        damageTracker->damage(*geometry);
+    }
+    if (spriteBatch && spriteTimeline.trackCount() == spriteBatch->count() && !spriteTimeline.idle(time)) {
+        SpriteBatch::Sprite* sprites = spriteBatch->edit(0, spriteBatch->count());
+        spriteTimeline.evaluate(time, &sprites->geometry, sizeof(SpriteBatch::Sprite));
+        damageTracker->damage(spriteBounds);
+    }
+}
+
+void Animation::pageContent()
+{
+    if (!pageDue() && pageTarget == contentAsset)
+        return;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (pageTarget == contentAsset) {
+        auto it = std::find(assetIds.begin(), assetIds.end(), contentAsset);
+        pageTarget = it == assetIds.end() || it + 1 == assetIds.end() ? assetIds.front() : *(it + 1);
+    }
+
+    // an evicted texture is being reloaded, keep showing the current one
+    // and try again once it's back or the interval has passed once more,
+    // rather than on every frame until then
+    wgpu::Texture next = textures->acquire(pageTarget);
+    if (!next) {
+        if (textures->isFailed(pageTarget)) {
+            // gone for good, the next page skips it
+            assetIds.erase(std::find(assetIds.begin(), assetIds.end(), pageTarget));
+            pageTarget = contentAsset;
+            nextPage = now;
+            return;
+        }
+        nextPage = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<float>(options.pageInterval));
+        return;
+    }
+
+    texture = next;
+    contentAsset = pageTarget;
+    bindGroup = MakeBindGroup(device, contentLayout, {
+            {0, sampler},
+            {1, texture.CreateView()},
+            {2, uniforms->buffer(), 0, uniforms->bindingSize()}
+        }, frameArena);
+    recorder->setResources(contentLayer, { contentAsset });
+    recorder->invalidate(contentLayer);
+    damageTracker->damageAll();
+    nextPage = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<float>(options.pageInterval));
+}
+
+wgpu::TextureView Animation::currentBackbufferView()
+{
+    if (offscreen)
+        return offscreen->GetCurrentTextureView();
+    if (!scaler)
+        return swapchain.GetCurrentTextureView();
+    // a FIFO swapchain blocks here until the next refresh, which says
+    // nothing about what the frame costs
+    const auto start = std::chrono::steady_clock::now();
+    wgpu::TextureView view = swapchain.GetCurrentTextureView();
+    backbufferWait += std::chrono::steady_clock::now() - start;
+    return view;
+}
+
+void Animation::present()
+{
+    if (offscreen)
+        offscreen->Present();
+    else
+        swapchain.Present();
+
+    // the first frame is cleared while the assets are still loading, the
+    // content shows up in a later one
+    if (!firstFramePresented || (!firstContentPresented && contentReady())) {
+        const auto now = std::chrono::steady_clock::now();
+        const std::chrono::duration<double, std::milli> elapsed = now - createTime;
+        if (!firstFramePresented) {
+            firstFramePresented = true;
+            Profiler::instance().record("time to first frame", createTime, now);
+            Log(Log::Info) << "startup: first frame after" << elapsed.count() << "ms";
+        }
+        if (!firstContentPresented && contentReady()) {
+            firstContentPresented = true;
+            Profiler::instance().record("time to first content", createTime, now);
+            Log(Log::Info) << "startup: first content after" << elapsed.count() << "ms";
+        }
+    }
+}
+
+bool Animation::start()
+{
+    if (!device && !finishCreate())
+        return false;
+    started = true;
+    renderFrames();
+    return true;
+}
+
+void Animation::flushCapture()
+{
+    if (!capture)
+        return;
+    const auto deadline = std::chrono::steady_clock::now() + kCaptureFlushTimeout;
+    while (capture->pending() && std::chrono::steady_clock::now() < deadline) {
+        tick();
+        std::this_thread::sleep_for(1ms);
+    }
+}
+
+bool Animation::needsFrame() const
+{
+    if (!options.onDemand)
+        return true;
+    if (damageTracker->dirty() || assetsReady || !pendingMips.empty() || staging->hasPendingCopies() || pageDue())
+        return true;
+    // playing media only needs a frame once its next one is due, the loop
+    // sleeps until then (idleTimeout())
+    if (mediaFrameDue(currentTime()))
+        return true;
+    if (overlay && overlay->due(std::chrono::steady_clock::now()))
+        return true;
+    const double time = currentTime();
+    return !geometryTimeline.idle(time) || !spriteTimeline.idle(time);
+}
+
+void Animation::requestFrame()
+{
+    // with a fence callback pending the frame is recorded once it fires
+    if (started && !fenceCallbackPending)
+        renderFrames();
+}
+
+double Animation::currentTime() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+bool Animation::initVideo()
+{
+    const uint64_t frameSize = VideoTexture::frameSize(options.videoFormat, options.videoWidth, options.videoHeight);
+    if (!frameSize) {
+        Log(Log::Error) << "video size not set";
+        return false;
+    }
+    videoFile = MappedFile::open(options.video);
+    if (!videoFile) {
+        Log(Log::Error) << "unable to open video" << options.video;
+        return false;
+    }
+    videoFrameCount = videoFile->size() / frameSize;
+    if (!videoFrameCount) {
+        Log(Log::Error) << "video" << options.video << "is smaller than a single frame";
+        return false;
+    }
+
+    video = std::make_unique<VideoTexture>(device, *objects, *staging, *uniforms,
+                                           static_cast<wgpu::TextureFormat>(binding->GetPreferredSwapChainTextureFormat()),
+                                           wgpu::TextureFormat::Depth24PlusStencil8,
+                                           options.videoFormat, options.videoWidth, options.videoHeight);
+    if (!video->isValid())
+        return false;
+    videoGeometryOffset = uniforms->allocate();
+    if (videoGeometryOffset == UniformArena::kInvalidOffset)
+        return false;
+
+    videoGeometry = letterbox(options.videoWidth, options.videoHeight, width, height);
+    uniforms->write(videoGeometryOffset, UniformGeometry { videoGeometry });
+
+    // its layer goes over the scene's, added along with them by initContent()
+    Log(Log::Info) << "video:" << videoFrameCount << "frames of" << options.videoWidth << "x" << options.videoHeight;
+    return true;
+}
+
+bool Animation::initSequence()
+{
+    sequencePack = TexturePack::open(options.sequence);
+    if (!sequencePack || !sequencePack->count()) {
+        Log(Log::Error) << "unable to open sequence" << options.sequence;
+        return false;
+    }
+    const TexturePackEntry& first = sequencePack->entry(0);
+    for (uint32_t i = 1; i < sequencePack->count(); ++i) {
+        const TexturePackEntry& entry = sequencePack->entry(i);
+        if (entry.width != first.width || entry.height != first.height) {
+            Log(Log::Error) << "sequence" << options.sequence << "has frames of different sizes";
+            return false;
+        }
+    }
+
+    // reads the mapped pack on the producer thread, page faults included
+    std::shared_ptr<TexturePack> pack = sequencePack;
+    auto fill = [pack](uint64_t frame, uint8_t* data, uint32_t rowPitch) -> bool {
+        const uint32_t index = static_cast<uint32_t>(frame % pack->count());
+        const TexturePackEntry& entry = pack->entry(index);
+        const uint8_t* pixels = pack->level(index, 0);
+        const uint32_t rowSize = entry.width * 4;
+        for (uint32_t y = 0; y < entry.height; ++y) {
+            memcpy(data + static_cast<uint64_t>(y) * rowPitch,
+                   pixels + static_cast<uint64_t>(y) * entry.levelBytesPerRow[0], rowSize);
+        }
+        return true;
+    };
+    // released slots wait for every frame in flight
+    const uint32_t slotCount = std::max<uint32_t>(kStreamingTextureSlotCount, static_cast<uint32_t>(inFlight.size()) + 2);
+    sequence = std::make_unique<StreamingTexture>(device, *objects, *uniforms,
+                                                  static_cast<wgpu::TextureFormat>(binding->GetPreferredSwapChainTextureFormat()),
+                                                  wgpu::TextureFormat::Depth24PlusStencil8,
+                                                  first.width, first.height,
+                                                  1.0 / std::max(options.sequenceFrameRate, 1.0f), std::move(fill), slotCount);
+    if (!sequence->isValid())
+        return false;
+    sequenceGeometryOffset = uniforms->allocate();
+    if (sequenceGeometryOffset == UniformArena::kInvalidOffset)
+        return false;
+    sequenceGeometry = letterbox(first.width, first.height, width, height);
+    uniforms->write(sequenceGeometryOffset, UniformGeometry { sequenceGeometry });
+
+    // its layer goes over the scene's, added along with them by initContent()
+    Log(Log::Info) << "sequence:" << sequencePack->count() << "frames of" << first.width << "x" << first.height
+                   << "," << slotCount << "slots";
+    return true;
+}
+
+void Animation::addMediaLayers()
+{
+    // the planes are updated in place, the bundle never changes
+    if (video) {
+        recorder->addLayer([this](const wgpu::RenderBundleEncoder& renderBundleEncoder) {
+            video->encode(renderBundleEncoder, videoGeometryOffset);
+        });
+    }
+    // bound to whichever slot is current, recorded again on every new frame
+    if (sequence) {
+        sequenceLayer = recorder->addLayer([this](const wgpu::RenderBundleEncoder& renderBundleEncoder) {
+            sequence->encode(renderBundleEncoder, sequenceGeometryOffset);
+        });
+    }
+}
+
+uint64_t Animation::videoFrameAt(double time) const
+{
+    return static_cast<uint64_t>(time * options.videoFrameRate) % videoFrameCount;
+}
+
+uint64_t Animation::sequenceFrameAt(double time) const
+{
+    return static_cast<uint64_t>(time * std::max(options.sequenceFrameRate, 1.0f));
+}
+
+bool Animation::mediaFrameDue(double time) const
+{
+    // whether the producer has filled the sequence's frame in time only
+    // advance() knows, one that comes late is shown with the next
+    return (video && videoFrameAt(time) != videoFrame) || (sequence && sequenceFrameAt(time) != sequenceFrame);
+}
+
+std::chrono::milliseconds Animation::idleTimeout(std::chrono::milliseconds max) const
+{
+    if (!idle)
+        return max;
+
+    const auto now = std::chrono::steady_clock::now();
+    auto next = now + max;
+    if (video) {
+        // the start of the next video frame
+        const double frame = std::floor(currentTime() * options.videoFrameRate) + 1.0;
+        next = std::min(next, startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(frame / options.videoFrameRate)));
+    }
+    if (sequence) {
+        const double rate = std::max(options.sequenceFrameRate, 1.0f);
+        const double frame = static_cast<double>(sequenceFrameAt(currentTime()) + 1);
+        next = std::min(next, startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(frame / rate)));
+    }
+    if (options.pageInterval > 0.0f && contentLayer != kNoLayer && assetIds.size() > 1)
+        next = std::min(next, nextPage);
+
+    // rounded up, waking before it's due would only go back to sleep
+    if (next <= now)
+        return std::chrono::milliseconds(0);
+    return std::chrono::ceil<std::chrono::milliseconds>(next - now);
+}
+
+void Animation::updateVideo()
+{
+    if (!video)
+        return;
+    const uint64_t frame = videoFrameAt(currentTime());
+    if (frame == videoFrame)
+        return;
+    videoFrame = frame;
+    const uint64_t frameSize = VideoTexture::frameSize(options.videoFormat, options.videoWidth, options.videoHeight);
+    video->upload(videoFile->data() + frame * frameSize);
+    ++videoUploads;
+    damageTracker->damage(videoGeometry);
+}
+
+void Animation::resizeSceneTarget()
+{
+    const uint32_t w = scaler->scaled(width);
+    const uint32_t h = scaler->scaled(height);
+    if (w == sceneWidth && h == sceneHeight)
+        return;
+    sceneWidth = w;
+    sceneHeight = h;
+
+    // frames in flight hold on to the previous targets until the gpu is done
+    // with them, nothing waits here
+    wgpu::TextureDescriptor descriptor;
+    descriptor.dimension = wgpu::TextureDimension::e2D;
+    descriptor.size.width = sceneWidth;
+    descriptor.size.height = sceneHeight;
+    descriptor.size.depth = 1;
+    descriptor.arrayLayerCount = 1;
+    descriptor.sampleCount = 1;
+    descriptor.format = static_cast<wgpu::TextureFormat>(binding->GetPreferredSwapChainTextureFormat());
+    descriptor.mipLevelCount = 1;
+    descriptor.usage = wgpu::TextureUsage::OutputAttachment | wgpu::TextureUsage::Sampled;
+    sceneView = device.CreateTexture(&descriptor).CreateView();
+    depthStencilView = CreateDefaultDepthStencilView(device, sceneWidth, sceneHeight);
+
+    wgpu::SamplerDescriptor samplerDesc = GetDefaultSamplerDescriptor();
+    // repeating would bleed the opposite edge into the border pixels
+    samplerDesc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    upscaleBindGroup = MakeBindGroup(device, upscaleLayout, {
+            {0, objects->sampler(samplerDesc)},
+            {1, sceneView}
+        }, frameArena);
+
+    // a new target has no contents yet
+    damageTracker->damageAll();
+    Log(Log::Debug) << "render scale" << scaler->scale() << "," << sceneWidth << "x" << sceneHeight;
+}
+
+DamageTracker::Rect Animation::scaleRegion(const DamageTracker::Rect& region) const
+{
+    // rounded outwards, the upscale samples half a texel around each pixel
+    DamageTracker::Rect scaled;
+    const uint64_t x0 = static_cast<uint64_t>(region.x) * sceneWidth / width;
+    const uint64_t y0 = static_cast<uint64_t>(region.y) * sceneHeight / height;
+    const uint64_t x1 = (static_cast<uint64_t>(region.x + region.width) * sceneWidth + width - 1) / width;
+    const uint64_t y1 = (static_cast<uint64_t>(region.y + region.height) * sceneHeight + height - 1) / height;
+    scaled.x = static_cast<uint32_t>(x0 ? x0 - 1 : 0);
+    scaled.y = static_cast<uint32_t>(y0 ? y0 - 1 : 0);
+    scaled.width = static_cast<uint32_t>(std::min<uint64_t>(x1 + 1, sceneWidth)) - scaled.x;
+    scaled.height = static_cast<uint32_t>(std::min<uint64_t>(y1 + 1, sceneHeight)) - scaled.y;
+    return scaled;
+}
+
+void Animation::renderFrames()
+{
+    while (frameAvailable()) {
+        const auto now = std::chrono::steady_clock::now();
+        if (scaler)
+            measureFrames();
+        if (stalled) {
+            Profiler::instance().record("fence wait", stallStart, now);
+            stallTime += now - stallStart;
+            ++stallCount;
+            stalled = false;
+        }
+
+        // nothing changed, stay idle until requestFrame()
+        if (!needsFrame()) {
+            if (!idle) {
+                idle = true;
+                idleStart = now;
+            }
+            return;
+        }
+        if (idle) {
+            const std::chrono::duration<double> idleFor = now - idleStart;
+            idleDuration += std::chrono::duration_cast<std::chrono::nanoseconds>(idleFor);
+            skippedFrames += idleFor / frameInterval;
+            idle = false;
+        } else if (lastFrameTime != std::chrono::steady_clock::time_point()) {
+            frameInterval = frameInterval * 0.9 + std::chrono::duration<double>(now - lastFrameTime) * 0.1;
         }
-        pass.EndPass();
+        lastFrameTime = now;
+
+        frame();
+        signalFence();
+        // one wire flush per frame, the server sees the whole frame at once
+        if (wire)
+            wire->flush();
+    }
+
+    // every frame slot is owned by the gpu, wait for the oldest one to retire
+    if (!stalled) {
+        stalled = true;
+        stallStart = std::chrono::steady_clock::now();
+    }
+    if (!fenceCallbackPending) {
+        fenceCallbackPending = true;
+        fence.OnCompletion(inFlight[frameIndex].fenceValue, onFenceCompleted, this);
+        if (wire)
+            wire->flush();
+    }
+}
+
+void Animation::measureFrames()
+{
+    // Without timestamp queries a frame's gpu time is from when the gpu
+    // could start on it, once submitted and done with the frame before,
+    // to when its fence completed, timed in the callback rather than when
+    // the loop gets around to looking. The interval between frames isn't
+    // used, presenting to a FIFO swapchain pins it at the refresh rate
+    // whatever the work.
+    const uint32_t count = static_cast<uint32_t>(inFlight.size());
+    // oldest first, frameIndex is the next slot to be reused
+    for (uint32_t i = 0; i < count; ++i) {
+        InFlightFrame& slot = inFlight[(frameIndex + i) % count];
+        if (!slot.pending || !slot.done)
+            continue;
+        slot.pending = false;
+        const auto previousCompleted = gpuDone;
+        gpuDone = slot.completed;
+        // completions that happened while idle are only timed once the
+        // loop wakes up
+        if (!slot.rendered || idle)
+            continue;
+        if (scaler->addFrame(ResolutionScaler::frameTime(slot.cpuTime, slot.submitted, previousCompleted, slot.completed)))
+            resizeSceneTarget();
+    }
+}
+
+void Animation::onFrameCompleted(WGPUFenceCompletionStatus status, void* userdata)
+{
+    // cancelled as the fence is destroyed, the slot may be gone by then
+    if (status != WGPUFenceCompletionStatus_Success)
+        return;
+    InFlightFrame* slot = static_cast<InFlightFrame*>(userdata);
+    slot->completed = std::chrono::steady_clock::now();
+    slot->done = true;
+}
+
+void Animation::onFenceCompleted(WGPUFenceCompletionStatus status, void* userdata)
+{
+    // cancelled as the fence is destroyed, the animation is going away
+    if (status == WGPUFenceCompletionStatus_Unknown)
+        return;
+
+    // called from within Device::Tick() or, over the wire, wherever the
+    // returns are handled, post the wakeup so the loop records the next
+    // frame as soon as it's back in control
+    Animation* animation = static_cast<Animation*>(userdata);
+    animation->fenceCallbackPending = false;
+    auto loop = animation->loop.lock();
+    if (!loop)
+        return;
+    if (status == WGPUFenceCompletionStatus_DeviceLost) {
+        // no fence is ever going to pass again
+        Log(Log::Error) << "device lost, stopping";
+        loop->exit();
+        return;
     }
+    // renderFrames() waits on the fence again after an error
+    if (status != WGPUFenceCompletionStatus_Success)
+        Log(Log::Error) << "fence completion failed, status" << static_cast<uint32_t>(status);
+    loop->send([animation]() {
+        animation->renderFrames();
+    });
+}
 
-    wgpu::CommandBuffer commands = encoder.Finish();
-    queue.Submit(1, &commands);
-    swapchain.Present();
+bool Animation::contentReady() const
+{
+    return contentInitialized;
+}
+
+void Animation::setMipmapsEnabled(bool enabled)
+{
+    if (!spriteBatch)
+        return;
+    spriteBatch->setMipmapsEnabled(enabled);
+    damageTracker->damageAll();
+    requestFrame();
 }
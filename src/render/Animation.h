@@ -2,29 +2,244 @@
 #define ANIMATION_H
 
 #include "backend/Backend.h"
-#include <net/Fetch.h>
+#include "backend/Offscreen.h"
+#include "AssetLoader.h"
+#include "DamageTracker.h"
+#include "FrameArena.h"
+#include "FrameCapture.h"
+#include "GpuMemory.h"
+#include "MappedFile.h"
+#include "ResolutionScaler.h"
+#include "MipGenerator.h"
+#include "ObjectCache.h"
+#include "SceneRecorder.h"
+#include "SpriteBatch.h"
+#include "StagingRing.h"
+#include "StatsOverlay.h"
+#include "StreamingTexture.h"
+#include "TextureCache.h"
+#include "Timeline.h"
+#include "UniformArena.h"
+#include "VideoTexture.h"
+#include "wire/WireConnection.h"
 #include <image/Decoder.h>
 #include <dawn/webgpu_cpp.h>
 #include <dawn_native/DawnNative.h>
+#include <event/Loop.h>
+#include <chrono>
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 typedef struct GLFWwindow GLFWwindow;
 
+struct AnimationOptions
+{
+    // render into an offscreen texture ring instead of a window swapchain
+    bool headless { false };
+    // prefer an adapter of type CPU (e.g. a software vulkan ICD)
+    bool preferCpuAdapter { false };
+    // number of frames the cpu may record ahead of the gpu
+    uint32_t framesInFlight { 2 };
+    // when non-zero the image is drawn as a grid of this many sprites
+    uint32_t spriteCount { 0 };
+    // run the keyframe timelines of the quad and the sprites
+    bool animate { true };
+    // only record frames when something changed, otherwise as fast as the
+    // frames in flight allow
+    bool onDemand { true };
+    // generate a full mip chain for uploaded images on the gpu
+    bool mipmaps { false };
+    // run the device in a child process and talk to it over dawn_wire,
+    // headless only
+    bool wire { false };
+    // images to load, the first one is what gets drawn
+    std::vector<std::string> assets;
+    // decode worker threads and concurrent decodes, 0 picks a default
+    uint32_t decodeThreads { 0 };
+    uint32_t maxDecodesInFlight { 0 };
+    // threads recording render bundles including the render thread, 0
+    // picks a default
+    uint32_t recordThreads { 0 };
+    // render the scene at a resolution that keeps the frame time at the
+    // target frame rate and stretch it over the output
+    bool dynamicResolution { false };
+    float targetFrameRate { 60.0f };
+    // bytes the textures of loaded assets may take before the least
+    // recently used ones are evicted
+    uint64_t textureBudget { kDefaultTextureBudget };
+    // when non-zero the quad shows the next loaded image this often, in seconds
+    float pageInterval { 0.0f };
+    // when set every presented frame is read back and written here
+    // (headless only)
+    std::string capturePath;
+    FrameCapture::Format captureFormat { FrameCapture::Format::Raw };
+    // raw yuv file played in a loop over the scene, frames of the given
+    // size packed back to back
+    std::string video;
+    VideoTexture::Format videoFormat { VideoTexture::Format::I420 };
+    uint32_t videoWidth { 0 };
+    uint32_t videoHeight { 0 };
+    float videoFrameRate { 30.0f };
+    // texture pack whose images are played in a loop as a flipbook, all
+    // of them the size of the first
+    std::string sequence;
+    float sequenceFrameRate { 60.0f };
+    // frame times and gpu memory drawn over the output
+    bool statsOverlay { false };
+#ifdef __APPLE__
+    wgpu::BackendType backendType { wgpu::BackendType::Metal };
+#else
+    wgpu::BackendType backendType { wgpu::BackendType::Vulkan };
+#endif
+};
+
 class Animation
 {
 public:
-    void create(GLFWwindow* window, int width, int height);
+    ~Animation();
+
+    // The device is created on a background thread and create() returns
+    // right away so asset loading overlaps it, start() waits for it.
+    bool create(GLFWwindow* window, int width, int height, const AnimationOptions& options = AnimationOptions());
+    // Waits for the device and sets up what depends on it. A window's
+    // surface has to be set up on the thread that created the window, call
+    // this there after init(), headless start() calls it. False when the
+    // device couldn't be created.
+    bool finishCreate();
     void frame();
 
-    void init();
+    // starts loading assets, loop must belong to the calling thread
+    void init(const std::shared_ptr<reckoning::event::Loop>& loop);
 
-    bool fenceCompleted() const;
-    void signalFence();
+    // Starts event driven rendering on the loop passed to init(). A frame is
+    // recorded whenever one of the frames in flight has been retired by the
+    // gpu, the fence completion is posted into the loop. False when the
+    // device couldn't be created.
+    bool start();
+    // to be called after every round of the loop, fence callbacks only
+    // fire from here
     void tick();
 
+    // true once the asset has been loaded and something is drawn
+    bool contentReady() const;
+    // toggles sampling of the generated mip chain (sprite batch only)
+    void setMipmapsEnabled(bool enabled);
+
+    // Frames are only recorded while something is damaged, uploading or
+    // animating. These tell how much of that was saved: frames the loop
+    // would have rendered at its recent frame interval while idle, and the
+    // pixels partial redraws didn't have to touch.
+    bool isIdle() const;
+    // how long the loop may sleep while idle before something is due, a
+    // media frame or a page, at most max
+    std::chrono::milliseconds idleTimeout(std::chrono::milliseconds max) const;
+    uint64_t framesSkipped() const;
+    std::chrono::nanoseconds idleTime() const;
+    const DamageTracker& damage() const { return *damageTracker; }
+    const TextureCache& textureCache() const { return *textures; }
+    // layouts, samplers, shader modules and pipelines, shared by everything
+    // drawing with the device
+    const ObjectCache& objectCache() const { return *objects; }
+    // null unless the resolution is scaled dynamically
+    const ResolutionScaler* resolutionScaler() const { return scaler.get(); }
+    // null unless rendering over the wire
+    const WireConnection* wireConnection() const { return wire.get(); }
+    // null unless capturing
+    const FrameCapture* frameCapture() const { return capture.get(); }
+    // waits for the captured frames still in flight to be written
+    void flushCapture();
+    uint64_t videoFramesUploaded() const { return videoUploads; }
+    // null unless playing a sequence
+    const StreamingTexture* sequencePlayer() const { return sequence.get(); }
+    // buffers and textures alive in the process, by category
+    GpuMemory::Stats gpuMemory() const { return GpuMemory::instance().stats(); }
+
+    uint32_t currentFrameIndex() const;
+    uint64_t frameCount() const;
+    uint64_t gpuStallCount() const;
+    std::chrono::nanoseconds gpuStallTime() const;
+
+private:
+    void initPipelines();
+    wgpu::TextureView currentBackbufferView();
+    void present();
+
+    void uploadAssets();
+    void animate();
+    uint32_t imageMipLevelCount(const AssetLoader::Asset& image) const;
+    wgpu::Texture createImageTexture(const AssetLoader::Asset& image);
+    void initContent(const AssetLoader::Asset& image);
+    void initSprites(const AssetLoader::Asset& image);
+    void resizeSceneTarget();
+    bool pageDue() const;
+    void pageContent();
+    bool initVideo();
+    bool initSequence();
+    // the video's and the sequence's layers, over the scene's
+    void addMediaLayers();
+    uint64_t videoFrameAt(double time) const;
+    uint64_t sequenceFrameAt(double time) const;
+    // true when a frame of the playing media starts to be shown at time
+    bool mediaFrameDue(double time) const;
+    void updateVideo();
+    DamageTracker::Rect scaleRegion(const DamageTracker::Rect& region) const;
+
+    bool frameAvailable() const;
+    bool needsFrame() const;
+    void requestFrame();
+    void signalFence();
+    void renderFrames();
+    // feeds the frames the gpu has finished since the last call to the
+    // resolution scaler
+    void measureFrames();
+    // seconds since start, a double so frame times stay exact however long
+    // the animation runs
+    double currentTime() const;
+
+    static void onFenceCompleted(WGPUFenceCompletionStatus status, void* userdata);
+    // times a frame's fence for the resolution scaler, userdata is its slot
+    static void onFrameCompleted(WGPUFenceCompletionStatus status, void* userdata);
+
+private:
+    static constexpr uint32_t kNoLayer = 0xffffffffu;
+
+    struct InFlightFrame
+    {
+        uint64_t fenceValue { 0 };
+        // measured for the resolution scaler: when the frame was submitted,
+        // how long recording it took and when its fence completed
+        std::chrono::steady_clock::time_point submitted;
+        std::chrono::nanoseconds cpuTime { 0 };
+        std::chrono::steady_clock::time_point completed;
+        bool pending { false };
+        bool rendered { false };
+        bool done { false };
+    };
+
+    // mip chains to generate in the next frame, after the upload is recorded
+    struct PendingMips
+    {
+        wgpu::Texture texture;
+        uint32_t levelCount;
+        uint32_t arrayLayer;
+    };
+
 private:
     std::unique_ptr<dawn_native::Instance> instance;
+    std::unique_ptr<WireConnection> wire;
+    // written by deviceSetup, read after it has been joined
+    WGPUDevice backendDevice { nullptr };
+    DawnProcTable backendProcs {};
+    std::thread deviceSetup;
+    std::thread shaderWarmup;
+    std::chrono::steady_clock::time_point createTime;
+    bool firstFramePresented { false };
+    bool firstContentPresented { false };
+    // set once initContent() has added the scene's layers
+    bool contentInitialized { false };
     wgpu::Device device;
     wgpu::Queue queue;
     wgpu::SwapChain swapchain;
@@ -37,28 +252,172 @@ private:
     wgpu::BindGroup bindGroup;
     wgpu::Fence fence;
     GLFWwindow* mWindow { nullptr };
+    AnimationOptions options;
 
     int width { 0 }, height { 0 };
     uint64_t fenceValue { 0 };
+    std::vector<InFlightFrame> inFlight;
+    uint32_t frameIndex { 0 };
+    uint64_t frameNumber { 0 };
+
+    std::weak_ptr<reckoning::event::Loop> loop;
+    bool fenceCallbackPending { false };
+    bool stalled { false };
+    std::chrono::steady_clock::time_point stallStart;
+    uint64_t stallCount { 0 };
+    std::chrono::nanoseconds stallTime { 0 };
+
+    std::unique_ptr<DamageTracker> damageTracker;
+    wgpu::RenderPipeline clearPipeline;
+    bool assetsReady { false };
+    bool started { false };
+    bool idle { false };
+    std::chrono::steady_clock::time_point idleStart;
+    std::chrono::steady_clock::time_point lastFrameTime;
+    std::chrono::nanoseconds idleDuration { 0 };
+    std::chrono::duration<double> frameInterval { 1.0 / 60.0 };
+    double skippedFrames { 0.0 };
+    glm::vec4 spriteBounds { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    std::unique_ptr<ResolutionScaler> scaler;
+    // when the gpu was last done with a frame
+    std::chrono::steady_clock::time_point gpuDone;
+    // time the current frame spent waiting for a backbuffer
+    std::chrono::nanoseconds backbufferWait { 0 };
+    wgpu::TextureView sceneView;
+    uint32_t sceneWidth { 0 }, sceneHeight { 0 };
+    wgpu::BindGroupLayout upscaleLayout;
+    wgpu::RenderPipeline upscalePipeline;
+    wgpu::BindGroup upscaleBindGroup;
+
     std::shared_ptr<BackendBinding> binding;
-    std::shared_ptr<reckoning::net::Fetch> fetch;
-    std::shared_ptr<reckoning::image::Decoder> decoder;
+    std::shared_ptr<OffscreenBinding> offscreen;
+    std::shared_ptr<ObjectCache> objects;
+    std::unique_ptr<StagingRing> staging;
+    std::unique_ptr<UniformArena> uniforms;
+    // descriptor arrays and other scratch that dies with the frame, reset
+    // at the start of every frame
+    FrameArena frameArena;
+    uint32_t geometryOffset { UniformArena::kInvalidOffset };
+    std::chrono::steady_clock::time_point startTime;
+    Timeline geometryTimeline;
+    Timeline spriteTimeline;
+    std::unique_ptr<SpriteBatch> spriteBatch;
+    uint64_t spriteGeneration { 0 };
+    std::unique_ptr<MipGenerator> mipGenerator;
+    std::vector<PendingMips> pendingMips;
+    std::unique_ptr<AssetLoader> assetLoader;
+    std::unique_ptr<TextureCache> textures;
+    // every asset uploaded so far in load order, what paging cycles through
+    std::vector<uint32_t> assetIds;
+    wgpu::BindGroupLayout contentLayout;
+    uint32_t contentLayer { kNoLayer };
+    uint32_t contentAsset { 0 };
+    uint32_t pageTarget { 0 };
+    std::chrono::steady_clock::time_point nextPage;
+
+    std::unique_ptr<SceneRecorder> recorder;
+    std::unique_ptr<FrameCapture> capture;
+
+    static constexpr uint64_t kNoVideoFrame = ~0ull;
+    std::shared_ptr<MappedFile> videoFile;
+    std::unique_ptr<VideoTexture> video;
+    uint64_t videoFrameCount { 0 };
+    uint64_t videoFrame { kNoVideoFrame };
+    uint64_t videoUploads { 0 };
+    uint32_t videoGeometryOffset { UniformArena::kInvalidOffset };
+    glm::vec4 videoGeometry { -1.0f, 1.0f, 1.0f, -1.0f };
+
+    std::shared_ptr<TexturePack> sequencePack;
+    std::unique_ptr<StreamingTexture> sequence;
+    uint32_t sequenceLayer { kNoLayer };
+    // the frame number the sequence was last advanced to
+    uint64_t sequenceFrame { kNoVideoFrame };
+    uint32_t sequenceGeometryOffset { UniformArena::kInvalidOffset };
+    glm::vec4 sequenceGeometry { -1.0f, 1.0f, 1.0f, -1.0f };
 
-    std::vector<wgpu::RenderBundle> bundles;
+    std::unique_ptr<StatsOverlay> overlay;
 };
 
-inline bool Animation::fenceCompleted() const
+inline bool Animation::frameAvailable() const
 {
-    return fence.GetCompletedValue() >= fenceValue;
+    return fence.GetCompletedValue() >= inFlight[frameIndex].fenceValue;
 }
 
 inline void Animation::signalFence()
 {
     queue.Signal(fence, ++fenceValue);
+    inFlight[frameIndex].fenceValue = fenceValue;
+    if (scaler && inFlight[frameIndex].pending)
+        fence.OnCompletion(fenceValue, onFrameCompleted, &inFlight[frameIndex]);
+    frameIndex = (frameIndex + 1) % inFlight.size();
+    ++frameNumber;
+}
+
+inline uint32_t Animation::currentFrameIndex() const
+{
+    return frameIndex;
+}
+
+inline uint64_t Animation::frameCount() const
+{
+    return frameNumber;
+}
+
+inline uint64_t Animation::gpuStallCount() const
+{
+    return stallCount;
+}
+
+inline std::chrono::nanoseconds Animation::gpuStallTime() const
+{
+    return stallTime;
+}
+
+inline uint64_t Animation::framesSkipped() const
+{
+    double skipped = skippedFrames;
+    if (idle)
+        skipped += std::chrono::duration<double>(std::chrono::steady_clock::now() - idleStart) / frameInterval;
+    return static_cast<uint64_t>(skipped);
+}
+
+inline std::chrono::nanoseconds Animation::idleTime() const
+{
+    if (!idle)
+        return idleDuration;
+    return idleDuration + std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - idleStart);
+}
+
+inline bool Animation::isIdle() const
+{
+    return idle;
+}
+
+inline bool Animation::pageDue() const
+{
+    return options.pageInterval > 0.0f && contentLayer != kNoLayer && assetIds.size() > 1
+        && std::chrono::steady_clock::now() >= nextPage;
 }
 
 inline void Animation::tick()
 {
+    // paging and media frames have no event of their own to wake up an
+    // idle animation, the loop sleeps for idleTimeout()
+    if (idle && (pageDue() || mediaFrameDue(currentTime())))
+        requestFrame();
+    // captured frames keep being read back while idle
+    if (capture)
+        capture->retire(fence.GetCompletedValue());
+    if (sequence)
+        sequence->retire(fence.GetCompletedValue());
+    // the client device has nothing to tick, fence completions arrive as
+    // return commands from the server
+    if (wire) {
+        wire->flush();
+        wire->handleReturns();
+        return;
+    }
     device.Tick();
 }
 
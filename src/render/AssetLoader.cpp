@@ -0,0 +1,312 @@
+#include "AssetLoader.h"
+#include "Constants.h"
+#include "Profiler.h"
+#include <log/Log.h>
+#include <algorithm>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+AssetLoader::AssetLoader(uint32_t workerCount, uint32_t maxDecodesInFlight, uint32_t maxFetchesInFlight)
+    : mWorkers(workerCount),
+      mMaxDecodesInFlight(maxDecodesInFlight ? maxDecodesInFlight : mWorkers.size() * 2),
+      mMaxFetchesInFlight(std::max(maxFetchesInFlight, 1u)),
+      mAlive(std::make_shared<std::atomic<bool>>(true))
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    // workers may still be holding on to assets, make sure they're gone
+    // before mReady is
+    mAlive->store(false);
+    mWorkers.stop();
+}
+
+uint32_t AssetLoader::load(const std::shared_ptr<event::Loop>& loop, const std::vector<std::string>& sources)
+{
+    mLoop = loop;
+    if (!mFetch)
+        mFetch = net::Fetch::create();
+
+    const uint32_t first = mNextId;
+    const Clock::time_point now = Clock::now();
+    bool ready = false;
+    for (const std::string& source : sources) {
+        std::string path = MappedFile::localPath(source);
+        if (!path.empty() && TexturePack::isPack(path)) {
+            // only the index is touched here, the pixels are paged in by the upload
+            std::shared_ptr<TexturePack> pack = TexturePack::open(path);
+            if (pack) {
+                loadPack(std::move(pack), source, now);
+                ready = true;
+            } else {
+                Log(Log::Error) << "invalid texture pack" << path;
+                ++mRequested;
+                ++mFailed;
+            }
+            continue;
+        }
+
+        Asset asset;
+        asset.id = mNextId++;
+        asset.source = source;
+        asset.requested = now;
+        ++mRequested;
+        enqueue(std::move(asset), std::move(path));
+    }
+
+    startFetches();
+    startDecodes();
+    if (ready && mReadyCallback)
+        mReadyCallback();
+    return first;
+}
+
+void AssetLoader::reload(uint32_t id, const std::string& source,
+                         const std::shared_ptr<TexturePack>& pack, uint32_t packIndex)
+{
+    const Clock::time_point now = Clock::now();
+    ++mRequested;
+    if (pack) {
+        ++mDecoded;
+        Asset asset = packAsset(pack, packIndex, now);
+        asset.id = id;
+        asset.source = source;
+        mReady.push(std::move(asset));
+        // not from in here, the caller may be in the middle of a frame
+        if (auto loop = mLoop.lock()) {
+            auto alive = mAlive;
+            loop->send([this, alive]() {
+                if (alive->load() && mReadyCallback)
+                    mReadyCallback();
+            });
+        }
+        return;
+    }
+
+    Asset asset;
+    asset.id = id;
+    asset.source = source;
+    asset.requested = now;
+    enqueue(std::move(asset), MappedFile::localPath(source));
+    startFetches();
+    startDecodes();
+}
+
+void AssetLoader::enqueue(Asset&& asset, std::string&& path)
+{
+    if (!path.empty()) {
+        // mapped on the worker, nothing to fetch
+        asset.fetched = asset.requested;
+        mDecodeQueue.push_back({ std::move(asset), nullptr, std::move(path) });
+    } else {
+        mFetchQueue.push_back(std::move(asset));
+    }
+}
+
+AssetLoader::Asset AssetLoader::packAsset(const std::shared_ptr<TexturePack>& pack, uint32_t index, Clock::time_point now) const
+{
+    const TexturePackEntry& entry = pack->entry(index);
+
+    Asset asset;
+    asset.pixels = pack->level(index, 0);
+    asset.width = entry.width;
+    asset.height = entry.height;
+    asset.bytesPerRow = entry.levelBytesPerRow[0];
+    asset.pack = pack;
+    asset.packIndex = index;
+    asset.requested = asset.fetched = asset.decodeStarted = asset.decoded = now;
+    return asset;
+}
+
+void AssetLoader::loadPack(std::shared_ptr<TexturePack>&& pack, const std::string& source, Clock::time_point now)
+{
+    mRequested += pack->count();
+    mDecoded += pack->count();
+    for (uint32_t i = 0; i < pack->count(); ++i) {
+        Asset asset = packAsset(pack, i, now);
+        asset.id = mNextId++;
+        asset.source = source + "#" + pack->entry(i).name;
+        mReady.push(std::move(asset));
+    }
+}
+
+void AssetLoader::startFetches()
+{
+    while (mFetchesInFlight < mMaxFetchesInFlight && !mFetchQueue.empty()) {
+        Asset asset = std::move(mFetchQueue.front());
+        mFetchQueue.pop_front();
+        ++mFetchesInFlight;
+
+        const std::string source = asset.source;
+        auto alive = mAlive;
+        mFetch->fetch(source).then([this, alive, asset](std::shared_ptr<buffer::Buffer>&& buffer) mutable -> void {
+            if (!alive->load())
+                return;
+            --mFetchesInFlight;
+            asset.fetched = Clock::now();
+            mFetchTime += (asset.fetched - asset.requested).count();
+            if (!buffer) {
+                Log(Log::Error) << "failed to fetch" << asset.source;
+                ++mFailed;
+                if (mFailedCallback)
+                    mFailedCallback(asset.id);
+            } else {
+                mDecodeQueue.push_back({ std::move(asset), std::move(buffer), std::string() });
+                startDecodes();
+            }
+            startFetches();
+        });
+    }
+}
+
+void AssetLoader::startDecodes()
+{
+    while (mDecodesInFlight < mMaxDecodesInFlight && !mDecodeQueue.empty()) {
+        Fetched fetched = std::move(mDecodeQueue.front());
+        mDecodeQueue.pop_front();
+        ++mDecodesInFlight;
+
+        mWorkers.post([this, fetched]() mutable {
+            decode(std::move(fetched));
+        });
+    }
+}
+
+void AssetLoader::decode(Fetched&& fetched)
+{
+    // worker thread
+    thread_local std::shared_ptr<image::Decoder> decoder = image::Decoder::create();
+
+    Asset asset = std::move(fetched.asset);
+    asset.decodeStarted = Clock::now();
+    mQueueTime += (asset.decodeStarted - asset.fetched).count();
+
+    std::shared_ptr<buffer::Buffer> buffer = std::move(fetched.buffer);
+    if (!fetched.path.empty()) {
+        asset.mapped = MappedFile::open(fetched.path);
+        if (!asset.mapped) {
+            Log(Log::Error) << "unable to map" << fetched.path;
+            asset.decoded = Clock::now();
+            decoded(std::move(asset), false);
+            return;
+        }
+
+        if (const RawImageHeader* header = rawImageHeader(*asset.mapped)) {
+            asset.pixels = asset.mapped->data() + sizeof(RawImageHeader);
+            asset.width = header->width;
+            asset.height = header->height;
+            asset.bytesPerRow = header->bytesPerRow;
+            asset.decoded = Clock::now();
+            decoded(std::move(asset), true);
+            return;
+        }
+
+        // the decoder only takes a buffer of its own, the file is read
+        // straight into it rather than faulted in through the mapping and
+        // copied, only the header's page of the mapping was touched
+        const size_t size = asset.mapped->size();
+        asset.mapped.reset();
+        buffer = buffer::Buffer::create(size);
+        if (!readFile(fetched.path, static_cast<uint8_t*>(buffer->data()), size)) {
+            Log(Log::Error) << "unable to read" << fetched.path;
+            asset.decoded = Clock::now();
+            decoded(std::move(asset), false);
+            return;
+        }
+    }
+
+    auto alive = mAlive;
+    decoder->decode(std::move(buffer), kTextureRowPitchAlignment).then([this, alive, asset](image::Decoder::Image&& image) mutable -> void {
+        if (!alive->load())
+            return;
+        asset.decoded = Clock::now();
+        asset.image = std::move(image);
+        const bool ok = static_cast<bool>(asset.image.data);
+        if (ok) {
+            asset.pixels = static_cast<const uint8_t*>(asset.image.data->data());
+            asset.width = asset.image.width;
+            asset.height = asset.image.height;
+            asset.bytesPerRow = asset.image.bpl;
+        }
+        decoded(std::move(asset), ok);
+    });
+}
+
+void AssetLoader::decoded(Asset&& asset, bool ok)
+{
+    // worker thread
+    const uint32_t id = asset.id;
+    mDecodeTime += (asset.decoded - asset.decodeStarted).count();
+    Profiler::instance().record("decode", asset.decodeStarted, asset.decoded);
+    if (ok) {
+        ++mDecoded;
+        mReady.push(std::move(asset));
+    } else {
+        Log(Log::Error) << "failed to decode" << asset.source;
+        ++mFailed;
+    }
+
+    auto loop = mLoop.lock();
+    if (!loop)
+        return;
+    auto alive = mAlive;
+    loop->send([this, alive, ok, id]() {
+        if (!alive->load())
+            return;
+        --mDecodesInFlight;
+        startDecodes();
+        if (ok && mReadyCallback)
+            mReadyCallback();
+        else if (!ok && mFailedCallback)
+            mFailedCallback(id);
+    });
+}
+
+bool AssetLoader::next(Asset& asset)
+{
+    return mReady.pop(asset);
+}
+
+void AssetLoader::uploaded(const Asset& asset, std::chrono::nanoseconds uploadTime)
+{
+    (void)asset;
+    ++mUploaded;
+    mUploadTime += uploadTime.count();
+    if (idle())
+        logStats();
+}
+
+bool AssetLoader::idle() const
+{
+    const uint64_t requested = mRequested.load();
+    return requested > 0 && mUploaded.load() + mFailed.load() == requested;
+}
+
+AssetLoader::Stats AssetLoader::stats() const
+{
+    Stats stats;
+    stats.requested = mRequested.load();
+    stats.decoded = mDecoded.load();
+    stats.failed = mFailed.load();
+    stats.uploaded = mUploaded.load();
+    stats.fetchTime = std::chrono::nanoseconds(mFetchTime.load());
+    stats.queueTime = std::chrono::nanoseconds(mQueueTime.load());
+    stats.decodeTime = std::chrono::nanoseconds(mDecodeTime.load());
+    stats.uploadTime = std::chrono::nanoseconds(mUploadTime.load());
+    return stats;
+}
+
+void AssetLoader::logStats() const
+{
+    const Stats s = stats();
+    auto average = [](std::chrono::nanoseconds total, uint64_t count) {
+        return count ? std::chrono::duration<double, std::milli>(total).count() / count : 0.0;
+    };
+    Log(Log::Info) << "assets:" << s.uploaded << "of" << s.requested << "loaded," << s.failed << "failed;"
+                   << "avg fetch" << average(s.fetchTime, s.requested) << "ms,"
+                   << "decode queue" << average(s.queueTime, s.decoded + s.failed) << "ms,"
+                   << "decode" << average(s.decodeTime, s.decoded + s.failed) << "ms,"
+                   << "upload" << average(s.uploadTime, s.uploaded) << "ms";
+}
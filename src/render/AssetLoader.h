@@ -0,0 +1,142 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include "MappedFile.h"
+#include "MpscQueue.h"
+#include "TexturePack.h"
+#include "WorkerPool.h"
+#include <net/Fetch.h>
+#include <image/Decoder.h>
+#include <buffer/Buffer.h>
+#include <event/Loop.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Loads batches of images. Remote sources are fetched on the owning thread,
+// local ones (file:// or absolute paths) are memory mapped on a worker. Images
+// are decoded on a bounded worker pool with a cap on concurrent decodes, and
+// handed back through a lock free queue that the render thread drains once
+// per frame. Raw images (see RawImageHeader) skip decoding and are uploaded
+// straight out of the mapping, texture packs (see TexturePack) are opened
+// right away and every image in them is ready on the next frame.
+class AssetLoader
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Asset
+    {
+        uint32_t id { 0 };
+        std::string source;
+
+        // pixels either point into image (decoded) or mapped (raw)
+        const uint8_t* pixels { nullptr };
+        uint32_t width { 0 };
+        uint32_t height { 0 };
+        uint32_t bytesPerRow { 0 };
+
+        reckoning::image::Decoder::Image image;
+        std::shared_ptr<MappedFile> mapped;
+        // set for images out of a texture pack, which carry their own mip chain
+        std::shared_ptr<TexturePack> pack;
+        uint32_t packIndex { 0 };
+
+        Clock::time_point requested;
+        Clock::time_point fetched;
+        Clock::time_point decodeStarted;
+        Clock::time_point decoded;
+    };
+
+    struct Stats
+    {
+        uint64_t requested { 0 };
+        uint64_t decoded { 0 };
+        uint64_t failed { 0 };
+        uint64_t uploaded { 0 };
+        std::chrono::nanoseconds fetchTime { 0 };
+        std::chrono::nanoseconds queueTime { 0 };
+        std::chrono::nanoseconds decodeTime { 0 };
+        std::chrono::nanoseconds uploadTime { 0 };
+    };
+
+    AssetLoader(uint32_t workerCount = 0, uint32_t maxDecodesInFlight = 0, uint32_t maxFetchesInFlight = 8);
+    ~AssetLoader();
+
+    // fetches run on loop, which must belong to the calling thread. Returns
+    // the id of the first asset, the rest follow consecutively with every
+    // image of a texture pack getting an id of its own.
+    uint32_t load(const std::shared_ptr<reckoning::event::Loop>& loop, const std::vector<std::string>& sources);
+
+    // loads an asset again under its old id, e.g. after its texture was
+    // evicted. Images out of a texture pack are ready right away.
+    void reload(uint32_t id, const std::string& source,
+                const std::shared_ptr<TexturePack>& pack = nullptr, uint32_t packIndex = 0);
+
+    // called on the owning thread whenever assets have become ready
+    void setReadyCallback(std::function<void()>&& callback) { mReadyCallback = std::move(callback); }
+    // called on the owning thread with the id of an asset that couldn't be
+    // fetched or decoded
+    void setFailedCallback(std::function<void(uint32_t id)>&& callback) { mFailedCallback = std::move(callback); }
+
+    // render thread, returns false when nothing is ready
+    bool next(Asset& asset);
+    // render thread, records how long uploading a drained asset took
+    void uploaded(const Asset& asset, std::chrono::nanoseconds uploadTime);
+
+    bool idle() const;
+    Stats stats() const;
+    void logStats() const;
+
+private:
+    struct Fetched
+    {
+        Asset asset;
+        // one of these is set
+        std::shared_ptr<reckoning::buffer::Buffer> buffer;
+        std::string path;
+    };
+
+    void loadPack(std::shared_ptr<TexturePack>&& pack, const std::string& source, Clock::time_point now);
+    Asset packAsset(const std::shared_ptr<TexturePack>& pack, uint32_t index, Clock::time_point now) const;
+    void enqueue(Asset&& asset, std::string&& path);
+    void startFetches();
+    void startDecodes();
+    void decode(Fetched&& fetched);
+    void decoded(Asset&& asset, bool ok);
+
+private:
+    std::weak_ptr<reckoning::event::Loop> mLoop;
+    std::function<void()> mReadyCallback;
+    std::function<void(uint32_t)> mFailedCallback;
+    std::shared_ptr<reckoning::net::Fetch> mFetch;
+    WorkerPool mWorkers;
+    uint32_t mMaxDecodesInFlight;
+    uint32_t mMaxFetchesInFlight;
+
+    // owning thread only
+    uint32_t mNextId { 0 };
+    uint32_t mFetchesInFlight { 0 };
+    uint32_t mDecodesInFlight { 0 };
+    std::deque<Asset> mFetchQueue;
+    std::deque<Fetched> mDecodeQueue;
+
+    MpscQueue<Asset> mReady;
+
+    std::shared_ptr<std::atomic<bool>> mAlive;
+    std::atomic<uint64_t> mRequested { 0 };
+    std::atomic<uint64_t> mDecoded { 0 };
+    std::atomic<uint64_t> mFailed { 0 };
+    std::atomic<uint64_t> mUploaded { 0 };
+    std::atomic<int64_t> mFetchTime { 0 };
+    std::atomic<int64_t> mQueueTime { 0 };
+    std::atomic<int64_t> mDecodeTime { 0 };
+    std::atomic<int64_t> mUploadTime { 0 };
+};
+
+#endif // ASSETLOADER_H
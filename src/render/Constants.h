@@ -9,5 +9,27 @@ static constexpr uint32_t kMaxVertexBuffers = 16u;
 static constexpr uint32_t kMaxVertexAttributes = 16u;
 static constexpr uint32_t kMaxColorAttachments = 4u;
 static constexpr uint32_t kTextureRowPitchAlignment = 256u;
+static constexpr uint32_t kMaxTextureDimension = 8192u;
+static constexpr uint32_t kOffscreenTextureCount = 3u;
+static constexpr uint64_t kStagingBlockSize = 4u * 1024u * 1024u;
+// blocks for frames that only carry uniforms and other small updates
+static constexpr uint64_t kStagingSmallBlockSize = 64u * 1024u;
+static constexpr uint32_t kMaxAssetUploadsPerFrame = 16u;
+static constexpr uint32_t kSpritesPerSceneLayer = 1024u;
+static constexpr uint32_t kMinLayersPerRecordJob = 4u;
+static constexpr float kMinResolutionScale = 0.5f;
+static constexpr uint32_t kResolutionScaleWindow = 30u;
+static constexpr uint32_t kResolutionScaleAlignment = 8u;
+static constexpr uint64_t kDefaultTextureBudget = 256u * 1024u * 1024u;
+static constexpr uint32_t kUniformSlotSize = 256u;
+static constexpr uint32_t kUniformArenaSlotCount = 256u;
+static constexpr uint32_t kFrameCaptureBufferCount = 4u;
+static constexpr uint32_t kStreamingTextureSlotCount = 3u;
+static constexpr uint32_t kFrameArenaBlockSize = 64u * 1024u;
+static constexpr uint32_t kStatsOverlayHistory = 120u;
+static constexpr float kStatsOverlayRefreshInterval = 0.25f;
+static constexpr uint64_t kWireRingSize = 64u * 1024u * 1024u;
+static constexpr uint32_t kProfilerWindowSize = 1024u;
+static constexpr uint32_t kMaxTraceEvents = 1u << 20;
 
 #endif // CONSTANTS_H
@@ -0,0 +1,86 @@
+#include "DamageTracker.h"
+#include <algorithm>
+#include <cmath>
+
+DamageTracker::Rect DamageTracker::Rect::united(const Rect& other) const
+{
+    if (empty())
+        return other;
+    if (other.empty())
+        return *this;
+    Rect rect;
+    rect.x = std::min(x, other.x);
+    rect.y = std::min(y, other.y);
+    rect.width = std::max(x + width, other.x + other.width) - rect.x;
+    rect.height = std::max(y + height, other.y + other.height) - rect.y;
+    return rect;
+}
+
+DamageTracker::DamageTracker(uint32_t width, uint32_t height, uint32_t bufferCount)
+    : mWidth(width), mHeight(height), mPending(std::max(bufferCount, 1u))
+{
+}
+
+void DamageTracker::damage(const Rect& rect)
+{
+    if (rect.empty())
+        return;
+    for (Rect& pending : mPending)
+        pending = pending.united(rect);
+    mDirty = true;
+}
+
+void DamageTracker::damage(const glm::vec4& geometry)
+{
+    // to pixels, rounded outwards and clipped to the target
+    auto toX = [this](float ndc) { return (ndc + 1.0f) * 0.5f * mWidth; };
+    auto toY = [this](float ndc) { return (1.0f - ndc) * 0.5f * mHeight; };
+    const float left = std::max(std::floor(std::min(toX(geometry.x), toX(geometry.z))), 0.0f);
+    const float right = std::min(std::ceil(std::max(toX(geometry.x), toX(geometry.z))), static_cast<float>(mWidth));
+    const float top = std::max(std::floor(std::min(toY(geometry.y), toY(geometry.w))), 0.0f);
+    const float bottom = std::min(std::ceil(std::max(toY(geometry.y), toY(geometry.w))), static_cast<float>(mHeight));
+    if (right <= left || bottom <= top)
+        return;
+
+    Rect rect;
+    rect.x = static_cast<uint32_t>(left);
+    rect.y = static_cast<uint32_t>(top);
+    rect.width = static_cast<uint32_t>(right) - rect.x;
+    rect.height = static_cast<uint32_t>(bottom) - rect.y;
+    damage(rect);
+}
+
+void DamageTracker::damageAll()
+{
+    Rect rect;
+    rect.width = mWidth;
+    rect.height = mHeight;
+    damage(rect);
+}
+
+DamageTracker::Rect DamageTracker::redraw(uint32_t buffer)
+{
+    if (!mDirty)
+        return Rect();
+    mDirty = false;
+
+    Rect rect;
+    if (mPending.size() == 1) {
+        // contents don't survive, always redraw everything
+        rect.width = mWidth;
+        rect.height = mHeight;
+        mPending[0] = Rect();
+    } else {
+        Rect& pending = mPending[buffer % mPending.size()];
+        rect = pending;
+        pending = Rect();
+    }
+
+    if (rect.area() == static_cast<uint64_t>(mWidth) * mHeight) {
+        ++mFullFrames;
+    } else if (!rect.empty()) {
+        ++mPartialFrames;
+        mPartialPixels += rect.area();
+    }
+    return rect;
+}
@@ -0,0 +1,58 @@
+#ifndef DAMAGETRACKER_H
+#define DAMAGETRACKER_H
+
+#include <glm/vec4.hpp>
+#include <cstdint>
+#include <vector>
+
+// Keeps track of which part of the render target is out of date. Damage is
+// a bounding rect in pixels per backbuffer, since a backbuffer that wasn't
+// rendered to in a while is missing everything damaged since. When buffer
+// contents aren't known to survive (a window swapchain) every redraw is a
+// full one, but frames are still only produced when something is damaged.
+class DamageTracker
+{
+public:
+    struct Rect
+    {
+        uint32_t x { 0 }, y { 0 }, width { 0 }, height { 0 };
+
+        bool empty() const { return !width || !height; }
+        uint64_t area() const { return static_cast<uint64_t>(width) * height; }
+        Rect united(const Rect& other) const;
+    };
+
+    // bufferCount 0 means backbuffer contents are undefined between frames
+    DamageTracker(uint32_t width, uint32_t height, uint32_t bufferCount);
+
+    void damage(const Rect& rect);
+    // left, top, right, bottom in normalized device coordinates
+    void damage(const glm::vec4& geometry);
+    void damageAll();
+
+    bool dirty() const { return mDirty; }
+
+    // returns what has to be redrawn in the given backbuffer and marks
+    // everything clean, an empty rect if nothing is dirty
+    Rect redraw(uint32_t buffer);
+
+    uint32_t width() const { return mWidth; }
+    uint32_t height() const { return mHeight; }
+
+    uint64_t fullFrames() const { return mFullFrames; }
+    uint64_t partialFrames() const { return mPartialFrames; }
+    // pixels covered by partial redraws and what full redraws would've cost
+    uint64_t partialPixels() const { return mPartialPixels; }
+    uint64_t partialFullPixels() const { return mPartialFrames * static_cast<uint64_t>(mWidth) * mHeight; }
+
+private:
+    uint32_t mWidth, mHeight;
+    bool mDirty { false };
+    std::vector<Rect> mPending;
+
+    uint64_t mFullFrames { 0 };
+    uint64_t mPartialFrames { 0 };
+    uint64_t mPartialPixels { 0 };
+};
+
+#endif // DAMAGETRACKER_H
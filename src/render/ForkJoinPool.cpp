@@ -0,0 +1,91 @@
+#include "ForkJoinPool.h"
+
+ForkJoinPool::ForkJoinPool(uint32_t threadCount)
+{
+    mThreads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        mThreads.emplace_back([this]() { work(); });
+    }
+}
+
+ForkJoinPool::~ForkJoinPool()
+{
+    {
+        std::lock_guard<std::mutex> locker(mMutex);
+        mStopped = true;
+    }
+    mStart.notify_all();
+    for (std::thread& thread : mThreads) {
+        thread.join();
+    }
+}
+
+size_t ForkJoinPool::runJobs(size_t count, Job job, void* context)
+{
+    size_t ran = 0;
+    for (;;) {
+        const size_t index = mNext.fetch_add(1, std::memory_order_relaxed);
+        if (index >= count)
+            return ran;
+        job(context, index);
+        ++ran;
+    }
+}
+
+void ForkJoinPool::run(size_t count, Job job, void* context)
+{
+    if (!count)
+        return;
+    if (mThreads.empty() || count == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            job(context, i);
+        }
+        return;
+    }
+
+    {
+        // a thread that woke up too late for the last batch may still be
+        // claiming off the counter with that batch's job, let it leave
+        // before the counter starts over
+        std::unique_lock<std::mutex> locker(mMutex);
+        mDone.wait(locker, [this]() { return mActive == 0; });
+        mJob = job;
+        mContext = context;
+        mCount = count;
+        mNext.store(0, std::memory_order_relaxed);
+        mFinished = 0;
+        ++mGeneration;
+    }
+    mStart.notify_all();
+
+    const size_t ran = runJobs(count, job, context);
+
+    std::unique_lock<std::mutex> locker(mMutex);
+    mFinished += ran;
+    mDone.wait(locker, [this]() { return mFinished == mCount; });
+}
+
+void ForkJoinPool::work()
+{
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> locker(mMutex);
+    for (;;) {
+        mStart.wait(locker, [this, generation]() { return mStopped || mGeneration != generation; });
+        if (mStopped)
+            return;
+        generation = mGeneration;
+        const Job job = mJob;
+        void* const context = mContext;
+        const size_t count = mCount;
+        ++mActive;
+        locker.unlock();
+
+        const size_t ran = runJobs(count, job, context);
+
+        locker.lock();
+        --mActive;
+        mFinished += ran;
+        // with the lock held, the caller may be waiting on either
+        mDone.notify_all();
+    }
+}
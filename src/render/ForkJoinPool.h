@@ -0,0 +1,59 @@
+#ifndef FORKJOINPOOL_H
+#define FORKJOINPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that work through one batch of jobs at a time
+// together with the calling thread, for work that is split up and waited
+// for every frame. Unlike WorkerPool's posts a batch never touches the
+// heap: the job is a function pointer and a context, the threads sleep on
+// a condition variable in between batches and claim jobs off a counter.
+class ForkJoinPool
+{
+public:
+    typedef void (*Job)(void* context, size_t index);
+
+    explicit ForkJoinPool(uint32_t threadCount);
+    ~ForkJoinPool();
+
+    ForkJoinPool(const ForkJoinPool&) = delete;
+    ForkJoinPool& operator=(const ForkJoinPool&) = delete;
+
+    // calls job(context, index) for every index below count, spread over
+    // the threads and the caller, and returns once all of them have
+    // returned. Not reentrant, one thread runs batches.
+    void run(size_t count, Job job, void* context);
+
+    uint32_t size() const { return static_cast<uint32_t>(mThreads.size()); }
+
+private:
+    void work();
+    // claims and runs jobs of the current batch until there are none left,
+    // returns how many it ran
+    size_t runJobs(size_t count, Job job, void* context);
+
+private:
+    std::vector<std::thread> mThreads;
+
+    std::mutex mMutex;
+    std::condition_variable mStart;
+    std::condition_variable mDone;
+    bool mStopped { false };
+    // the current batch, written under the lock while no thread is active
+    uint64_t mGeneration { 0 };
+    Job mJob { nullptr };
+    void* mContext { nullptr };
+    size_t mCount { 0 };
+    std::atomic<size_t> mNext { 0 };
+    size_t mFinished { 0 };
+    // threads between picking up a batch and reporting what they ran
+    uint32_t mActive { 0 };
+};
+
+#endif // FORKJOINPOOL_H
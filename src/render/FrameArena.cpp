@@ -0,0 +1,55 @@
+#include "FrameArena.h"
+#include <algorithm>
+#include <cassert>
+
+static inline size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+FrameArena::FrameArena(size_t blockSize)
+    : mBlock(new uint8_t[blockSize]), mSize(blockSize)
+{
+    ++mHeapAllocations;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+    assert(alignment && !(alignment & (alignment - 1)));
+    // blocks come from new[], which aligns for any fundamental type, the
+    // offsets are aligned from there
+    assert(alignment <= alignof(std::max_align_t));
+
+    const size_t offset = alignUp(mUsed, alignment);
+    if (offset + size <= mSize) {
+        mUsed = offset + size;
+        return mBlock.get() + offset;
+    }
+
+    size_t overflowOffset = alignUp(mOverflowOffset, alignment);
+    if (mOverflow.empty() || overflowOffset + size > mOverflowSize) {
+        mOverflowSize = std::max(mSize, size);
+        mOverflow.emplace_back(new uint8_t[mOverflowSize]);
+        ++mHeapAllocations;
+        mOverflowOffset = overflowOffset = 0;
+    }
+    mOverflowUsed += overflowOffset - mOverflowOffset + size;
+    mOverflowOffset = overflowOffset + size;
+    return mOverflow.back().get() + overflowOffset;
+}
+
+void FrameArena::reset()
+{
+    if (!mOverflow.empty()) {
+        // room for everything this frame needed in one block
+        const size_t size = alignUp(mUsed + mOverflowUsed, alignof(std::max_align_t)) * 2;
+        mOverflow.clear();
+        mBlock.reset(new uint8_t[size]);
+        ++mHeapAllocations;
+        mSize = size;
+        mOverflowSize = 0;
+        mOverflowOffset = 0;
+        mOverflowUsed = 0;
+    }
+    mUsed = 0;
+}
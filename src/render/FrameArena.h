@@ -0,0 +1,63 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include "Constants.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for data that only lives until the end of a frame, such
+// as the binding arrays of descriptors. Allocations bump a pointer through
+// one block and are all dropped at once by reset(). When a frame needs more
+// than the block holds, overflow blocks are taken from the heap and the
+// next reset() replaces everything with a single block large enough for
+// that frame, so a steady frame loop stops allocating after the first few
+// frames. Destructors are never run, only trivially destructible types can
+// be allocated.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t blockSize = kFrameArenaBlockSize);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // count value initialized objects
+    template<typename T>
+    T* allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        T* objects = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; ++i)
+            new (objects + i) T();
+        return objects;
+    }
+
+    // invalidates everything allocated so far
+    void reset();
+
+    size_t bytesUsed() const { return mUsed + mOverflowUsed; }
+    size_t capacity() const { return mSize; }
+    // blocks taken from the heap so far, stays put once the arena has grown
+    // to fit the largest frame
+    uint64_t heapAllocations() const { return mHeapAllocations; }
+
+private:
+    std::unique_ptr<uint8_t[]> mBlock;
+    size_t mSize { 0 };
+    size_t mUsed { 0 };
+
+    std::vector<std::unique_ptr<uint8_t[]>> mOverflow;
+    // of the last overflow block
+    size_t mOverflowSize { 0 };
+    size_t mOverflowOffset { 0 };
+    size_t mOverflowUsed { 0 };
+    uint64_t mHeapAllocations { 0 };
+};
+
+#endif // FRAMEARENA_H
@@ -0,0 +1,315 @@
+#include "FrameCapture.h"
+#include "Utils.h"
+#include <log/Log.h>
+#include <array>
+#include <cassert>
+#include <cinttypes>
+#include <cstring>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static inline uint32_t alignUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0)
+{
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBigEndian(uint8_t* out, uint32_t value)
+{
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+static bool writeChunk(FILE* f, const char type[4], const uint8_t* data, uint32_t size, uint32_t crc)
+{
+    uint8_t header[8];
+    putBigEndian(header, size);
+    memcpy(header + 4, type, 4);
+    uint8_t trailer[4];
+    putBigEndian(trailer, crc);
+    return fwrite(header, 1, sizeof(header), f) == sizeof(header)
+        && (!size || fwrite(data, 1, size, f) == size)
+        && fwrite(trailer, 1, sizeof(trailer), f) == sizeof(trailer);
+}
+
+// Frames are written as stored (uncompressed) deflate blocks, compressing
+// would cost far more than the frame took to render. Every row goes into a
+// block of its own, so rows wider than a stored block can hold aren't
+// supported.
+static bool writePng(const std::string& path, const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t rowPitch,
+                     bool swizzle, std::vector<uint8_t>& row)
+{
+    const uint32_t rowSize = width * 4 + 1;
+    if (rowSize > 0xffff)
+        return false;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    bool ok = fwrite(signature, 1, sizeof(signature), f) == sizeof(signature);
+
+    uint8_t ihdr[4 + 13];
+    memcpy(ihdr, "IHDR", 4);
+    putBigEndian(ihdr + 4, width);
+    putBigEndian(ihdr + 8, height);
+    ihdr[12] = 8; // bit depth
+    ihdr[13] = 6; // rgba
+    ihdr[14] = 0;
+    ihdr[15] = 0;
+    ihdr[16] = 0;
+    ok = ok && writeChunk(f, "IHDR", ihdr + 4, 13, crc32(ihdr, sizeof(ihdr)));
+
+    // zlib header, one stored block per row and the adler32 of the rows
+    const uint32_t blockSize = 5 + rowSize;
+    const uint32_t idatSize = 2 + blockSize * height + 4;
+    uint8_t header[8];
+    putBigEndian(header, idatSize);
+    memcpy(header + 4, "IDAT", 4);
+    ok = ok && fwrite(header, 1, sizeof(header), f) == sizeof(header);
+    uint32_t crc = crc32(header + 4, 4);
+
+    static const uint8_t zlibHeader[2] = { 0x78, 0x01 };
+    ok = ok && fwrite(zlibHeader, 1, sizeof(zlibHeader), f) == sizeof(zlibHeader);
+    crc = crc32(zlibHeader, sizeof(zlibHeader), crc);
+
+    uint32_t a = 1, b = 0;
+    row.resize(blockSize);
+    for (uint32_t y = 0; ok && y < height; ++y) {
+        uint8_t* block = row.data();
+        block[0] = y + 1 == height ? 1 : 0;
+        block[1] = static_cast<uint8_t>(rowSize);
+        block[2] = static_cast<uint8_t>(rowSize >> 8);
+        block[3] = static_cast<uint8_t>(~rowSize);
+        block[4] = static_cast<uint8_t>(~rowSize >> 8);
+        uint8_t* pixels = block + 5;
+        pixels[0] = 0; // filter
+        const uint8_t* source = rgba + static_cast<uint64_t>(y) * rowPitch;
+        if (swizzle) {
+            for (uint32_t x = 0; x < width; ++x) {
+                pixels[1 + x * 4 + 0] = source[x * 4 + 2];
+                pixels[1 + x * 4 + 1] = source[x * 4 + 1];
+                pixels[1 + x * 4 + 2] = source[x * 4 + 0];
+                pixels[1 + x * 4 + 3] = source[x * 4 + 3];
+            }
+        } else {
+            memcpy(pixels + 1, source, width * 4);
+        }
+        for (uint32_t i = 0; i < rowSize; ++i) {
+            a = (a + pixels[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        ok = fwrite(block, 1, blockSize, f) == blockSize;
+        crc = crc32(block, blockSize, crc);
+    }
+
+    uint8_t adler[4];
+    putBigEndian(adler, (b << 16) | a);
+    ok = ok && fwrite(adler, 1, sizeof(adler), f) == sizeof(adler);
+    crc = crc32(adler, sizeof(adler), crc);
+    uint8_t trailer[4];
+    putBigEndian(trailer, crc);
+    ok = ok && fwrite(trailer, 1, sizeof(trailer), f) == sizeof(trailer);
+
+    ok = ok && writeChunk(f, "IEND", nullptr, 0, crc32(reinterpret_cast<const uint8_t*>("IEND"), 4));
+    return fclose(f) == 0 && ok;
+}
+
+FrameCapture::FrameCapture(const wgpu::Device& device, wgpu::TextureFormat format, uint32_t width, uint32_t height,
+                           const std::string& path, Format outputFormat, uint32_t bufferCount)
+    : mOutputFormat(outputFormat), mWidth(width), mHeight(height),
+      mRowPitch(alignUp(width * 4, kTextureRowPitchAlignment))
+{
+    assert(bufferCount > 0);
+
+    if (format == wgpu::TextureFormat::BGRA8Unorm) {
+        mSwizzle = true;
+    } else if (format != wgpu::TextureFormat::RGBA8Unorm) {
+        Log(Log::Error) << "frame capture: unsupported target format" << static_cast<uint32_t>(format);
+        return;
+    }
+    if (outputFormat == Format::Raw) {
+        mRawFile = fopen(path.c_str(), "wb");
+        if (!mRawFile) {
+            Log(Log::Error) << "frame capture: unable to open" << path;
+            return;
+        }
+    }
+
+    wgpu::BufferDescriptor descriptor;
+    descriptor.size = static_cast<uint64_t>(mRowPitch) * height;
+    descriptor.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+    for (uint32_t i = 0; i < bufferCount; ++i) {
+        auto slot = std::make_unique<Slot>();
+        slot->capture = this;
+        slot->buffer = device.CreateBuffer(&descriptor);
+        mSlots.push_back(std::move(slot));
+    }
+
+    mWriter = std::make_unique<WorkerPool>(1);
+    mPath = path;
+}
+
+FrameCapture::~FrameCapture()
+{
+    // the writer may still be reading mapped memory
+    if (mWriter)
+        mWriter->stop();
+    if (mRawFile)
+        fclose(mRawFile);
+    // releasing the buffers cancels their map requests, while this is
+    // still whole
+    mDestroying = true;
+    mSlots.clear();
+}
+
+bool FrameCapture::parseFormat(const std::string& name, Format* format)
+{
+    if (name == "raw") {
+        *format = Format::Raw;
+        return true;
+    }
+    if (name == "png") {
+        *format = Format::Png;
+        return true;
+    }
+    return false;
+}
+
+bool FrameCapture::record(const wgpu::CommandEncoder& encoder, const wgpu::Texture& texture, uint64_t retireValue)
+{
+    // the buffers are handed out in order, if the oldest one isn't back yet
+    // none of the others are either
+    Slot* slot = mSlots[mNext].get();
+    if (slot->state != Slot::Free) {
+        ++mDropped;
+        return false;
+    }
+    mNext = (mNext + 1) % mSlots.size();
+
+    wgpu::TextureCopyView source = CreateTextureCopyView(texture, 0, 0, {0, 0, 0});
+    wgpu::BufferCopyView destination = CreateBufferCopyView(slot->buffer, 0, mRowPitch, 0);
+    wgpu::Extent3D extent = { mWidth, mHeight, 1 };
+    encoder.CopyTextureToBuffer(&source, &destination, &extent);
+
+    // frames that only carried uploads or were dropped leave no gaps
+    slot->frame = mCaptured++;
+    slot->retireValue = retireValue;
+    slot->state = Slot::InFlight;
+    return true;
+}
+
+void FrameCapture::retire(uint64_t completedValue)
+{
+    Slot* done;
+    while (mDone.pop(done)) {
+        done->buffer.Unmap();
+        done->state = Slot::Free;
+    }
+
+    for (auto& slot : mSlots) {
+        if (slot->state != Slot::InFlight || slot->retireValue > completedValue)
+            continue;
+        slot->state = Slot::Mapping;
+        slot->buffer.MapReadAsync(onMapped, slot.get());
+    }
+}
+
+bool FrameCapture::pending() const
+{
+    for (const auto& slot : mSlots) {
+        if (slot->state != Slot::Free)
+            return true;
+    }
+    return false;
+}
+
+void FrameCapture::onMapped(WGPUBufferMapAsyncStatus status, const void* data, uint64_t dataLength, void* userdata)
+{
+    Slot* slot = static_cast<Slot*>(userdata);
+    FrameCapture* capture = slot->capture;
+    if (status != WGPUBufferMapAsyncStatus_Success) {
+        // cancelled as the buffers are destroyed, nothing to hand back
+        if (capture->mDestroying)
+            return;
+        // the frame is lost, the buffer can take another one
+        if (!capture->mFailed++)
+            Log(Log::Error) << "frame capture: unable to map frame" << slot->frame << ", status" << static_cast<uint32_t>(status);
+        slot->state = Slot::Free;
+        return;
+    }
+
+    assert(dataLength >= static_cast<uint64_t>(capture->mRowPitch) * capture->mHeight);
+    (void)dataLength;
+
+    slot->state = Slot::Writing;
+    const uint8_t* pixels = static_cast<const uint8_t*>(data);
+    capture->mWriter->post([capture, slot, pixels]() {
+        capture->write(slot, pixels);
+        capture->mDone.push(static_cast<Slot*>(slot));
+    });
+}
+
+void FrameCapture::write(Slot* slot, const uint8_t* data)
+{
+    bool ok = true;
+    uint64_t bytes = 0;
+    if (mOutputFormat == Format::Png) {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "-%06" PRIu64 ".png", slot->frame);
+        ok = writePng(mPath + suffix, data, mWidth, mHeight, mRowPitch, mSwizzle, mRow);
+        bytes = static_cast<uint64_t>(mWidth) * mHeight * 4;
+    } else {
+        const size_t rowSize = static_cast<size_t>(mWidth) * 4;
+        mRow.resize(rowSize);
+        for (uint32_t y = 0; ok && y < mHeight; ++y) {
+            const uint8_t* row = data + static_cast<uint64_t>(y) * mRowPitch;
+            if (mSwizzle) {
+                for (uint32_t x = 0; x < mWidth; ++x) {
+                    mRow[x * 4 + 0] = row[x * 4 + 2];
+                    mRow[x * 4 + 1] = row[x * 4 + 1];
+                    mRow[x * 4 + 2] = row[x * 4 + 0];
+                    mRow[x * 4 + 3] = row[x * 4 + 3];
+                }
+                row = mRow.data();
+            }
+            ok = fwrite(row, 1, rowSize, mRawFile) == rowSize;
+        }
+        bytes = static_cast<uint64_t>(rowSize) * mHeight;
+    }
+
+    if (!ok) {
+        if (!mWriteErrors.fetch_add(1, std::memory_order_relaxed))
+            Log(Log::Error) << "frame capture: unable to write frame" << slot->frame << "to" << mPath;
+        return;
+    }
+    mWritten.fetch_add(1, std::memory_order_relaxed);
+    mBytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void FrameCapture::logStats() const
+{
+    Log(Log::Info) << "frame capture:" << mCaptured << "captured," << mDropped << "dropped," << mFailed << "failed,"
+                   << writtenCount() << "written," << (bytesWritten() / (1024.0 * 1024.0)) << "MB to" << mPath;
+}
@@ -0,0 +1,101 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include "Constants.h"
+#include "MpscQueue.h"
+#include "WorkerPool.h"
+#include <dawn/webgpu_cpp.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reads rendered frames back without stalling the render loop. Each
+// captured frame is copied into one of a pool of map-read buffers as part
+// of the frame's own commands, the buffer is mapped once the frame's fence
+// has passed and its rows are written out by a consumer thread straight
+// from the mapped memory. The buffer is unmapped and reused after that.
+// When every buffer is still busy the frame is dropped rather than waited
+// for.
+class FrameCapture
+{
+public:
+    enum class Format { Raw, Png };
+
+    // Raw appends tightly packed rgba frames to path, Png writes one file
+    // per frame named path-<n>.png, n counting the captured frames
+    FrameCapture(const wgpu::Device& device, wgpu::TextureFormat format, uint32_t width, uint32_t height,
+                 const std::string& path, Format outputFormat, uint32_t bufferCount = kFrameCaptureBufferCount);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    bool isValid() const { return !mPath.empty(); }
+
+    // records a copy of texture, it's read back once the fence reaches
+    // retireValue. False when the frame was dropped.
+    bool record(const wgpu::CommandEncoder& encoder, const wgpu::Texture& texture, uint64_t retireValue);
+    // maps the buffers whose fence value has been reached and recycles the
+    // ones the consumer is done with
+    void retire(uint64_t completedValue);
+    // true while frames are waiting to be mapped or written
+    bool pending() const;
+
+    uint64_t capturedCount() const { return mCaptured; }
+    uint64_t droppedCount() const { return mDropped; }
+    // captured, but the buffer couldn't be mapped
+    uint64_t failedCount() const { return mFailed; }
+    uint64_t writtenCount() const { return mWritten.load(std::memory_order_relaxed); }
+    uint64_t bytesWritten() const { return mBytesWritten.load(std::memory_order_relaxed); }
+    void logStats() const;
+
+    static bool parseFormat(const std::string& name, Format* format);
+
+private:
+    struct Slot
+    {
+        enum State { Free, InFlight, Mapping, Writing };
+
+        FrameCapture* capture { nullptr };
+        wgpu::Buffer buffer;
+        // which captured frame it holds
+        uint64_t frame { 0 };
+        uint64_t retireValue { 0 };
+        State state { Free };
+    };
+
+    void write(Slot* slot, const uint8_t* data);
+    static void onMapped(WGPUBufferMapAsyncStatus status, const void* data, uint64_t dataLength, void* userdata);
+
+private:
+    std::string mPath;
+    Format mOutputFormat;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mRowPitch;
+    // the consumer writes rgba, bgra targets are swizzled on the way out
+    bool mSwizzle { false };
+    std::vector<std::unique_ptr<Slot>> mSlots;
+    uint32_t mNext { 0 };
+
+    uint64_t mCaptured { 0 };
+    uint64_t mDropped { 0 };
+    uint64_t mFailed { 0 };
+    // map requests cancelled from here on are the buffers going away
+    bool mDestroying { false };
+
+    // only touched by the consumer thread
+    FILE* mRawFile { nullptr };
+    std::vector<uint8_t> mRow;
+    std::atomic<uint64_t> mWritten { 0 };
+    std::atomic<uint64_t> mBytesWritten { 0 };
+    std::atomic<uint64_t> mWriteErrors { 0 };
+    // handed back by the consumer, unmapped on the render thread
+    MpscQueue<Slot*> mDone;
+    std::unique_ptr<WorkerPool> mWriter;
+};
+
+#endif // FRAMECAPTURE_H
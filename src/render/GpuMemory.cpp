@@ -0,0 +1,283 @@
+#include "GpuMemory.h"
+#include <log/Log.h>
+#include <algorithm>
+#include <string>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static uint32_t bytesPerTexel(WGPUTextureFormat format)
+{
+    switch (format) {
+    case WGPUTextureFormat_R8Unorm:
+    case WGPUTextureFormat_R8Snorm:
+    case WGPUTextureFormat_R8Uint:
+    case WGPUTextureFormat_R8Sint:
+        return 1;
+    case WGPUTextureFormat_RG8Unorm:
+    case WGPUTextureFormat_RG8Snorm:
+    case WGPUTextureFormat_RG8Uint:
+    case WGPUTextureFormat_RG8Sint:
+    case WGPUTextureFormat_R16Uint:
+    case WGPUTextureFormat_R16Sint:
+    case WGPUTextureFormat_R16Float:
+        return 2;
+    case WGPUTextureFormat_RG32Float:
+    case WGPUTextureFormat_RG32Uint:
+    case WGPUTextureFormat_RG32Sint:
+    case WGPUTextureFormat_RGBA16Uint:
+    case WGPUTextureFormat_RGBA16Sint:
+    case WGPUTextureFormat_RGBA16Float:
+        return 8;
+    case WGPUTextureFormat_RGBA32Float:
+    case WGPUTextureFormat_RGBA32Uint:
+    case WGPUTextureFormat_RGBA32Sint:
+        return 16;
+    default:
+        // the 8 bit four channel formats, the depth formats and whatever
+        // else this renderer doesn't create
+        return 4;
+    }
+}
+
+static uint64_t textureBytes(const WGPUTextureDescriptor* descriptor)
+{
+    uint64_t texels = 0;
+    for (uint32_t level = 0; level < descriptor->mipLevelCount; ++level) {
+        texels += static_cast<uint64_t>(std::max(descriptor->size.width >> level, 1u))
+            * std::max(descriptor->size.height >> level, 1u) * std::max(descriptor->size.depth, 1u);
+    }
+    return texels * std::max(descriptor->arrayLayerCount, 1u) * std::max(descriptor->sampleCount, 1u)
+        * bytesPerTexel(descriptor->format);
+}
+
+static GpuMemory::Category textureCategory(const WGPUTextureDescriptor* descriptor)
+{
+    switch (descriptor->format) {
+    case WGPUTextureFormat_Depth32Float:
+    case WGPUTextureFormat_Depth24Plus:
+    case WGPUTextureFormat_Depth24PlusStencil8:
+        return GpuMemory::Category::DepthStencil;
+    default:
+        break;
+    }
+    // uploaded content, mip chains rendered by MipGenerator included
+    if (descriptor->usage & WGPUTextureUsage_CopyDst)
+        return GpuMemory::Category::Texture;
+    if (descriptor->usage & WGPUTextureUsage_OutputAttachment)
+        return GpuMemory::Category::RenderTarget;
+    return GpuMemory::Category::Texture;
+}
+
+static GpuMemory::Category bufferCategory(const WGPUBufferDescriptor* descriptor)
+{
+    if (descriptor->usage & WGPUBufferUsage_MapWrite)
+        return GpuMemory::Category::StagingBuffer;
+    if (descriptor->usage & WGPUBufferUsage_MapRead)
+        return GpuMemory::Category::ReadbackBuffer;
+    if (descriptor->usage & WGPUBufferUsage_Uniform)
+        return GpuMemory::Category::UniformBuffer;
+    if (descriptor->usage & (WGPUBufferUsage_Vertex | WGPUBufferUsage_Index))
+        return GpuMemory::Category::VertexBuffer;
+    return GpuMemory::Category::OtherBuffer;
+}
+
+uint64_t GpuMemory::Stats::totalBytes() const
+{
+    uint64_t total = 0;
+    for (uint64_t b : bytes)
+        total += b;
+    return total;
+}
+
+uint64_t GpuMemory::Stats::totalObjects() const
+{
+    uint64_t total = 0;
+    for (uint64_t o : objects)
+        total += o;
+    return total;
+}
+
+GpuMemory& GpuMemory::instance()
+{
+    static GpuMemory memory;
+    return memory;
+}
+
+DawnProcTable GpuMemory::install(const DawnProcTable& procs)
+{
+    if (procs.deviceCreateTexture == createTexture)
+        return procs;
+
+    // before the table is in use, the tracking procs read this unlocked
+    mProcs = procs;
+
+    DawnProcTable tracking = procs;
+    tracking.deviceCreateTexture = createTexture;
+    tracking.textureReference = textureReference;
+    tracking.textureRelease = textureRelease;
+    tracking.textureDestroy = textureDestroy;
+    tracking.deviceCreateBuffer = createBuffer;
+    tracking.deviceCreateBufferMapped = createBufferMapped;
+    tracking.bufferReference = bufferReference;
+    tracking.bufferRelease = bufferRelease;
+    tracking.bufferDestroy = bufferDestroy;
+    return tracking;
+}
+
+void GpuMemory::add(void* object, Category category, uint64_t bytes)
+{
+    if (!object)
+        return;
+
+    const uint32_t index = static_cast<uint32_t>(category);
+    std::lock_guard<std::mutex> locker(mMutex);
+    mObjects[object] = { category, bytes, 1 };
+    mStats.bytes[index] += bytes;
+    ++mStats.objects[index];
+    ++mStats.created;
+    mStats.peakBytes = std::max(mStats.peakBytes, mStats.totalBytes());
+}
+
+void GpuMemory::reference(void* object)
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    auto it = mObjects.find(object);
+    if (it != mObjects.end())
+        ++it->second.refs;
+}
+
+void GpuMemory::remove(void* object, bool release)
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    // objects created before install() aren't known
+    auto it = mObjects.find(object);
+    if (it == mObjects.end())
+        return;
+    if (release && --it->second.refs > 0)
+        return;
+
+    const uint32_t index = static_cast<uint32_t>(it->second.category);
+    mStats.bytes[index] -= it->second.bytes;
+    --mStats.objects[index];
+    ++mStats.released;
+    mObjects.erase(it);
+}
+
+// releases are accounted for before they're passed on, once released the
+// handle may come back out of a creation on another thread
+
+WGPUTexture GpuMemory::createTexture(WGPUDevice device, const WGPUTextureDescriptor* descriptor)
+{
+    GpuMemory& memory = instance();
+    WGPUTexture texture = memory.mProcs.deviceCreateTexture(device, descriptor);
+    memory.add(texture, textureCategory(descriptor), textureBytes(descriptor));
+    return texture;
+}
+
+void GpuMemory::textureReference(WGPUTexture texture)
+{
+    GpuMemory& memory = instance();
+    memory.reference(texture);
+    memory.mProcs.textureReference(texture);
+}
+
+void GpuMemory::textureRelease(WGPUTexture texture)
+{
+    GpuMemory& memory = instance();
+    memory.remove(texture, true);
+    memory.mProcs.textureRelease(texture);
+}
+
+void GpuMemory::textureDestroy(WGPUTexture texture)
+{
+    GpuMemory& memory = instance();
+    memory.remove(texture, false);
+    memory.mProcs.textureDestroy(texture);
+}
+
+WGPUBuffer GpuMemory::createBuffer(WGPUDevice device, const WGPUBufferDescriptor* descriptor)
+{
+    GpuMemory& memory = instance();
+    WGPUBuffer buffer = memory.mProcs.deviceCreateBuffer(device, descriptor);
+    memory.add(buffer, bufferCategory(descriptor), descriptor->size);
+    return buffer;
+}
+
+WGPUCreateBufferMappedResult GpuMemory::createBufferMapped(WGPUDevice device, const WGPUBufferDescriptor* descriptor)
+{
+    GpuMemory& memory = instance();
+    WGPUCreateBufferMappedResult result = memory.mProcs.deviceCreateBufferMapped(device, descriptor);
+    memory.add(result.buffer, bufferCategory(descriptor), descriptor->size);
+    return result;
+}
+
+void GpuMemory::bufferReference(WGPUBuffer buffer)
+{
+    GpuMemory& memory = instance();
+    memory.reference(buffer);
+    memory.mProcs.bufferReference(buffer);
+}
+
+void GpuMemory::bufferRelease(WGPUBuffer buffer)
+{
+    GpuMemory& memory = instance();
+    memory.remove(buffer, true);
+    memory.mProcs.bufferRelease(buffer);
+}
+
+void GpuMemory::bufferDestroy(WGPUBuffer buffer)
+{
+    GpuMemory& memory = instance();
+    memory.remove(buffer, false);
+    memory.mProcs.bufferDestroy(buffer);
+}
+
+GpuMemory::Stats GpuMemory::stats() const
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    return mStats;
+}
+
+uint64_t GpuMemory::totalBytes() const
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    return mStats.totalBytes();
+}
+
+void GpuMemory::logStats() const
+{
+    const Stats s = stats();
+    Log(Log::Info) << "gpu memory:" << s.totalBytes() << "bytes in" << s.totalObjects() << "objects, peak"
+                   << s.peakBytes << "bytes," << s.created << "created," << s.released << "released";
+    for (uint32_t i = 0; i < kCategoryCount; ++i) {
+        if (!s.objects[i])
+            continue;
+        Log(Log::Info) << "gpu memory," << std::string(categoryName(static_cast<Category>(i))) + ":" << s.bytes[i]
+                       << "bytes in" << s.objects[i] << "objects";
+    }
+}
+
+const char* GpuMemory::categoryName(Category category)
+{
+    switch (category) {
+    case Category::Texture:
+        return "textures";
+    case Category::RenderTarget:
+        return "render targets";
+    case Category::DepthStencil:
+        return "depth stencil";
+    case Category::UniformBuffer:
+        return "uniform buffers";
+    case Category::VertexBuffer:
+        return "vertex buffers";
+    case Category::StagingBuffer:
+        return "staging buffers";
+    case Category::ReadbackBuffer:
+        return "readback buffers";
+    case Category::OtherBuffer:
+    case Category::Count:
+        break;
+    }
+    return "other buffers";
+}
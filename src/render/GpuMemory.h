@@ -0,0 +1,98 @@
+#ifndef GPUMEMORY_H
+#define GPUMEMORY_H
+
+#include <dawn/dawn_proc_table.h>
+#include <dawn/webgpu.h>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// Bytes and objects of every buffer and texture alive, by category.
+// install() swaps the creation, reference, release and destroy procs of a
+// proc table for tracking ones that call through to the originals, so once
+// the table is handed to dawn_proc everything goes through it: the Utils
+// helpers, the texture cache, the staging and streaming rings, the offscreen
+// targets. An object counts from its creation until its last reference is
+// released or it is destroyed, whatever dawn holds on to internally after
+// that isn't seen. Sizes follow from the descriptors, without the padding
+// and alignment a driver adds. Swapchain images belong to the surface and
+// aren't counted.
+class GpuMemory
+{
+public:
+    enum class Category
+    {
+        Texture,
+        RenderTarget,
+        DepthStencil,
+        UniformBuffer,
+        VertexBuffer,
+        StagingBuffer,
+        ReadbackBuffer,
+        OtherBuffer,
+        Count
+    };
+    static constexpr uint32_t kCategoryCount = static_cast<uint32_t>(Category::Count);
+
+    struct Stats
+    {
+        uint64_t bytes[kCategoryCount] {};
+        uint64_t objects[kCategoryCount] {};
+        uint64_t peakBytes { 0 };
+        // over the lifetime of the process, a count that keeps growing
+        // apart from released is a leak
+        uint64_t created { 0 };
+        uint64_t released { 0 };
+
+        uint64_t totalBytes() const;
+        uint64_t totalObjects() const;
+    };
+
+    static GpuMemory& instance();
+
+    // returns procs with the tracking procs in place, to be called before
+    // the table is handed to dawn_proc. Installing an already tracking
+    // table again is a no-op.
+    DawnProcTable install(const DawnProcTable& procs);
+
+    Stats stats() const;
+    uint64_t totalBytes() const;
+    void logStats() const;
+
+    static const char* categoryName(Category category);
+
+private:
+    GpuMemory() = default;
+
+    struct Object
+    {
+        Category category;
+        uint64_t bytes;
+        uint32_t refs;
+    };
+
+    void add(void* object, Category category, uint64_t bytes);
+    void reference(void* object);
+    // drops the object's bytes, for its last release or its destruction
+    void remove(void* object, bool release);
+
+    static WGPUTexture createTexture(WGPUDevice device, const WGPUTextureDescriptor* descriptor);
+    static void textureReference(WGPUTexture texture);
+    static void textureRelease(WGPUTexture texture);
+    static void textureDestroy(WGPUTexture texture);
+    static WGPUBuffer createBuffer(WGPUDevice device, const WGPUBufferDescriptor* descriptor);
+    static WGPUCreateBufferMappedResult createBufferMapped(WGPUDevice device, const WGPUBufferDescriptor* descriptor);
+    static void bufferReference(WGPUBuffer buffer);
+    static void bufferRelease(WGPUBuffer buffer);
+    static void bufferDestroy(WGPUBuffer buffer);
+
+private:
+    // the wrapped procs, called through by the tracking ones
+    DawnProcTable mProcs {};
+
+    mutable std::mutex mMutex;
+    std::unordered_map<void*, Object> mObjects;
+    Stats mStats;
+};
+
+#endif // GPUMEMORY_H
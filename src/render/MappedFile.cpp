@@ -0,0 +1,81 @@
+#include "MappedFile.h"
+#include "Constants.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+    if (mData)
+        munmap(const_cast<uint8_t*>(mData), mSize);
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path, Access access)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return {};
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return {};
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return {};
+
+    madvise(data, st.st_size, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+    std::shared_ptr<MappedFile> file(new MappedFile);
+    file->mData = static_cast<const uint8_t*>(data);
+    file->mSize = static_cast<size_t>(st.st_size);
+    return file;
+}
+
+std::string MappedFile::localPath(const std::string& source)
+{
+    static const std::string scheme = "file://";
+    if (source.compare(0, scheme.size(), scheme) == 0)
+        return source.substr(scheme.size());
+    if (!source.empty() && source[0] == '/')
+        return source;
+    return std::string();
+}
+
+const RawImageHeader* rawImageHeader(const MappedFile& file)
+{
+    if (file.size() < sizeof(RawImageHeader))
+        return nullptr;
+    const RawImageHeader* header = reinterpret_cast<const RawImageHeader*>(file.data());
+    if (header->magic != RawImageHeader::kMagic || !header->width || !header->height
+        || header->width > kMaxTextureDimension || header->height > kMaxTextureDimension
+        || header->bytesPerRow < static_cast<uint64_t>(header->width) * 4)
+        return nullptr;
+    if (file.size() - sizeof(RawImageHeader) < static_cast<uint64_t>(header->bytesPerRow) * header->height)
+        return nullptr;
+    return header;
+}
+
+bool readFile(const std::string& path, uint8_t* data, size_t size)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    size_t offset = 0;
+    while (offset < size) {
+        const ssize_t r = ::read(fd, data + offset, size - offset);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        offset += static_cast<size_t>(r);
+    }
+    ::close(fd);
+    return offset == size;
+}
@@ -0,0 +1,64 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Read only memory mapping of a local file.
+class MappedFile
+{
+public:
+    // how the mapping is going to be read, passed on to the kernel's
+    // readahead
+    enum class Access
+    {
+        // front to back, e.g. an image copied to the gpu or a video
+        Sequential,
+        // wherever an index points, e.g. a texture pack
+        Random
+    };
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // returns nullptr if the file can't be opened or mapped
+    static std::shared_ptr<MappedFile> open(const std::string& path, Access access = Access::Sequential);
+
+    const uint8_t* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+    // accepts file:// urls and absolute paths, returns an empty string for anything else
+    static std::string localPath(const std::string& source);
+
+private:
+    MappedFile() = default;
+
+    const uint8_t* mData { nullptr };
+    size_t mSize { 0 };
+};
+
+// Uncompressed RGBA8 image, a RawImageHeader followed by height rows of
+// bytesPerRow bytes. When bytesPerRow is a multiple of
+// kTextureRowPitchAlignment the pixels can be copied to the gpu as is.
+struct RawImageHeader
+{
+    static constexpr uint32_t kMagic = 0x57525444; // "DTRW"
+
+    uint32_t magic;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerRow;
+};
+
+// validates the header of a mapped raw image and returns a pointer to it
+const RawImageHeader* rawImageHeader(const MappedFile& file);
+
+// reads size bytes from the start of a local file into data, for consumers
+// that need their own copy of it anyway
+bool readFile(const std::string& path, uint8_t* data, size_t size);
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,120 @@
+#include "MipGenerator.h"
+#include "ObjectCache.h"
+#include "ShaderCache.h"
+#include "Utils.h"
+#include <algorithm>
+
+// a single triangle covering the whole target
+static const char* kVertexSource = R"(
+    #version 450
+    layout(location = 0) out vec2 fragUV;
+
+    vec2 positions[3] = vec2[](
+        vec2(-1.0, +1.0),
+        vec2(+3.0, +1.0),
+        vec2(-1.0, -3.0)
+    );
+
+    void main() {
+        vec2 position = positions[gl_VertexIndex];
+        fragUV = vec2(position.x + 1.0, 1.0 - position.y) * 0.5;
+        gl_Position = vec4(position, 0.0, 1.0);
+    })";
+
+static const char* kFragmentSource = R"(
+    #version 450
+    layout(set = 0, binding = 0) uniform sampler mySampler;
+    layout(set = 0, binding = 1) uniform texture2D mySource;
+
+    layout(location = 0) in vec2 fragUV;
+    layout(location = 0) out vec4 fragColor;
+    void main() {
+        fragColor = texture(sampler2D(mySource, mySampler), fragUV);
+    })";
+
+MipGenerator::MipGenerator(const wgpu::Device& device, ObjectCache& objects)
+    : mDevice(device), mObjects(objects)
+{
+    mVertexModule = mObjects.shaderModule(SingleShaderStage::Vertex, kVertexSource);
+    mFragmentModule = mObjects.shaderModule(SingleShaderStage::Fragment, kFragmentSource);
+
+    mBindGroupLayout = mObjects.bindGroupLayout({
+        {0, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+        {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture}
+    });
+
+    wgpu::SamplerDescriptor samplerDesc = GetDefaultSamplerDescriptor();
+    samplerDesc.addressModeU = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeV = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.addressModeW = wgpu::AddressMode::ClampToEdge;
+    samplerDesc.mipmapFilter = wgpu::FilterMode::Nearest;
+    mSampler = mObjects.sampler(samplerDesc);
+}
+
+uint32_t MipGenerator::levelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    uint32_t size = std::max(width, height);
+    while (size > 1) {
+        size >>= 1;
+        ++levels;
+    }
+    return levels;
+}
+
+wgpu::RenderPipeline MipGenerator::pipeline(wgpu::TextureFormat format)
+{
+    ComboRenderPipelineDescriptor descriptor(mDevice);
+    descriptor.layout = mObjects.pipelineLayout(&mBindGroupLayout);
+    descriptor.vertexStage.module = mVertexModule;
+    descriptor.cFragmentStage.module = mFragmentModule;
+    descriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleList;
+    descriptor.cColorStates[0].format = format;
+    return mObjects.renderPipeline(descriptor);
+}
+
+void MipGenerator::generate(const wgpu::CommandEncoder& encoder, const wgpu::Texture& texture,
+                            wgpu::TextureFormat format, uint32_t levelCount, uint32_t arrayLayer)
+{
+    if (levelCount < 2 || !mVertexModule || !mFragmentModule)
+        return;
+
+    wgpu::RenderPipeline blit = pipeline(format);
+
+    auto levelView = [&](uint32_t level) {
+        wgpu::TextureViewDescriptor descriptor;
+        descriptor.format = format;
+        descriptor.dimension = wgpu::TextureViewDimension::e2D;
+        descriptor.baseMipLevel = level;
+        descriptor.mipLevelCount = 1;
+        descriptor.baseArrayLayer = arrayLayer;
+        descriptor.arrayLayerCount = 1;
+        return texture.CreateView(&descriptor);
+    };
+
+    wgpu::TextureView source = levelView(0);
+    for (uint32_t level = 1; level < levelCount; ++level) {
+        wgpu::TextureView target = levelView(level);
+
+        wgpu::BindGroup bindGroup = MakeBindGroup(mDevice, mBindGroupLayout, {
+            {0, mSampler},
+            {1, source}
+        });
+
+        ComboRenderPassDescriptor renderPass({target});
+        wgpu::RenderPassEncoder pass = encoder.BeginRenderPass(&renderPass);
+        pass.SetPipeline(blit);
+        pass.SetBindGroup(0, bindGroup);
+        pass.Draw(3, 1, 0, 0);
+        pass.EndPass();
+
+        source = target;
+    }
+}
+
+void MipGenerator::warmShaders()
+{
+    ShaderCache& cache = ShaderCache::instance();
+    cache.compile(SingleShaderStage::Vertex, kVertexSource);
+    cache.compile(SingleShaderStage::Fragment, kFragmentSource);
+}
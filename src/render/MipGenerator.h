@@ -0,0 +1,40 @@
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include <dawn/webgpu_cpp.h>
+#include <cstdint>
+
+class ObjectCache;
+
+// Fills in the mip chain of a texture on the gpu. Each level is rendered
+// from the one above it with a linear filtered blit, so the cpu only ever
+// uploads level 0. Textures need OutputAttachment and Sampled usage.
+class MipGenerator
+{
+public:
+    MipGenerator(const wgpu::Device& device, ObjectCache& objects);
+
+    // compiles the shaders into the ShaderCache ahead of construction,
+    // callable from any thread
+    static void warmShaders();
+
+    static uint32_t levelCount(uint32_t width, uint32_t height);
+
+    // records the downsampling passes for levels 1..levelCount-1 of one
+    // array layer, must come after the commands that fill level 0
+    void generate(const wgpu::CommandEncoder& encoder, const wgpu::Texture& texture,
+                  wgpu::TextureFormat format, uint32_t levelCount, uint32_t arrayLayer = 0);
+
+private:
+    wgpu::RenderPipeline pipeline(wgpu::TextureFormat format);
+
+private:
+    wgpu::Device mDevice;
+    ObjectCache& mObjects;
+    wgpu::ShaderModule mVertexModule;
+    wgpu::ShaderModule mFragmentModule;
+    wgpu::BindGroupLayout mBindGroupLayout;
+    wgpu::Sampler mSampler;
+};
+
+#endif // MIPGENERATOR_H
@@ -0,0 +1,72 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock free multi producer, single consumer queue (Vyukov). Any
+// thread may push(), only one thread may pop().
+template<typename T>
+class MpscQueue
+{
+public:
+    MpscQueue();
+    ~MpscQueue();
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T&& value);
+    bool pop(T& value);
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next { nullptr };
+        T value;
+    };
+
+    std::atomic<Node*> mHead;
+    Node* mTail;
+};
+
+template<typename T>
+inline MpscQueue<T>::MpscQueue()
+{
+    Node* stub = new Node;
+    mHead.store(stub, std::memory_order_relaxed);
+    mTail = stub;
+}
+
+template<typename T>
+inline MpscQueue<T>::~MpscQueue()
+{
+    T value;
+    while (pop(value)) {
+    }
+    delete mTail;
+}
+
+template<typename T>
+inline void MpscQueue<T>::push(T&& value)
+{
+    Node* node = new Node;
+    node->value = std::move(value);
+    Node* previous = mHead.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+}
+
+template<typename T>
+inline bool MpscQueue<T>::pop(T& value)
+{
+    Node* tail = mTail;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (!next)
+        return false;
+    value = std::move(next->value);
+    mTail = next;
+    delete tail;
+    return true;
+}
+
+#endif // MPSCQUEUE_H
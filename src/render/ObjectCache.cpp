@@ -0,0 +1,238 @@
+#include "ObjectCache.h"
+#include "Utils.h"
+#include <algorithm>
+
+ObjectCache::ObjectCache(const wgpu::Device& device)
+    : mDevice(device)
+{
+}
+
+size_t ObjectCache::KeyHash::operator()(const Key& key) const
+{
+    return static_cast<size_t>(Fnv1aHash(key.words.data(), key.words.size() * sizeof(uint64_t)));
+}
+
+wgpu::ShaderModule ObjectCache::shaderModule(SingleShaderStage stage, const char* source)
+{
+    Key key;
+    key.add(stage);
+    key.add(source);
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    auto it = mShaderModules.find(key);
+    if (it != mShaderModules.end()) {
+        ++mHits;
+        return it->second;
+    }
+    ++mMisses;
+
+    // a failed compile isn't cached, the next call logs the errors again
+    wgpu::ShaderModule module = CreateShaderModule(mDevice, stage, source);
+    if (module)
+        mShaderModules.emplace(std::move(key), module);
+    return module;
+}
+
+wgpu::BindGroupLayout ObjectCache::bindGroupLayout(std::initializer_list<wgpu::BindGroupLayoutBinding> bindings)
+{
+    constexpr wgpu::ShaderStage kNoStages{};
+
+    // mirrors MakeBindGroupLayout, bindings without visibility are dropped
+    std::vector<wgpu::BindGroupLayoutBinding> visible;
+    Key key;
+    for (const wgpu::BindGroupLayoutBinding& binding : bindings) {
+        if (binding.visibility == kNoStages)
+            continue;
+        visible.push_back(binding);
+        key.add(binding.binding);
+        key.add(binding.visibility);
+        key.add(binding.type);
+        key.add(binding.hasDynamicOffset);
+        key.add(binding.multisampled);
+        key.add(binding.textureDimension);
+        key.add(binding.textureComponentType);
+    }
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    auto it = mBindGroupLayouts.find(key);
+    if (it != mBindGroupLayouts.end()) {
+        ++mHits;
+        return it->second;
+    }
+    ++mMisses;
+
+    wgpu::BindGroupLayoutDescriptor descriptor;
+    descriptor.bindingCount = static_cast<uint32_t>(visible.size());
+    descriptor.bindings = visible.data();
+    wgpu::BindGroupLayout layout = mDevice.CreateBindGroupLayout(&descriptor);
+    mBindGroupLayouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+wgpu::PipelineLayout ObjectCache::pipelineLayout(const wgpu::BindGroupLayout* bindGroupLayout)
+{
+    Key key;
+    key.add(reinterpret_cast<uintptr_t>(bindGroupLayout ? bindGroupLayout->Get() : nullptr));
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    auto it = mPipelineLayouts.find(key);
+    if (it != mPipelineLayouts.end()) {
+        ++mHits;
+        return it->second.layout;
+    }
+    ++mMisses;
+
+    PipelineLayoutEntry entry;
+    entry.layout = MakeBasicPipelineLayout(mDevice, bindGroupLayout);
+    if (bindGroupLayout)
+        entry.bindGroupLayouts.push_back(*bindGroupLayout);
+    wgpu::PipelineLayout layout = entry.layout;
+    mPipelineLayouts.emplace(std::move(key), std::move(entry));
+    return layout;
+}
+
+wgpu::Sampler ObjectCache::sampler(const wgpu::SamplerDescriptor& descriptor)
+{
+    Key key;
+    key.add(descriptor.addressModeU);
+    key.add(descriptor.addressModeV);
+    key.add(descriptor.addressModeW);
+    key.add(descriptor.magFilter);
+    key.add(descriptor.minFilter);
+    key.add(descriptor.mipmapFilter);
+    key.add(descriptor.lodMinClamp);
+    key.add(descriptor.lodMaxClamp);
+    key.add(descriptor.compare);
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    auto it = mSamplers.find(key);
+    if (it != mSamplers.end()) {
+        ++mHits;
+        return it->second;
+    }
+    ++mMisses;
+
+    wgpu::Sampler sampler = mDevice.CreateSampler(&descriptor);
+    mSamplers.emplace(std::move(key), sampler);
+    return sampler;
+}
+
+wgpu::RenderPipeline ObjectCache::renderPipeline(const wgpu::RenderPipelineDescriptor& descriptor)
+{
+    Key key;
+    key.add(reinterpret_cast<uintptr_t>(descriptor.layout.Get()));
+    key.add(reinterpret_cast<uintptr_t>(descriptor.vertexStage.module.Get()));
+    key.add(descriptor.vertexStage.entryPoint);
+    if (descriptor.fragmentStage) {
+        key.add(reinterpret_cast<uintptr_t>(descriptor.fragmentStage->module.Get()));
+        key.add(descriptor.fragmentStage->entryPoint);
+    } else {
+        key.add(0);
+    }
+
+    if (const wgpu::VertexStateDescriptor* vertexState = descriptor.vertexState) {
+        key.add(vertexState->indexFormat);
+        key.add(vertexState->vertexBufferCount);
+        for (uint32_t i = 0; i < vertexState->vertexBufferCount; ++i) {
+            const wgpu::VertexBufferLayoutDescriptor& buffer = vertexState->vertexBuffers[i];
+            key.add(buffer.arrayStride);
+            key.add(buffer.stepMode);
+            key.add(buffer.attributeCount);
+            for (uint32_t j = 0; j < buffer.attributeCount; ++j) {
+                key.add(buffer.attributes[j].format);
+                key.add(buffer.attributes[j].offset);
+                key.add(buffer.attributes[j].shaderLocation);
+            }
+        }
+    } else {
+        key.add(0);
+    }
+
+    key.add(descriptor.primitiveTopology);
+
+    if (const wgpu::RasterizationStateDescriptor* rasterization = descriptor.rasterizationState) {
+        key.add(rasterization->frontFace);
+        key.add(rasterization->cullMode);
+        key.add(rasterization->depthBias);
+        key.add(rasterization->depthBiasSlopeScale);
+        key.add(rasterization->depthBiasClamp);
+    } else {
+        key.add(0);
+    }
+
+    key.add(descriptor.sampleCount);
+    key.add(descriptor.sampleMask);
+    key.add(descriptor.alphaToCoverageEnabled);
+
+    auto addStencilFace = [&key](const wgpu::StencilStateFaceDescriptor& face) {
+        key.add(face.compare);
+        key.add(face.failOp);
+        key.add(face.depthFailOp);
+        key.add(face.passOp);
+    };
+    if (const wgpu::DepthStencilStateDescriptor* depthStencil = descriptor.depthStencilState) {
+        key.add(depthStencil->format);
+        key.add(depthStencil->depthWriteEnabled);
+        key.add(depthStencil->depthCompare);
+        addStencilFace(depthStencil->stencilFront);
+        addStencilFace(depthStencil->stencilBack);
+        key.add(depthStencil->stencilReadMask);
+        key.add(depthStencil->stencilWriteMask);
+    } else {
+        key.add(0);
+    }
+
+    auto addBlend = [&key](const wgpu::BlendDescriptor& blend) {
+        key.add(blend.operation);
+        key.add(blend.srcFactor);
+        key.add(blend.dstFactor);
+    };
+    key.add(descriptor.colorStateCount);
+    for (uint32_t i = 0; i < descriptor.colorStateCount; ++i) {
+        const wgpu::ColorStateDescriptor& color = descriptor.colorStates[i];
+        key.add(color.format);
+        addBlend(color.alphaBlend);
+        addBlend(color.colorBlend);
+        key.add(color.writeMask);
+    }
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    auto it = mRenderPipelines.find(key);
+    if (it != mRenderPipelines.end()) {
+        ++mHits;
+        return it->second.pipeline;
+    }
+    ++mMisses;
+
+    RenderPipelineEntry entry;
+    entry.pipeline = mDevice.CreateRenderPipeline(&descriptor);
+    entry.layout = descriptor.layout;
+    entry.vertexModule = descriptor.vertexStage.module;
+    if (descriptor.fragmentStage)
+        entry.fragmentModule = descriptor.fragmentStage->module;
+    wgpu::RenderPipeline pipeline = entry.pipeline;
+    mRenderPipelines.emplace(std::move(key), std::move(entry));
+    return pipeline;
+}
+
+uint64_t ObjectCache::hits() const
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    return mHits;
+}
+
+uint64_t ObjectCache::misses() const
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    return mMisses;
+}
+
+void ObjectCache::clear()
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    mRenderPipelines.clear();
+    mPipelineLayouts.clear();
+    mSamplers.clear();
+    mBindGroupLayouts.clear();
+    mShaderModules.clear();
+}
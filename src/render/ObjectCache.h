@@ -0,0 +1,111 @@
+#ifndef OBJECTCACHE_H
+#define OBJECTCACHE_H
+
+#include <dawn/webgpu_cpp.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+enum class SingleShaderStage;
+
+// Per device cache of immutable state objects. Descriptors are hashed by
+// content so identical shader modules, bind group layouts, pipeline
+// layouts, samplers and render pipelines are only ever created once. Objects referenced by a key
+// (layouts, shader modules) are kept alive by the cache so their handles
+// can't be recycled into a false hit.
+class ObjectCache
+{
+public:
+    explicit ObjectCache(const wgpu::Device& device);
+
+    // keyed on the stage and the GLSL source, so pipelines built from the
+    // same source share a module and their keys match
+    wgpu::ShaderModule shaderModule(SingleShaderStage stage, const char* source);
+    wgpu::BindGroupLayout bindGroupLayout(std::initializer_list<wgpu::BindGroupLayoutBinding> bindings);
+    wgpu::PipelineLayout pipelineLayout(const wgpu::BindGroupLayout* bindGroupLayout);
+    wgpu::Sampler sampler(const wgpu::SamplerDescriptor& descriptor);
+    wgpu::RenderPipeline renderPipeline(const wgpu::RenderPipelineDescriptor& descriptor);
+
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+    void clear();
+
+private:
+    struct Key
+    {
+        std::vector<uint64_t> words;
+
+        template<typename T>
+        void add(T value);
+        void add(float value);
+        void add(const char* string);
+
+        bool operator==(const Key& other) const { return words == other.words; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct PipelineLayoutEntry
+    {
+        wgpu::PipelineLayout layout;
+        std::vector<wgpu::BindGroupLayout> bindGroupLayouts;
+    };
+
+    struct RenderPipelineEntry
+    {
+        wgpu::RenderPipeline pipeline;
+        wgpu::PipelineLayout layout;
+        wgpu::ShaderModule vertexModule;
+        wgpu::ShaderModule fragmentModule;
+    };
+
+private:
+    wgpu::Device mDevice;
+    mutable std::mutex mMutex;
+    uint64_t mHits { 0 };
+    uint64_t mMisses { 0 };
+
+    std::unordered_map<Key, wgpu::ShaderModule, KeyHash> mShaderModules;
+    std::unordered_map<Key, wgpu::BindGroupLayout, KeyHash> mBindGroupLayouts;
+    std::unordered_map<Key, PipelineLayoutEntry, KeyHash> mPipelineLayouts;
+    std::unordered_map<Key, wgpu::Sampler, KeyHash> mSamplers;
+    std::unordered_map<Key, RenderPipelineEntry, KeyHash> mRenderPipelines;
+};
+
+template<typename T>
+inline void ObjectCache::Key::add(T value)
+{
+    words.push_back(static_cast<uint64_t>(value));
+}
+
+inline void ObjectCache::Key::add(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    words.push_back(bits);
+}
+
+inline void ObjectCache::Key::add(const char* string)
+{
+    if (!string) {
+        words.push_back(0);
+        return;
+    }
+    const size_t size = strlen(string);
+    words.push_back(size + 1);
+    for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        memcpy(&word, string + i, std::min(sizeof(uint64_t), size - i));
+        words.push_back(word);
+    }
+}
+
+#endif // OBJECTCACHE_H
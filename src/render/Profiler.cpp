@@ -0,0 +1,165 @@
+#include "Profiler.h"
+#include "Constants.h"
+#include <log/Log.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static uint32_t currentThread()
+{
+    static std::atomic<uint32_t> next { 0 };
+    thread_local const uint32_t thread = ++next;
+    return thread;
+}
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    mEnabled.store(enabled);
+    if (!enabled)
+        mTracing.store(false);
+}
+
+void Profiler::setTracing(bool tracing)
+{
+    mTracing.store(tracing);
+    if (tracing)
+        mEnabled.store(true);
+}
+
+void Profiler::record(const char* name, Clock::time_point start, Clock::time_point end)
+{
+    if (!enabled())
+        return;
+
+    const int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    const uint32_t thread = currentThread();
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    Series& series = this->series(name);
+    series.samples[series.next] = duration;
+    series.next = (series.next + 1) % series.samples.size();
+    ++series.count;
+
+    if (tracing()) {
+        if (mEvents.size() < kMaxTraceEvents) {
+            const int64_t offset = std::chrono::duration_cast<std::chrono::nanoseconds>(start - mEpoch).count();
+            mEvents.push_back({ name, thread, offset, duration });
+        } else {
+            ++mDroppedEvents;
+        }
+    }
+}
+
+Profiler::Series& Profiler::series(const char* name)
+{
+    auto it = mIndex.find(name);
+    if (it != mIndex.end())
+        return mSeries[it->second];
+
+    size_t index = 0;
+    while (index < mSeries.size() && strcmp(mSeries[index].name, name) != 0) {
+        ++index;
+    }
+    if (index == mSeries.size()) {
+        mSeries.emplace_back();
+        mSeries.back().name = name;
+        mSeries.back().samples.resize(kProfilerWindowSize);
+    }
+    mIndex.emplace(name, index);
+    return mSeries[index];
+}
+
+void Profiler::reset()
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    // the series keep their windows, a reset only drops the samples
+    for (Series& series : mSeries) {
+        series.next = 0;
+        series.count = 0;
+    }
+    mEvents.clear();
+    mDroppedEvents = 0;
+}
+
+Profiler::Percentiles Profiler::percentiles(const Series& series) const
+{
+    Percentiles result;
+    result.count = series.count;
+    const size_t size = static_cast<size_t>(std::min<uint64_t>(series.count, series.samples.size()));
+    if (!size)
+        return result;
+
+    std::vector<int64_t> sorted(series.samples.begin(), series.samples.begin() + size);
+    std::sort(sorted.begin(), sorted.end());
+    auto at = [&sorted](double fraction) {
+        const size_t index = std::min(static_cast<size_t>(fraction * sorted.size()), sorted.size() - 1);
+        return std::chrono::nanoseconds(sorted[index]);
+    };
+    result.p50 = at(0.50);
+    result.p95 = at(0.95);
+    result.p99 = at(0.99);
+    return result;
+}
+
+Profiler::Percentiles Profiler::percentiles(const std::string& name) const
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    for (const Series& series : mSeries) {
+        if (name == series.name)
+            return percentiles(series);
+    }
+    return Percentiles();
+}
+
+void Profiler::logStats() const
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    auto ms = [](std::chrono::nanoseconds time) {
+        return std::chrono::duration<double, std::milli>(time).count();
+    };
+    for (const Series& series : mSeries) {
+        if (!series.count)
+            continue;
+        const Percentiles p = percentiles(series);
+        Log(Log::Info) << "profile:" << series.name << p.count << "samples, p50" << ms(p.p50) << "ms, p95"
+                       << ms(p.p95) << "ms, p99" << ms(p.p99) << "ms";
+    }
+}
+
+bool Profiler::writeTrace(const std::string& path) const
+{
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        Log(Log::Error) << "unable to open trace file" << path;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (size_t i = 0; i < mEvents.size(); ++i) {
+        const TraceEvent& event = mEvents[i];
+        // trace_event timestamps are in microseconds, names are literals
+        // without anything that needs escaping
+        fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"dt\",\"ph\":\"X\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%.3f,\"dur\":%.3f}",
+                i ? "," : "", event.name, event.thread, event.start / 1000.0, event.duration / 1000.0);
+    }
+    fprintf(f, "\n]}\n");
+
+    const bool ok = fclose(f) == 0;
+    if (ok) {
+        Log(Log::Info) << "wrote" << mEvents.size() << "trace events to" << path;
+        if (mDroppedEvents)
+            Log(Log::Warn) << "trace buffer full," << mDroppedEvents << "events dropped";
+    }
+    return ok;
+}
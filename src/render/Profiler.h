@@ -0,0 +1,115 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Scoped cpu timing markers. Every marker keeps a rolling window of samples
+// for percentiles and, while tracing, the individual events are kept around
+// to be written out as a chrome trace_event file. Disabled markers cost a
+// relaxed atomic load. This dawn revision has no timestamp queries, so there
+// is no gpu side timing.
+class Profiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Percentiles
+    {
+        uint64_t count { 0 };
+        std::chrono::nanoseconds p50 { 0 };
+        std::chrono::nanoseconds p95 { 0 };
+        std::chrono::nanoseconds p99 { 0 };
+    };
+
+    class Scope
+    {
+    public:
+        // name has to outlive the profiler, in practice a string literal
+        explicit Scope(const char* name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* mName;
+        Clock::time_point mStart;
+    };
+
+    static Profiler& instance();
+
+    void setEnabled(bool enabled);
+    bool enabled() const { return mEnabled.load(std::memory_order_relaxed); }
+    // implies enabled
+    void setTracing(bool tracing);
+    bool tracing() const { return mTracing.load(std::memory_order_relaxed); }
+
+    // for spans that don't map to a scope, e.g. waiting on a fence
+    void record(const char* name, Clock::time_point start, Clock::time_point end);
+
+    // drops every sample and trace event, the series stay
+    void reset();
+
+    Percentiles percentiles(const std::string& name) const;
+    void logStats() const;
+    bool writeTrace(const std::string& path) const;
+
+private:
+    Profiler() = default;
+
+    struct Series
+    {
+        const char* name { nullptr };
+        std::vector<int64_t> samples;
+        size_t next { 0 };
+        uint64_t count { 0 };
+    };
+
+    struct TraceEvent
+    {
+        const char* name;
+        uint32_t thread;
+        int64_t start;
+        int64_t duration;
+    };
+
+    Percentiles percentiles(const Series& series) const;
+    // the series of name, by its text when the pointer isn't known yet
+    Series& series(const char* name);
+
+private:
+    std::atomic<bool> mEnabled { false };
+    std::atomic<bool> mTracing { false };
+    const Clock::time_point mEpoch { Clock::now() };
+
+    mutable std::mutex mMutex;
+    // in the order they were first recorded. Looked up by the name's
+    // pointer, recording doesn't build a string; the same text at another
+    // address (a literal in another translation unit) maps to the same
+    // series.
+    std::vector<Series> mSeries;
+    std::unordered_map<const char*, size_t> mIndex;
+    std::vector<TraceEvent> mEvents;
+    uint64_t mDroppedEvents { 0 };
+};
+
+inline Profiler::Scope::Scope(const char* name)
+    : mName(name)
+{
+    if (Profiler::instance().enabled())
+        mStart = Clock::now();
+}
+
+inline Profiler::Scope::~Scope()
+{
+    if (mStart != Clock::time_point())
+        Profiler::instance().record(mName, mStart, Clock::now());
+}
+
+#endif // PROFILER_H
@@ -0,0 +1,66 @@
+#include "ResolutionScaler.h"
+#include <algorithm>
+#include <cmath>
+
+// frame time relative to the target outside of which the scale changes
+static constexpr double kScaleDownAbove = 1.05;
+static constexpr double kScaleUpBelow = 0.8;
+static constexpr float kScaleUpStep = 0.05f;
+// changes smaller than this aren't worth reallocating the targets for
+static constexpr float kMinScaleChange = 0.02f;
+
+ResolutionScaler::ResolutionScaler(std::chrono::nanoseconds targetFrameTime, float minScale, float maxScale)
+    : mTarget(targetFrameTime), mMinScale(minScale), mMaxScale(std::max(maxScale, minScale)),
+      mScale(mMaxScale), mMinScaleSeen(mMaxScale)
+{
+    mWindow.reserve(kResolutionScaleWindow);
+    mSorted.reserve(kResolutionScaleWindow);
+}
+
+bool ResolutionScaler::addFrame(std::chrono::nanoseconds frameTime)
+{
+    mWindow.push_back(frameTime.count());
+    if (mWindow.size() < kResolutionScaleWindow)
+        return false;
+
+    mSorted = mWindow;
+    mWindow.clear();
+    const size_t index = mSorted.size() * 9 / 10;
+    std::nth_element(mSorted.begin(), mSorted.begin() + index, mSorted.end());
+    const double ratio = static_cast<double>(mSorted[index]) / mTarget.count();
+
+    float scale = mScale;
+    if (ratio > kScaleDownAbove) {
+        // frame time goes roughly with the pixel count, the square of the scale
+        scale = mScale * static_cast<float>(std::sqrt(1.0 / ratio));
+    } else if (ratio < kScaleUpBelow) {
+        scale = mScale + kScaleUpStep;
+    }
+    scale = std::min(std::max(scale, mMinScale), mMaxScale);
+    if (std::abs(scale - mScale) < kMinScaleChange && scale != mMinScale && scale != mMaxScale)
+        return false;
+    if (scale == mScale)
+        return false;
+
+    mScale = scale;
+    mMinScaleSeen = std::min(mMinScaleSeen, mScale);
+    ++mChanges;
+    return true;
+}
+
+std::chrono::nanoseconds ResolutionScaler::frameTime(std::chrono::nanoseconds cpuTime,
+                                                     std::chrono::steady_clock::time_point submitted,
+                                                     std::chrono::steady_clock::time_point previousCompleted,
+                                                     std::chrono::steady_clock::time_point completed)
+{
+    const auto gpuStart = std::max(submitted, previousCompleted);
+    const auto gpuTime = std::chrono::duration_cast<std::chrono::nanoseconds>(completed - gpuStart);
+    return std::max(cpuTime, gpuTime);
+}
+
+uint32_t ResolutionScaler::scaled(uint32_t size) const
+{
+    const uint32_t s = static_cast<uint32_t>(std::ceil(size * mScale));
+    const uint32_t aligned = (s + kResolutionScaleAlignment - 1) / kResolutionScaleAlignment * kResolutionScaleAlignment;
+    return std::max(std::min(aligned, size), 1u);
+}
@@ -0,0 +1,52 @@
+#ifndef RESOLUTIONSCALER_H
+#define RESOLUTIONSCALER_H
+
+#include "Constants.h"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Picks the scale of the render target from what recent frames cost, the
+// time the slower of the cpu and the gpu spent on each. Once a window of
+// frames has been measured the slowest tenth of it is compared
+// against the target: too slow scales the pixel count down in proportion,
+// comfortably fast scales it back up a step at a time. Frames measured
+// across a change are thrown away so the new size is judged on its own.
+class ResolutionScaler
+{
+public:
+    explicit ResolutionScaler(std::chrono::nanoseconds targetFrameTime,
+                              float minScale = kMinResolutionScale, float maxScale = 1.0f);
+
+    // frameTime is the larger of the frame's cpu and gpu time, not the
+    // interval between frames. Returns true when scale() changed.
+    bool addFrame(std::chrono::nanoseconds frameTime);
+
+    // A frame's cost without timestamp queries: its cpu time, which mustn't
+    // include waiting for a backbuffer, or its gpu time, from when the gpu
+    // could start on it (submitted and done with the frame before) to when
+    // its fence completed, whichever is larger.
+    static std::chrono::nanoseconds frameTime(std::chrono::nanoseconds cpuTime,
+                                              std::chrono::steady_clock::time_point submitted,
+                                              std::chrono::steady_clock::time_point previousCompleted,
+                                              std::chrono::steady_clock::time_point completed);
+
+    float scale() const { return mScale; }
+    // a dimension of the output scaled and rounded up to the alignment
+    uint32_t scaled(uint32_t size) const;
+
+    uint64_t changes() const { return mChanges; }
+    float minScaleSeen() const { return mMinScaleSeen; }
+
+private:
+    std::chrono::nanoseconds mTarget;
+    float mMinScale, mMaxScale;
+    float mScale { 1.0f };
+    std::vector<int64_t> mWindow;
+    std::vector<int64_t> mSorted;
+
+    uint64_t mChanges { 0 };
+    float mMinScaleSeen { 1.0f };
+};
+
+#endif // RESOLUTIONSCALER_H
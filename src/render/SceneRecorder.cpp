@@ -0,0 +1,106 @@
+#include "SceneRecorder.h"
+#include "Constants.h"
+#include "Utils.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cassert>
+
+SceneRecorder::SceneRecorder(const wgpu::Device& device, wgpu::TextureFormat colorFormat,
+                             wgpu::TextureFormat depthStencilFormat, uint32_t threadCount)
+    : mDevice(device), mColorFormat(colorFormat), mDepthStencilFormat(depthStencilFormat)
+{
+    if (!threadCount)
+        threadCount = WorkerPool::defaultThreadCount() + 1;
+    if (threadCount > 1)
+        mPool = std::make_unique<ForkJoinPool>(threadCount - 1);
+}
+
+uint32_t SceneRecorder::addLayer(RecordFunction&& record, std::vector<uint32_t>&& resources)
+{
+    const uint32_t layer = layerCount();
+    mLayers.push_back({ std::move(record), std::move(resources), true });
+    mBundles.push_back(wgpu::RenderBundle());
+    return layer;
+}
+
+void SceneRecorder::setResources(uint32_t layer, std::vector<uint32_t>&& resources)
+{
+    assert(layer < layerCount());
+    mLayers[layer].resources = std::move(resources);
+}
+
+void SceneRecorder::setResources(uint32_t layer, std::initializer_list<uint32_t> resources)
+{
+    assert(layer < layerCount());
+    mLayers[layer].resources.assign(resources);
+}
+
+void SceneRecorder::invalidate(uint32_t layer)
+{
+    assert(layer < layerCount());
+    mLayers[layer].dirty = true;
+}
+
+void SceneRecorder::invalidateAll()
+{
+    for (Layer& layer : mLayers) {
+        layer.dirty = true;
+    }
+}
+
+void SceneRecorder::record(size_t first, size_t last)
+{
+    for (size_t i = first; i < last; ++i) {
+        mLayers[mDirty[i]].record(mEncoders[i]);
+    }
+}
+
+void SceneRecorder::recordJob(void* recorder, size_t job)
+{
+    SceneRecorder* self = static_cast<SceneRecorder*>(recorder);
+    const size_t first = job * self->mPerJob;
+    self->record(first, std::min(first + self->mPerJob, self->mDirty.size()));
+}
+
+const std::vector<wgpu::RenderBundle>& SceneRecorder::bundles()
+{
+    mDirty.clear();
+    for (uint32_t i = 0; i < layerCount(); ++i) {
+        if (mLayers[i].dirty)
+            mDirty.push_back(i);
+    }
+    if (mDirty.empty())
+        return mBundles;
+
+    ComboRenderBundleEncoderDescriptor descriptor;
+    descriptor.colorFormatsCount = 1;
+    descriptor.cColorFormats[0] = mColorFormat;
+    descriptor.depthStencilFormat = mDepthStencilFormat;
+
+    const size_t count = mDirty.size();
+    mEncoders.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        mEncoders[i] = mDevice.CreateRenderBundleEncoder(&descriptor);
+    }
+
+    // a job per thread, unless there are too few layers to be worth the
+    // hand off
+    const size_t maxJobs = (count + kMinLayersPerRecordJob - 1) / kMinLayersPerRecordJob;
+    size_t jobs = std::min<size_t>(threadCount(), maxJobs);
+    mPerJob = (count + jobs - 1) / jobs;
+    jobs = (count + mPerJob - 1) / mPerJob;
+
+    if (jobs > 1) {
+        mPool->run(jobs, recordJob, this);
+    } else {
+        record(0, count);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        mBundles[mDirty[i]] = mEncoders[i].Finish();
+        mLayers[mDirty[i]].dirty = false;
+    }
+    mEncoders.clear();
+    mLayersRecorded += count;
+    return mBundles;
+}
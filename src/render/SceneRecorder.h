@@ -0,0 +1,75 @@
+#ifndef SCENERECORDER_H
+#define SCENERECORDER_H
+
+#include "ForkJoinPool.h"
+#include <dawn/webgpu_cpp.h>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+// Keeps one render bundle per layer of the scene and re-records only the
+// layers that were invalidated, the render pass executes all of them in
+// layer order. Dirty layers are recorded in parallel: the device isn't
+// thread safe so encoders are created and finished on the calling thread,
+// the commands in between are encoded on the workers with every encoder
+// owned by exactly one thread.
+class SceneRecorder
+{
+public:
+    typedef std::function<void(const wgpu::RenderBundleEncoder&)> RecordFunction;
+
+    // threadCount includes the calling thread, 1 records everything on it
+    // and 0 picks a default
+    SceneRecorder(const wgpu::Device& device, wgpu::TextureFormat colorFormat,
+                  wgpu::TextureFormat depthStencilFormat, uint32_t threadCount = 0);
+
+    SceneRecorder(const SceneRecorder&) = delete;
+    SceneRecorder& operator=(const SceneRecorder&) = delete;
+
+    // the function may run on any thread, it must only read shared state.
+    // resources are the asset ids of the textures the layer samples.
+    uint32_t addLayer(RecordFunction&& record, std::vector<uint32_t>&& resources = {});
+    void setResources(uint32_t layer, std::vector<uint32_t>&& resources);
+    // copied into the layer's list, which keeps its capacity
+    void setResources(uint32_t layer, std::initializer_list<uint32_t> resources);
+    const std::vector<uint32_t>& resources(uint32_t layer) const { return mLayers[layer].resources; }
+    void invalidate(uint32_t layer);
+    void invalidateAll();
+    uint32_t layerCount() const { return static_cast<uint32_t>(mLayers.size()); }
+
+    // records what changed since the last call, the bundles are in layer order
+    const std::vector<wgpu::RenderBundle>& bundles();
+
+    uint32_t threadCount() const { return mPool ? mPool->size() + 1 : 1; }
+    uint64_t layersRecorded() const { return mLayersRecorded; }
+
+private:
+    void record(size_t first, size_t last);
+    static void recordJob(void* recorder, size_t job);
+
+private:
+    struct Layer
+    {
+        RecordFunction record;
+        std::vector<uint32_t> resources;
+        bool dirty { true };
+    };
+
+    wgpu::Device mDevice;
+    wgpu::TextureFormat mColorFormat;
+    wgpu::TextureFormat mDepthStencilFormat;
+    std::unique_ptr<ForkJoinPool> mPool;
+
+    std::vector<Layer> mLayers;
+    std::vector<wgpu::RenderBundle> mBundles;
+    // dirty layers and their encoders while recording
+    std::vector<uint32_t> mDirty;
+    std::vector<wgpu::RenderBundleEncoder> mEncoders;
+    // layers per job of the bundles() call in progress
+    size_t mPerJob { 0 };
+    uint64_t mLayersRecorded { 0 };
+};
+
+#endif // SCENERECORDER_H
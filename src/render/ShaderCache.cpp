@@ -0,0 +1,206 @@
+#include "ShaderCache.h"
+#include <log/Log.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static constexpr uint32_t kSpirvMagic = 0x07230203u;
+
+// a blob is this header, the source it was compiled from and the SPIR-V
+struct BlobHeader
+{
+    static constexpr uint32_t kMagic = 0x43535444u; // "DTSC"
+
+    uint32_t magic;
+    uint32_t stage;
+    uint64_t sourceSize;
+    uint64_t spirvWords;
+};
+
+static bool makeDirectories(const std::string& directory)
+{
+    for (size_t pos = 1; pos <= directory.size(); ++pos) {
+        if (pos != directory.size() && directory[pos] != '/')
+            continue;
+        const std::string sub = directory.substr(0, pos);
+        if (mkdir(sub.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+    }
+    return true;
+}
+
+static std::string defaultDirectory()
+{
+    if (const char* xdg = getenv("XDG_CACHE_HOME")) {
+        if (*xdg)
+            return std::string(xdg) + "/dawntest/shaders";
+    }
+    if (const char* home = getenv("HOME")) {
+        if (*home)
+            return std::string(home) + "/.cache/dawntest/shaders";
+    }
+    return std::string();
+}
+
+ShaderCache& ShaderCache::instance()
+{
+    static ShaderCache cache;
+    return cache;
+}
+
+ShaderCache::ShaderCache()
+    : mDirectory(defaultDirectory())
+{
+    // Part of the cache key, so blobs from a different compiler are never
+    // reused. shaderc has no version of its own to ask for, the SPIR-V
+    // version and revision it was built against change with every
+    // glslang/SPIRV-Headers upgrade. Bump v when the compile options change.
+    unsigned int spirvVersion = 0;
+    unsigned int spirvRevision = 0;
+    shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+    mOptionsKey = "spv=" + std::to_string(spirvVersion) + "." + std::to_string(spirvRevision) + ";v=3";
+}
+
+void ShaderCache::setDirectory(const std::string& directory)
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    mDirectory = directory;
+}
+
+std::string ShaderCache::directory() const
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+    return mDirectory;
+}
+
+uint64_t ShaderCache::key(SingleShaderStage stage, const std::string& source) const
+{
+    const uint32_t s = static_cast<uint32_t>(stage);
+    const uint64_t size = source.size();
+    uint64_t hash = Fnv1aHash(&s, sizeof(s));
+    hash = Fnv1aHash(&size, sizeof(size), hash);
+    hash = Fnv1aHash(mOptionsKey.data(), mOptionsKey.size(), hash);
+    return Fnv1aHash(source.data(), source.size(), hash);
+}
+
+std::string ShaderCache::path(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".spv", key);
+    return mDirectory + "/" + name;
+}
+
+bool ShaderCache::load(uint64_t key, SingleShaderStage stage, const std::string& source,
+                       std::vector<uint32_t>& spirv) const
+{
+    if (mDirectory.empty())
+        return false;
+
+    FILE* f = fopen(path(key).c_str(), "rb");
+    if (!f)
+        return false;
+
+    bool ok = false;
+    bool collision = false;
+    struct stat st;
+    BlobHeader header;
+    if (fstat(fileno(f), &st) == 0 && fread(&header, sizeof(header), 1, f) == 1 && header.magic == BlobHeader::kMagic
+        && header.spirvWords > 0 && header.sourceSize <= static_cast<uint64_t>(st.st_size)
+        && header.spirvWords <= static_cast<uint64_t>(st.st_size) / sizeof(uint32_t)
+        && sizeof(header) + header.sourceSize + header.spirvWords * sizeof(uint32_t) == static_cast<uint64_t>(st.st_size)) {
+        std::string blobSource(header.sourceSize, '\0');
+        if (fread(&blobSource[0], 1, blobSource.size(), f) == blobSource.size()) {
+            collision = header.stage != static_cast<uint32_t>(stage) || blobSource != source;
+            if (!collision) {
+                spirv.resize(header.spirvWords);
+                ok = fread(spirv.data(), sizeof(uint32_t), spirv.size(), f) == spirv.size() && spirv[0] == kSpirvMagic;
+            }
+        }
+    }
+    fclose(f);
+
+    if (collision) {
+        // compiled again and replaced
+        Log(Log::Warn) << "shader cache entry" << path(key) << "was compiled from another source";
+        return false;
+    }
+    if (!ok) {
+        Log(Log::Warn) << "discarding corrupt shader cache entry" << path(key);
+        unlink(path(key).c_str());
+        spirv.clear();
+    }
+    return ok;
+}
+
+void ShaderCache::store(uint64_t key, SingleShaderStage stage, const std::string& source,
+                        const std::vector<uint32_t>& spirv) const
+{
+    if (mDirectory.empty())
+        return;
+    if (!makeDirectories(mDirectory)) {
+        Log(Log::Warn) << "unable to create shader cache directory" << mDirectory;
+        return;
+    }
+
+    // write to a temporary file and rename so concurrent readers never see a partial blob
+    const std::string target = path(key);
+    const std::string temporary = target + "." + std::to_string(getpid()) + ".tmp";
+    FILE* f = fopen(temporary.c_str(), "wb");
+    if (!f)
+        return;
+    const BlobHeader header = { BlobHeader::kMagic, static_cast<uint32_t>(stage), source.size(), spirv.size() };
+    const bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(source.data(), 1, source.size(), f) == source.size()
+        && fwrite(spirv.data(), sizeof(uint32_t), spirv.size(), f) == spirv.size();
+    if (fclose(f) != 0 || !ok || rename(temporary.c_str(), target.c_str()) != 0) {
+        Log(Log::Warn) << "unable to write shader cache entry" << target;
+        unlink(temporary.c_str());
+    }
+}
+
+std::vector<uint32_t> ShaderCache::compile(SingleShaderStage stage, const std::string& source)
+{
+    std::lock_guard<std::mutex> locker(mMutex);
+
+    const uint64_t k = key(stage, source);
+    auto it = mEntries.find(k);
+    // on a collision the entry already there stays and this source is
+    // compiled every time, the hash is 64 bits
+    const bool collision = it != mEntries.end() && (it->second.stage != stage || it->second.source != source);
+    if (it != mEntries.end() && !collision) {
+        ++mMemoryHits;
+        return it->second.spirv;
+    }
+
+    std::vector<uint32_t> spirv;
+    if (!collision && load(k, stage, source, spirv)) {
+        ++mDiskHits;
+        mEntries[k] = { stage, source, spirv };
+        return spirv;
+    }
+
+    ++mMisses;
+    auto result = mCompiler.CompileGlslToSpv(source.c_str(), source.size(), ShadercShaderKind(stage),
+                                             "myshader?", mCompileOptions);
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+        Log(Log::Error) << result.GetErrorMessage();
+        return {};
+    }
+
+    spirv.assign(result.cbegin(), result.cend());
+    if (collision) {
+        Log(Log::Warn) << "shader cache key" << k << "collides, not caching";
+        return spirv;
+    }
+    store(k, stage, source, spirv);
+    mEntries[k] = { stage, source, spirv };
+    return spirv;
+}
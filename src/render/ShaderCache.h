@@ -0,0 +1,67 @@
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include "Utils.h"
+#include <shaderc/shaderc.hpp>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Content addressed cache of compiled SPIR-V. Entries are keyed on a hash of
+// the GLSL source, the shader stage and the compiler options, and live both
+// in memory and as blobs in a directory on disk so a warm start never has to
+// invoke shaderc. Every entry keeps the stage and source it was compiled
+// from and a hit compares them, a hash collision is a miss rather than the
+// wrong SPIR-V. A single compiler instance is kept around for misses.
+class ShaderCache
+{
+public:
+    static ShaderCache& instance();
+
+    // directory for on-disk blobs, an empty string disables the disk layer
+    void setDirectory(const std::string& directory);
+    std::string directory() const;
+
+    // returns an empty vector if compilation failed
+    std::vector<uint32_t> compile(SingleShaderStage stage, const std::string& source);
+
+    uint64_t memoryHits() const { return mMemoryHits.load(); }
+    uint64_t diskHits() const { return mDiskHits.load(); }
+    uint64_t misses() const { return mMisses.load(); }
+
+private:
+    ShaderCache();
+
+    uint64_t key(SingleShaderStage stage, const std::string& source) const;
+    std::string path(uint64_t key) const;
+
+    // false when there is no blob or it was compiled from something else
+    bool load(uint64_t key, SingleShaderStage stage, const std::string& source, std::vector<uint32_t>& spirv) const;
+    void store(uint64_t key, SingleShaderStage stage, const std::string& source,
+               const std::vector<uint32_t>& spirv) const;
+
+private:
+    struct Entry
+    {
+        SingleShaderStage stage;
+        std::string source;
+        std::vector<uint32_t> spirv;
+    };
+
+private:
+    mutable std::mutex mMutex;
+    shaderc::Compiler mCompiler;
+    shaderc::CompileOptions mCompileOptions;
+    std::string mOptionsKey;
+    std::string mDirectory;
+    std::unordered_map<uint64_t, Entry> mEntries;
+
+    std::atomic<uint64_t> mMemoryHits { 0 };
+    std::atomic<uint64_t> mDiskHits { 0 };
+    std::atomic<uint64_t> mMisses { 0 };
+};
+
+#endif // SHADERCACHE_H
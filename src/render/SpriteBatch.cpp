@@ -0,0 +1,266 @@
+#include "SpriteBatch.h"
+#include "ObjectCache.h"
+#include "ShaderCache.h"
+#include "StagingRing.h"
+#include "Utils.h"
+#include <log/Log.h>
+#include <algorithm>
+#include <cassert>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static constexpr uint32_t kMinimumCapacity = 64u;
+
+static const char* kVertexSource = R"(
+    #version 450
+    layout(location = 0) in vec4 geometry;
+    layout(location = 1) in vec4 uvRect;
+    layout(location = 2) in vec4 params;
+
+    layout(location = 0) out vec3 fragUV;
+    layout(location = 1) out float fragOpacity;
+
+    vec2 corners[4] = vec2[](
+        vec2(0.0, 0.0),
+        vec2(1.0, 0.0),
+        vec2(0.0, 1.0),
+        vec2(1.0, 1.0)
+    );
+
+    void main() {
+        vec2 corner = corners[gl_VertexIndex];
+        gl_Position = vec4(mix(geometry.x, geometry.z, corner.x), mix(geometry.y, geometry.w, corner.y), 0.0, 1.0);
+        fragUV = vec3(mix(uvRect.xy, uvRect.zw, corner), params.x);
+        fragOpacity = params.y;
+    })";
+
+static const char* kFragmentSource = R"(
+    #version 450
+    layout(set = 0, binding = 0) uniform sampler mySampler;
+    layout(set = 0, binding = 1) uniform texture2DArray myTextures;
+
+    layout(location = 0) in vec3 fragUV;
+    layout(location = 1) in float fragOpacity;
+    layout(location = 0) out vec4 fragColor;
+    void main() {
+        vec4 color = texture(sampler2DArray(myTextures, mySampler), fragUV);
+        fragColor = vec4(color.rgb, color.a * fragOpacity);
+    })";
+
+SpriteBatch::SpriteBatch(const wgpu::Device& device, ObjectCache& objects, StagingRing& staging,
+                         wgpu::TextureFormat colorFormat, wgpu::TextureFormat depthStencilFormat,
+                         uint32_t layerWidth, uint32_t layerHeight, uint32_t layerCount,
+                         uint32_t mipLevelCount)
+    : mDevice(device), mStaging(staging), mColorFormat(colorFormat), mDepthStencilFormat(depthStencilFormat),
+      mLayerWidth(layerWidth), mLayerHeight(layerHeight), mLayerCount(layerCount),
+      mMipLevelCount(std::max(mipLevelCount, 1u)), mMipmapsEnabled(mMipLevelCount > 1)
+{
+    wgpu::TextureDescriptor descriptor;
+    descriptor.dimension = wgpu::TextureDimension::e2D;
+    descriptor.size.width = mLayerWidth;
+    descriptor.size.height = mLayerHeight;
+    descriptor.size.depth = 1;
+    descriptor.arrayLayerCount = mLayerCount;
+    descriptor.sampleCount = 1;
+    descriptor.format = wgpu::TextureFormat::RGBA8Unorm;
+    descriptor.mipLevelCount = mMipLevelCount;
+    descriptor.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::Sampled;
+    if (mMipLevelCount > 1) {
+        // levels past 0 are rendered by MipGenerator
+        descriptor.usage |= wgpu::TextureUsage::OutputAttachment;
+    }
+    mTexture = mDevice.CreateTexture(&descriptor);
+
+    wgpu::TextureViewDescriptor viewDescriptor;
+    viewDescriptor.format = wgpu::TextureFormat::RGBA8Unorm;
+    viewDescriptor.dimension = wgpu::TextureViewDimension::e2DArray;
+    viewDescriptor.baseMipLevel = 0;
+    viewDescriptor.mipLevelCount = 1;
+    viewDescriptor.baseArrayLayer = 0;
+    viewDescriptor.arrayLayerCount = mLayerCount;
+    wgpu::TextureView view = mTexture.CreateView(&viewDescriptor);
+    viewDescriptor.mipLevelCount = mMipLevelCount;
+    wgpu::TextureView mipmappedView = mTexture.CreateView(&viewDescriptor);
+
+    wgpu::ShaderModule vsModule = objects.shaderModule(SingleShaderStage::Vertex, kVertexSource);
+    wgpu::ShaderModule fsModule = objects.shaderModule(SingleShaderStage::Fragment, kFragmentSource);
+
+    if (!vsModule || !fsModule) {
+        Log(Log::Error) << "sprite batch shaders failed to compile";
+        return;
+    }
+
+    wgpu::BindGroupLayoutBinding samplerBinding = {0, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler};
+    wgpu::BindGroupLayoutBinding textureBinding = {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture};
+    textureBinding.textureDimension = wgpu::TextureViewDimension::e2DArray;
+    wgpu::BindGroupLayout bgl = objects.bindGroupLayout({ samplerBinding, textureBinding });
+
+    ComboRenderPipelineDescriptor pipelineDescriptor(mDevice);
+    pipelineDescriptor.layout = objects.pipelineLayout(&bgl);
+    pipelineDescriptor.vertexStage.module = vsModule;
+    pipelineDescriptor.cFragmentStage.module = fsModule;
+    pipelineDescriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleStrip;
+    pipelineDescriptor.cVertexState.vertexBufferCount = 1;
+    pipelineDescriptor.cVertexState.cVertexBuffers[0].arrayStride = sizeof(Sprite);
+    pipelineDescriptor.cVertexState.cVertexBuffers[0].stepMode = wgpu::InputStepMode::Instance;
+    pipelineDescriptor.cVertexState.cVertexBuffers[0].attributeCount = 3;
+    for (uint32_t i = 0; i < 3; ++i) {
+        pipelineDescriptor.cVertexState.cAttributes[i].shaderLocation = i;
+        pipelineDescriptor.cVertexState.cAttributes[i].offset = i * sizeof(glm::vec4);
+        pipelineDescriptor.cVertexState.cAttributes[i].format = wgpu::VertexFormat::Float4;
+    }
+    pipelineDescriptor.depthStencilState = &pipelineDescriptor.cDepthStencilState;
+    pipelineDescriptor.cDepthStencilState.format = mDepthStencilFormat;
+    pipelineDescriptor.cColorStates[0].format = mColorFormat;
+    pipelineDescriptor.cColorStates[0].colorBlend.srcFactor = wgpu::BlendFactor::SrcAlpha;
+    pipelineDescriptor.cColorStates[0].colorBlend.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+    mPipeline = objects.renderPipeline(pipelineDescriptor);
+
+    wgpu::Sampler sampler = objects.sampler(GetDefaultSamplerDescriptor());
+    mBindGroup = MakeBindGroup(mDevice, bgl, {
+        {0, sampler},
+        {1, view}
+    });
+    mMipmappedBindGroup = MakeBindGroup(mDevice, bgl, {
+        {0, sampler},
+        {1, mipmappedView}
+    });
+}
+
+void SpriteBatch::setMipmapsEnabled(bool enabled)
+{
+    enabled = enabled && mMipLevelCount > 1;
+    if (enabled == mMipmapsEnabled)
+        return;
+    mMipmapsEnabled = enabled;
+    ++mGeneration;
+}
+
+glm::vec4 SpriteBatch::uploadLayer(uint32_t layer, const void* data, uint32_t rowPitch, uint32_t width, uint32_t height)
+{
+    assert(layer < mLayerCount);
+    width = std::min(width, mLayerWidth);
+    height = std::min(height, mLayerHeight);
+    mStaging.uploadTexture(data, rowPitch, width, height, mTexture, 0, layer);
+    return glm::vec4(0.0f, 0.0f,
+                     static_cast<float>(width) / mLayerWidth,
+                     static_cast<float>(height) / mLayerHeight);
+}
+
+void SpriteBatch::markDirty(uint32_t first, uint32_t last)
+{
+    if (mDirtyFirst == mDirtyLast) {
+        mDirtyFirst = first;
+        mDirtyLast = last;
+    } else {
+        mDirtyFirst = std::min(mDirtyFirst, first);
+        mDirtyLast = std::max(mDirtyLast, last);
+    }
+}
+
+uint32_t SpriteBatch::add(const Sprite& sprite)
+{
+    const uint32_t index = count();
+    mSprites.push_back(sprite);
+    markDirty(index, index + 1);
+    return index;
+}
+
+void SpriteBatch::set(uint32_t index, const Sprite& sprite)
+{
+    assert(index < count());
+    mSprites[index] = sprite;
+    markDirty(index, index + 1);
+}
+
+SpriteBatch::Sprite* SpriteBatch::edit(uint32_t first, uint32_t count)
+{
+    assert(first + count <= this->count());
+    if (count)
+        markDirty(first, first + count);
+    return mSprites.data() + first;
+}
+
+void SpriteBatch::clear()
+{
+    mSprites.clear();
+    mDirtyFirst = mDirtyLast = 0;
+}
+
+void SpriteBatch::update()
+{
+    if (count() > mCapacity) {
+        uint32_t capacity = std::max(mCapacity, kMinimumCapacity);
+        while (capacity < count())
+            capacity *= 2;
+
+        wgpu::BufferDescriptor descriptor;
+        descriptor.size = static_cast<uint64_t>(capacity) * sizeof(Sprite);
+        descriptor.usage = wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst;
+        mInstances = mDevice.CreateBuffer(&descriptor);
+        mCapacity = capacity;
+        ++mGeneration;
+
+        markDirty(0, count());
+    }
+
+    if (mDirtyFirst == mDirtyLast)
+        return;
+
+    mStaging.uploadBuffer(&mSprites[mDirtyFirst], static_cast<uint64_t>(mDirtyLast - mDirtyFirst) * sizeof(Sprite),
+                          mInstances, static_cast<uint64_t>(mDirtyFirst) * sizeof(Sprite));
+    mDirtyFirst = mDirtyLast = 0;
+}
+
+void SpriteBatch::encode(const wgpu::RenderBundleEncoder& encoder) const
+{
+    encode(encoder, 0, count());
+}
+
+void SpriteBatch::encode(const wgpu::RenderBundleEncoder& encoder, uint32_t first, uint32_t count) const
+{
+    first = std::min(first, this->count());
+    count = std::min(count, this->count() - first);
+    if (!count || !mInstances)
+        return;
+    encoder.SetPipeline(mPipeline);
+    encoder.SetBindGroup(0, mMipmapsEnabled ? mMipmappedBindGroup : mBindGroup);
+    encoder.SetVertexBuffer(0, mInstances);
+    encoder.Draw(4, count, 0, first);
+}
+
+void SpriteBatch::encode(const wgpu::RenderPassEncoder& pass) const
+{
+    if (mSprites.empty() || !mInstances)
+        return;
+    pass.SetPipeline(mPipeline);
+    pass.SetBindGroup(0, mMipmapsEnabled ? mMipmappedBindGroup : mBindGroup);
+    pass.SetVertexBuffer(0, mInstances);
+    pass.Draw(4, count(), 0, 0);
+}
+
+wgpu::RenderBundle SpriteBatch::bundle()
+{
+    if (mBundle && mBundleGeneration == mGeneration && mBundleCount == count())
+        return mBundle;
+
+    ComboRenderBundleEncoderDescriptor descriptor;
+    descriptor.colorFormatsCount = 1;
+    descriptor.cColorFormats[0] = mColorFormat;
+    descriptor.depthStencilFormat = mDepthStencilFormat;
+
+    wgpu::RenderBundleEncoder encoder = mDevice.CreateRenderBundleEncoder(&descriptor);
+    encode(encoder);
+    mBundle = encoder.Finish();
+    mBundleGeneration = mGeneration;
+    mBundleCount = count();
+    return mBundle;
+}
+
+void SpriteBatch::warmShaders()
+{
+    ShaderCache& cache = ShaderCache::instance();
+    cache.compile(SingleShaderStage::Vertex, kVertexSource);
+    cache.compile(SingleShaderStage::Fragment, kFragmentSource);
+}
@@ -0,0 +1,108 @@
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include <dawn/webgpu_cpp.h>
+#include <glm/vec4.hpp>
+#include <cstdint>
+#include <vector>
+
+class ObjectCache;
+class StagingRing;
+
+// Draws any number of textured quads with a single instanced draw call. Each
+// sprite is one instance in a shared vertex buffer carrying its geometry, the
+// uv rect it samples and the layer of the texture array it samples from, so
+// the cost of submitting a batch doesn't depend on how many sprites it holds.
+class SpriteBatch
+{
+public:
+    struct Sprite
+    {
+        // left, top, right, bottom in normalized device coordinates
+        glm::vec4 geometry;
+        // u0, v0, u1, v1
+        glm::vec4 uvRect;
+        // x: texture array layer, y: opacity
+        glm::vec4 params;
+    };
+
+    SpriteBatch(const wgpu::Device& device, ObjectCache& objects, StagingRing& staging,
+                wgpu::TextureFormat colorFormat, wgpu::TextureFormat depthStencilFormat,
+                uint32_t layerWidth, uint32_t layerHeight, uint32_t layerCount,
+                uint32_t mipLevelCount = 1);
+
+    // compiles the shaders into the ShaderCache ahead of construction,
+    // callable from any thread
+    static void warmShaders();
+
+    bool isValid() const { return static_cast<bool>(mPipeline); }
+
+    wgpu::Texture texture() const { return mTexture; }
+    uint32_t mipLevelCount() const { return mMipLevelCount; }
+
+    // samples the whole mip chain when enabled, only level 0 otherwise
+    void setMipmapsEnabled(bool enabled);
+    bool mipmapsEnabled() const { return mMipmapsEnabled; }
+
+    uint32_t layerWidth() const { return mLayerWidth; }
+    uint32_t layerHeight() const { return mLayerHeight; }
+    uint32_t layerCount() const { return mLayerCount; }
+
+    // uploads an image with the top left corner at 0, 0 of the given layer,
+    // returns the uv rect covering it
+    glm::vec4 uploadLayer(uint32_t layer, const void* data, uint32_t rowPitch, uint32_t width, uint32_t height);
+
+    uint32_t add(const Sprite& sprite);
+    void set(uint32_t index, const Sprite& sprite);
+    const Sprite& sprite(uint32_t index) const { return mSprites[index]; }
+    // direct access for bulk writers, marks [first, first + count) as changed
+    Sprite* edit(uint32_t first, uint32_t count);
+    uint32_t count() const { return static_cast<uint32_t>(mSprites.size()); }
+    void clear();
+
+    // queues the changed part of the instance data on the staging ring
+    void update();
+
+    void encode(const wgpu::RenderBundleEncoder& encoder) const;
+    void encode(const wgpu::RenderPassEncoder& pass) const;
+    // draws only the sprites in [first, first + count), so a large batch can
+    // be recorded as several bundles
+    void encode(const wgpu::RenderBundleEncoder& encoder, uint32_t first, uint32_t count) const;
+
+    // bumped whenever the buffer or bind group the draws use changes,
+    // bundles recorded at an older generation have to be recorded again
+    uint64_t generation() const { return mGeneration; }
+
+    // a bundle drawing the whole batch, re-recorded only when the instance
+    // buffer or the sprite count changes
+    wgpu::RenderBundle bundle();
+
+private:
+    void markDirty(uint32_t first, uint32_t last);
+
+private:
+    wgpu::Device mDevice;
+    StagingRing& mStaging;
+    wgpu::TextureFormat mColorFormat;
+    wgpu::TextureFormat mDepthStencilFormat;
+    uint32_t mLayerWidth, mLayerHeight, mLayerCount;
+    uint32_t mMipLevelCount;
+    bool mMipmapsEnabled;
+
+    wgpu::Texture mTexture;
+    wgpu::RenderPipeline mPipeline;
+    wgpu::BindGroup mBindGroup;
+    wgpu::BindGroup mMipmappedBindGroup;
+    wgpu::Buffer mInstances;
+    uint32_t mCapacity { 0 };
+
+    std::vector<Sprite> mSprites;
+    uint32_t mDirtyFirst { 0 }, mDirtyLast { 0 };
+
+    uint64_t mGeneration { 0 };
+    wgpu::RenderBundle mBundle;
+    uint64_t mBundleGeneration { 0 };
+    uint32_t mBundleCount { 0 };
+};
+
+#endif // SPRITEBATCH_H
@@ -0,0 +1,234 @@
+#include "StagingRing.h"
+#include "Utils.h"
+#include <log/Log.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+StagingRing::StagingRing(const wgpu::Device& device, uint64_t blockSize, uint64_t smallBlockSize)
+    : mDevice(device), mBlockSize(blockSize), mSmallBlockSize(std::min(smallBlockSize, blockSize))
+{
+}
+
+StagingRing::~StagingRing()
+{
+    // outstanding map requests are cancelled when the buffers go away,
+    // onMapped() ignores those
+    mCurrent = nullptr;
+    mUsed.clear();
+    mFree.clear();
+    mSmallFree.clear();
+    mBlocks.clear();
+}
+
+StagingRing::Block* StagingRing::createBlock(uint64_t size)
+{
+    wgpu::BufferDescriptor descriptor;
+    descriptor.size = size;
+    descriptor.usage = wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc;
+    wgpu::CreateBufferMappedResult result = mDevice.CreateBufferMapped(&descriptor);
+
+    auto block = std::make_unique<Block>();
+    block->ring = this;
+    block->buffer = result.buffer;
+    block->data = static_cast<uint8_t*>(result.data);
+    block->size = size;
+    block->state = Block::Mapped;
+
+    mBytesAllocated += size;
+    mBlocks.push_back(std::move(block));
+    return mBlocks.back().get();
+}
+
+StagingRing::Block* StagingRing::acquire(uint64_t size)
+{
+    if (size > mBlockSize) {
+        // dedicated block, released again once it retires
+        return createBlock(size);
+    }
+    const bool small = size <= mSmallBlockSize;
+    std::vector<Block*>& free = small ? mSmallFree : mFree;
+    if (!free.empty()) {
+        Block* block = free.back();
+        free.pop_back();
+        return block;
+    }
+    return createBlock(small ? mSmallBlockSize : mBlockSize);
+}
+
+StagingRing::Allocation StagingRing::allocate(uint64_t size, uint64_t alignment)
+{
+    assert(alignment > 0);
+    size = alignUp(size, 4);
+
+    uint64_t offset = 0;
+    if (mCurrent) {
+        offset = alignUp(mCurrent->used, alignment);
+        if (offset + size > mCurrent->size)
+            mCurrent = nullptr;
+    }
+    if (!mCurrent) {
+        mCurrent = acquire(size);
+        mUsed.push_back(mCurrent);
+        offset = 0;
+    }
+    if (!mCurrent->data) {
+        Log(Log::Error) << "staging block is not mapped";
+        return Allocation();
+    }
+
+    mCurrent->used = offset + size;
+
+    Allocation allocation;
+    allocation.data = mCurrent->data + offset;
+    allocation.buffer = mCurrent->buffer;
+    allocation.offset = offset;
+    allocation.size = size;
+    return allocation;
+}
+
+void StagingRing::copyBufferToBuffer(const Allocation& source, const wgpu::Buffer& destination, uint64_t destinationOffset)
+{
+    Copy copy;
+    copy.source = CreateBufferCopyView(source.buffer, source.offset, 0, 0);
+    copy.destinationBuffer = destination;
+    copy.destinationOffset = destinationOffset;
+    copy.size = source.size;
+    mCopies.push_back(std::move(copy));
+}
+
+void StagingRing::copyBufferToTexture(const Allocation& source, uint32_t rowPitch, uint32_t imageHeight,
+                                      const wgpu::TextureCopyView& destination, const wgpu::Extent3D& size)
+{
+    assert(rowPitch % kTextureRowPitchAlignment == 0);
+
+    Copy copy;
+    copy.source = CreateBufferCopyView(source.buffer, source.offset, rowPitch, imageHeight);
+    copy.destinationTexture = destination;
+    copy.extent = size;
+    copy.toTexture = true;
+    mCopies.push_back(std::move(copy));
+}
+
+bool StagingRing::uploadBuffer(const void* data, uint64_t size, const wgpu::Buffer& destination, uint64_t destinationOffset)
+{
+    Allocation allocation = allocate(size);
+    if (!allocation)
+        return false;
+    memcpy(allocation.data, data, size);
+    copyBufferToBuffer(allocation, destination, destinationOffset);
+    return true;
+}
+
+bool StagingRing::uploadTexture(const void* data, uint32_t rowPitch, uint32_t width, uint32_t height,
+                                const wgpu::Texture& destination, uint32_t mipLevel, uint32_t arrayLayer)
+{
+    const uint32_t alignedRowPitch = static_cast<uint32_t>(alignUp(rowPitch, kTextureRowPitchAlignment));
+    const uint64_t size = static_cast<uint64_t>(alignedRowPitch) * height;
+    Allocation allocation = allocate(size, kTextureRowPitchAlignment);
+    if (!allocation)
+        return false;
+    if (alignedRowPitch == rowPitch) {
+        memcpy(allocation.data, data, size);
+    } else {
+        const uint8_t* source = static_cast<const uint8_t*>(data);
+        for (uint32_t y = 0; y < height; ++y) {
+            memcpy(allocation.data + static_cast<uint64_t>(y) * alignedRowPitch,
+                   source + static_cast<uint64_t>(y) * rowPitch, rowPitch);
+        }
+    }
+    copyBufferToTexture(allocation, alignedRowPitch, 0,
+                        CreateTextureCopyView(destination, mipLevel, arrayLayer, {0, 0, 0}),
+                        {width, height, 1});
+    return true;
+}
+
+wgpu::Buffer StagingRing::createBuffer(const void* data, uint64_t size, wgpu::BufferUsage usage)
+{
+    wgpu::BufferDescriptor descriptor;
+    descriptor.size = alignUp(size, 4);
+    descriptor.usage = usage | wgpu::BufferUsage::CopyDst;
+
+    wgpu::Buffer buffer = mDevice.CreateBuffer(&descriptor);
+    uploadBuffer(data, size, buffer);
+    return buffer;
+}
+
+void StagingRing::record(const wgpu::CommandEncoder& encoder, uint64_t retireValue)
+{
+    if (mUsed.empty())
+        return;
+
+    for (Block* block : mUsed) {
+        block->buffer.Unmap();
+        block->data = nullptr;
+        block->retireValue = retireValue;
+        block->state = Block::InFlight;
+    }
+    mUsed.clear();
+    mCurrent = nullptr;
+
+    for (Copy& copy : mCopies) {
+        if (copy.toTexture) {
+            encoder.CopyBufferToTexture(&copy.source, &copy.destinationTexture, &copy.extent);
+        } else {
+            encoder.CopyBufferToBuffer(copy.source.buffer, copy.source.offset,
+                                       copy.destinationBuffer, copy.destinationOffset, copy.size);
+        }
+    }
+    mCopies.clear();
+}
+
+void StagingRing::submit(const wgpu::Queue& queue, uint64_t retireValue)
+{
+    if (mUsed.empty())
+        return;
+
+    wgpu::CommandEncoder encoder = mDevice.CreateCommandEncoder();
+    record(encoder, retireValue);
+    wgpu::CommandBuffer commands = encoder.Finish();
+    queue.Submit(1, &commands);
+}
+
+void StagingRing::retire(uint64_t completedValue)
+{
+    auto it = mBlocks.begin();
+    while (it != mBlocks.end()) {
+        Block* block = it->get();
+        if (block->state != Block::InFlight || block->retireValue > completedValue) {
+            ++it;
+            continue;
+        }
+        if (block->size > mBlockSize) {
+            mBytesAllocated -= block->size;
+            it = mBlocks.erase(it);
+            continue;
+        }
+        block->state = Block::Mapping;
+        block->buffer.MapWriteAsync(onMapped, block);
+        ++it;
+    }
+}
+
+void StagingRing::onMapped(WGPUBufferMapAsyncStatus status, void* data, uint64_t dataLength, void* userdata)
+{
+    if (status != WGPUBufferMapAsyncStatus_Success)
+        return;
+
+    Block* block = static_cast<Block*>(userdata);
+    assert(dataLength >= block->size);
+    (void)dataLength;
+    block->data = static_cast<uint8_t*>(data);
+    block->used = 0;
+    block->state = Block::Mapped;
+    StagingRing* ring = block->ring;
+    (block->size == ring->mSmallBlockSize ? ring->mSmallFree : ring->mFree).push_back(block);
+}
@@ -0,0 +1,112 @@
+#ifndef STAGINGRING_H
+#define STAGINGRING_H
+
+#include "Constants.h"
+#include <dawn/webgpu_cpp.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Upload allocator built from a ring of mapped staging blocks. Allocations
+// are sub-allocated linearly out of the current block, copies out of them are
+// queued and recorded into a single command encoder. Blocks that took part in
+// a submit are tagged with the fence value of that submit and remapped once
+// the fence has passed it, so steady state uploads never create buffers.
+// A block has to be unmapped to be copied from, so every submit starts the
+// next one; an allocation that fits a small block starts a small one, so
+// frames that only update uniforms keep small blocks in flight rather than
+// full ones.
+class StagingRing
+{
+public:
+    struct Allocation
+    {
+        uint8_t* data { nullptr };
+        wgpu::Buffer buffer;
+        uint64_t offset { 0 };
+        uint64_t size { 0 };
+
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    StagingRing(const wgpu::Device& device, uint64_t blockSize = kStagingBlockSize,
+                uint64_t smallBlockSize = kStagingSmallBlockSize);
+    ~StagingRing();
+
+    StagingRing(const StagingRing&) = delete;
+    StagingRing& operator=(const StagingRing&) = delete;
+
+    // the returned memory is valid until the next record() or submit()
+    Allocation allocate(uint64_t size, uint64_t alignment = 4);
+
+    void copyBufferToBuffer(const Allocation& source, const wgpu::Buffer& destination, uint64_t destinationOffset);
+    void copyBufferToTexture(const Allocation& source, uint32_t rowPitch, uint32_t imageHeight,
+                             const wgpu::TextureCopyView& destination, const wgpu::Extent3D& size);
+
+    // allocate, copy and queue in one go. Rows are repacked when rowPitch
+    // isn't a multiple of kTextureRowPitchAlignment.
+    bool uploadBuffer(const void* data, uint64_t size, const wgpu::Buffer& destination, uint64_t destinationOffset = 0);
+    bool uploadTexture(const void* data, uint32_t rowPitch, uint32_t width, uint32_t height,
+                       const wgpu::Texture& destination, uint32_t mipLevel = 0, uint32_t arrayLayer = 0);
+
+    // equivalent of CreateBufferFromData going through the ring
+    wgpu::Buffer createBuffer(const void* data, uint64_t size, wgpu::BufferUsage usage);
+
+    // Records every queued copy into encoder. The blocks involved are handed
+    // to the gpu and become reusable once the fence reaches retireValue.
+    void record(const wgpu::CommandEncoder& encoder, uint64_t retireValue);
+    // same as record() but in a command buffer of its own
+    void submit(const wgpu::Queue& queue, uint64_t retireValue);
+    // starts remapping blocks whose fence value has been reached
+    void retire(uint64_t completedValue);
+
+    bool hasPendingCopies() const { return !mCopies.empty(); }
+    uint64_t blockCount() const { return mBlocks.size(); }
+    uint64_t bytesAllocated() const { return mBytesAllocated; }
+
+private:
+    struct Block
+    {
+        enum State { Mapped, InFlight, Mapping };
+
+        StagingRing* ring { nullptr };
+        wgpu::Buffer buffer;
+        uint8_t* data { nullptr };
+        uint64_t size { 0 };
+        uint64_t used { 0 };
+        uint64_t retireValue { 0 };
+        State state { Mapped };
+    };
+
+    struct Copy
+    {
+        wgpu::BufferCopyView source;
+        wgpu::Buffer destinationBuffer;
+        uint64_t destinationOffset { 0 };
+        uint64_t size { 0 };
+        wgpu::TextureCopyView destinationTexture;
+        wgpu::Extent3D extent;
+        bool toTexture { false };
+    };
+
+    // a free or new block of the size class size falls into
+    Block* acquire(uint64_t size);
+    Block* createBlock(uint64_t size);
+    static void onMapped(WGPUBufferMapAsyncStatus status, void* data, uint64_t dataLength, void* userdata);
+
+private:
+    wgpu::Device mDevice;
+    uint64_t mBlockSize;
+    uint64_t mSmallBlockSize;
+    uint64_t mBytesAllocated { 0 };
+    std::vector<std::unique_ptr<Block>> mBlocks;
+    // most recently mapped last, reused first. A vector instead of a deque
+    // so pushing and popping never allocates once it has grown to fit
+    std::vector<Block*> mFree;
+    std::vector<Block*> mSmallFree;
+    std::vector<Block*> mUsed;
+    Block* mCurrent { nullptr };
+    std::vector<Copy> mCopies;
+};
+
+#endif // STAGINGRING_H
@@ -0,0 +1,333 @@
+#include "StatsOverlay.h"
+#include "ObjectCache.h"
+#include "ShaderCache.h"
+#include "StagingRing.h"
+#include "Utils.h"
+#include <log/Log.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <iterator>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static constexpr uint32_t kMinimumCapacity = 256u;
+
+// layout in pixels, a font pixel is kPixel wide and tall
+static constexpr float kPixel = 2.0f;
+static constexpr float kCharAdvance = 4.0f * kPixel;
+static constexpr float kLineHeight = 6.0f * kPixel;
+static constexpr float kMargin = 8.0f;
+static constexpr float kPadding = 6.0f;
+static constexpr float kGap = 4.0f;
+static constexpr float kBarWidth = 2.0f;
+static constexpr float kGraphWidth = kStatsOverlayHistory * kBarWidth;
+static constexpr float kGraphHeight = 48.0f;
+static constexpr float kPanelWidth = kPadding * 2.0f + kGraphWidth;
+static constexpr float kPanelHeight = kPadding * 2.0f + (kLineHeight + kGap + kGraphHeight + kGap) * 2.0f
+    + kLineHeight * GpuMemory::kCategoryCount;
+
+static const glm::vec4 kBackgroundColor = { 0.0f, 0.0f, 0.0f, 0.6f };
+static const glm::vec4 kTextColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+static const glm::vec4 kGraphColor = { 1.0f, 1.0f, 1.0f, 0.08f };
+static const glm::vec4 kTargetColor = { 1.0f, 1.0f, 1.0f, 0.4f };
+static const glm::vec4 kOnTimeColor = { 0.3f, 0.85f, 0.3f, 1.0f };
+static const glm::vec4 kSlowColor = { 0.95f, 0.8f, 0.2f, 1.0f };
+static const glm::vec4 kMissedColor = { 0.95f, 0.3f, 0.25f, 1.0f };
+
+static const glm::vec4 kCategoryColors[GpuMemory::kCategoryCount] = {
+    { 0.35f, 0.6f, 1.0f, 1.0f },
+    { 0.95f, 0.5f, 0.2f, 1.0f },
+    { 0.6f, 0.4f, 0.9f, 1.0f },
+    { 0.3f, 0.85f, 0.8f, 1.0f },
+    { 0.9f, 0.85f, 0.3f, 1.0f },
+    { 0.9f, 0.35f, 0.6f, 1.0f },
+    { 0.5f, 0.8f, 0.35f, 1.0f },
+    { 0.6f, 0.6f, 0.6f, 1.0f }
+};
+
+static const char* kCategoryLabels[GpuMemory::kCategoryCount] = {
+    "TEXTURE", "TARGET", "DEPTH", "UNIFORM", "VERTEX", "STAGING", "READBACK", "OTHER"
+};
+
+static const char* kVertexSource = R"(
+    #version 450
+    layout(location = 0) in vec4 geometry;
+    layout(location = 1) in vec4 color;
+
+    layout(location = 0) out vec4 fragColor;
+
+    vec2 corners[4] = vec2[](
+        vec2(0.0, 0.0),
+        vec2(1.0, 0.0),
+        vec2(0.0, 1.0),
+        vec2(1.0, 1.0)
+    );
+
+    void main() {
+        vec2 corner = corners[gl_VertexIndex];
+        gl_Position = vec4(mix(geometry.x, geometry.z, corner.x), mix(geometry.y, geometry.w, corner.y), 0.0, 1.0);
+        fragColor = color;
+    })";
+
+static const char* kFragmentSource = R"(
+    #version 450
+    layout(location = 0) in vec4 fragColor;
+    layout(location = 0) out vec4 outColor;
+    void main() {
+        outColor = fragColor;
+    })";
+
+// 3x5 pixel glyphs, one octal digit per row from the top, the high bit of
+// a row is its left pixel
+static uint16_t glyph(char c)
+{
+    switch (toupper(static_cast<unsigned char>(c))) {
+    case '0': return 075557;
+    case '1': return 026227;
+    case '2': return 071747;
+    case '3': return 071317;
+    case '4': return 055711;
+    case '5': return 074717;
+    case '6': return 074757;
+    case '7': return 071111;
+    case '8': return 075757;
+    case '9': return 075717;
+    case 'A': return 025755;
+    case 'B': return 065656;
+    case 'C': return 034443;
+    case 'D': return 065556;
+    case 'E': return 074647;
+    case 'F': return 074644;
+    case 'G': return 034553;
+    case 'H': return 055755;
+    case 'I': return 072227;
+    case 'J': return 011152;
+    case 'K': return 055655;
+    case 'L': return 044447;
+    case 'M': return 057755;
+    case 'N': return 065555;
+    case 'O': return 025552;
+    case 'P': return 065644;
+    case 'Q': return 025563;
+    case 'R': return 065655;
+    case 'S': return 034216;
+    case 'T': return 072222;
+    case 'U': return 055557;
+    case 'V': return 055552;
+    case 'W': return 055775;
+    case 'X': return 055255;
+    case 'Y': return 055222;
+    case 'Z': return 071247;
+    case '.': return 000002;
+    case ':': return 002020;
+    case '/': return 011244;
+    case '-': return 000700;
+    case '%': return 051245;
+    default: return 0;
+    }
+}
+
+void StatsOverlay::warmShaders()
+{
+    ShaderCache& cache = ShaderCache::instance();
+    cache.compile(SingleShaderStage::Vertex, kVertexSource);
+    cache.compile(SingleShaderStage::Fragment, kFragmentSource);
+}
+
+StatsOverlay::StatsOverlay(const wgpu::Device& device, ObjectCache& objects, StagingRing& staging,
+                           wgpu::TextureFormat colorFormat, uint32_t width, uint32_t height, float targetFrameRate)
+    : mDevice(device), mStaging(staging), mWidth(width), mHeight(height),
+      mTargetInterval(1000.0f / std::max(targetFrameRate, 1.0f))
+{
+    const uint32_t margin = static_cast<uint32_t>(kMargin);
+    mRect.x = std::min(margin, mWidth);
+    mRect.y = std::min(margin, mHeight);
+    mRect.width = std::min(static_cast<uint32_t>(kPanelWidth), mWidth - mRect.x);
+    mRect.height = std::min(static_cast<uint32_t>(kPanelHeight), mHeight - mRect.y);
+
+    wgpu::ShaderModule vsModule = objects.shaderModule(SingleShaderStage::Vertex, kVertexSource);
+    wgpu::ShaderModule fsModule = objects.shaderModule(SingleShaderStage::Fragment, kFragmentSource);
+
+    if (!vsModule || !fsModule) {
+        Log(Log::Error) << "stats overlay shaders failed to compile";
+        return;
+    }
+
+    ComboRenderPipelineDescriptor descriptor(mDevice);
+    descriptor.layout = objects.pipelineLayout(nullptr);
+    descriptor.vertexStage.module = vsModule;
+    descriptor.cFragmentStage.module = fsModule;
+    descriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleStrip;
+    descriptor.cVertexState.vertexBufferCount = 1;
+    descriptor.cVertexState.cVertexBuffers[0].arrayStride = sizeof(Quad);
+    descriptor.cVertexState.cVertexBuffers[0].stepMode = wgpu::InputStepMode::Instance;
+    descriptor.cVertexState.cVertexBuffers[0].attributeCount = 2;
+    for (uint32_t i = 0; i < 2; ++i) {
+        descriptor.cVertexState.cAttributes[i].shaderLocation = i;
+        descriptor.cVertexState.cAttributes[i].offset = i * sizeof(glm::vec4);
+        descriptor.cVertexState.cAttributes[i].format = wgpu::VertexFormat::Float4;
+    }
+    descriptor.cColorStates[0].format = colorFormat;
+    descriptor.cColorStates[0].colorBlend.srcFactor = wgpu::BlendFactor::SrcAlpha;
+    descriptor.cColorStates[0].colorBlend.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+    mPipeline = objects.renderPipeline(descriptor);
+}
+
+void StatsOverlay::addFrame(Clock::time_point time)
+{
+    if (mLastFrame != Clock::time_point()) {
+        mFrameTimes[mFrameNext] = std::chrono::duration<float, std::milli>(time - mLastFrame).count();
+        mFrameNext = (mFrameNext + 1) % kStatsOverlayHistory;
+        mFrameCount = std::min(mFrameCount + 1, kStatsOverlayHistory);
+    }
+    mLastFrame = time;
+    ++mFramesSinceUpdate;
+}
+
+bool StatsOverlay::due(Clock::time_point now) const
+{
+    return mLastUpdate == Clock::time_point()
+        || std::chrono::duration<float>(now - mLastUpdate).count() >= kStatsOverlayRefreshInterval;
+}
+
+void StatsOverlay::addRect(float x, float y, float w, float h, const glm::vec4& color)
+{
+    const float left = mRect.x + x;
+    const float top = mRect.y + y;
+    mQuads.push_back({ { left / mWidth * 2.0f - 1.0f, 1.0f - top / mHeight * 2.0f,
+                         (left + w) / mWidth * 2.0f - 1.0f, 1.0f - (top + h) / mHeight * 2.0f }, color });
+}
+
+float StatsOverlay::addText(float x, float y, const char* text, const glm::vec4& color)
+{
+    const float start = x;
+    // cut off at the panel's edge, nothing may be drawn outside of rect()
+    for (const char* c = text; *c && x + 3.0f * kPixel <= kPanelWidth - kPadding; ++c, x += kCharAdvance) {
+        const uint16_t bits = glyph(*c);
+        for (uint32_t row = 0; row < 5; ++row) {
+            const uint32_t pixels = (bits >> (3 * (4 - row))) & 7;
+            // runs of lit pixels in a row are one rect
+            for (uint32_t column = 0; column < 3;) {
+                if (!(pixels & (4 >> column))) {
+                    ++column;
+                    continue;
+                }
+                uint32_t end = column + 1;
+                while (end < 3 && (pixels & (4 >> end)))
+                    ++end;
+                addRect(x + column * kPixel, y + row * kPixel, (end - column) * kPixel, kPixel, color);
+                column = end;
+            }
+        }
+    }
+    return x - start;
+}
+
+void StatsOverlay::update(Clock::time_point now, const GpuMemory::Stats& memory)
+{
+    const float elapsed = mLastUpdate == Clock::time_point() ? 0.0f
+        : std::chrono::duration<float>(now - mLastUpdate).count();
+    const float fps = elapsed > 0.0f ? mFramesSinceUpdate / elapsed : 0.0f;
+    mLastUpdate = now;
+    mFramesSinceUpdate = 0;
+
+    std::copy(std::begin(memory.bytes), std::end(memory.bytes), mMemory[mMemoryNext].begin());
+    mMemoryNext = (mMemoryNext + 1) % kStatsOverlayHistory;
+    mMemoryCount = std::min(mMemoryCount + 1, kStatsOverlayHistory);
+
+    mQuads.clear();
+    addRect(0.0f, 0.0f, kPanelWidth, kPanelHeight, kBackgroundColor);
+
+    char text[64];
+    float y = kPadding;
+
+    // frame intervals, newest on the right
+    float total = 0.0f;
+    float longest = 0.0f;
+    const uint32_t firstFrame = mFrameCount < kStatsOverlayHistory ? 0 : mFrameNext;
+    for (uint32_t i = 0; i < mFrameCount; ++i) {
+        const float interval = mFrameTimes[(firstFrame + i) % kStatsOverlayHistory];
+        total += interval;
+        longest = std::max(longest, interval);
+    }
+    snprintf(text, sizeof(text), "FPS %.1f  %.1f MS  MAX %.1f", fps, mFrameCount ? total / mFrameCount : 0.0f, longest);
+    addText(kPadding, y, text, kTextColor);
+    y += kLineHeight + kGap;
+
+    addRect(kPadding, y, kGraphWidth, kGraphHeight, kGraphColor);
+    // the graph tops out at two target intervals
+    const float scale = kGraphHeight / (mTargetInterval * 2.0f);
+    for (uint32_t i = 0; i < mFrameCount; ++i) {
+        const float interval = mFrameTimes[(firstFrame + i) % kStatsOverlayHistory];
+        const float h = std::min(interval * scale, kGraphHeight);
+        const glm::vec4& color = interval <= mTargetInterval * 1.05f ? kOnTimeColor
+            : interval <= mTargetInterval * 2.0f ? kSlowColor : kMissedColor;
+        addRect(kPadding + kGraphWidth - (mFrameCount - i) * kBarWidth, y + kGraphHeight - h, kBarWidth, h, color);
+    }
+    addRect(kPadding, y + kGraphHeight / 2.0f, kGraphWidth, 1.0f, kTargetColor);
+    y += kGraphHeight + kGap;
+
+    // memory, stacked by category in the order of the legend below
+    const double mb = 1024.0 * 1024.0;
+    snprintf(text, sizeof(text), "GPU %.1f MB  PEAK %.1f MB", memory.totalBytes() / mb, memory.peakBytes / mb);
+    addText(kPadding, y, text, kTextColor);
+    y += kLineHeight + kGap;
+
+    addRect(kPadding, y, kGraphWidth, kGraphHeight, kGraphColor);
+    const uint32_t firstSample = mMemoryCount < kStatsOverlayHistory ? 0 : mMemoryNext;
+    uint64_t highest = 1024 * 1024;
+    for (uint32_t i = 0; i < mMemoryCount; ++i) {
+        const auto& sample = mMemory[(firstSample + i) % kStatsOverlayHistory];
+        uint64_t sum = 0;
+        for (uint64_t bytes : sample)
+            sum += bytes;
+        highest = std::max(highest, sum);
+    }
+    for (uint32_t i = 0; i < mMemoryCount; ++i) {
+        const auto& sample = mMemory[(firstSample + i) % kStatsOverlayHistory];
+        const float x = kPadding + kGraphWidth - (mMemoryCount - i) * kBarWidth;
+        float bottom = y + kGraphHeight;
+        for (uint32_t category = 0; category < GpuMemory::kCategoryCount; ++category) {
+            if (!sample[category])
+                continue;
+            const float h = static_cast<float>(static_cast<double>(sample[category]) / highest * kGraphHeight);
+            addRect(x, bottom - h, kBarWidth, h, kCategoryColors[category]);
+            bottom -= h;
+        }
+    }
+    y += kGraphHeight + kGap;
+
+    for (uint32_t category = 0; category < GpuMemory::kCategoryCount; ++category) {
+        addRect(kPadding, y, kCharAdvance - kPixel, 5.0f * kPixel, kCategoryColors[category]);
+        snprintf(text, sizeof(text), "%-8s %7.1f MB %4llu", kCategoryLabels[category], memory.bytes[category] / mb,
+                 static_cast<unsigned long long>(memory.objects[category]));
+        addText(kPadding + kCharAdvance * 1.5f, y, text, kTextColor);
+        y += kLineHeight;
+    }
+
+    const uint32_t count = static_cast<uint32_t>(mQuads.size());
+    if (count > mCapacity) {
+        uint32_t capacity = std::max(mCapacity, kMinimumCapacity);
+        while (capacity < count)
+            capacity *= 2;
+
+        wgpu::BufferDescriptor descriptor;
+        descriptor.size = static_cast<uint64_t>(capacity) * sizeof(Quad);
+        descriptor.usage = wgpu::BufferUsage::Vertex | wgpu::BufferUsage::CopyDst;
+        mInstances = mDevice.CreateBuffer(&descriptor);
+        mCapacity = capacity;
+    }
+    mStaging.uploadBuffer(mQuads.data(), static_cast<uint64_t>(count) * sizeof(Quad), mInstances);
+    mCount = count;
+}
+
+void StatsOverlay::encode(const wgpu::RenderPassEncoder& pass) const
+{
+    if (!mCount || !mInstances)
+        return;
+    pass.SetPipeline(mPipeline);
+    pass.SetVertexBuffer(0, mInstances);
+    pass.Draw(4, mCount, 0, 0);
+}
@@ -0,0 +1,95 @@
+#ifndef STATSOVERLAY_H
+#define STATSOVERLAY_H
+
+#include "Constants.h"
+#include "DamageTracker.h"
+#include "GpuMemory.h"
+#include <dawn/webgpu_cpp.h>
+#include <glm/vec4.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+class ObjectCache;
+class StagingRing;
+
+// Heads-up display in the top left corner of the output: frames per second
+// over a graph of the recent frame intervals, and gpu memory by category
+// over a graph of its history. Everything is a flat colored rect, the text
+// included (a 3x5 pixel font), drawn with one instanced draw. The contents
+// are rebuilt at most every kStatsOverlayRefreshInterval, so an on-demand
+// loop only wakes up for it a few times a second and the graphs show every
+// frame in between.
+class StatsOverlay
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // width and height of the output, the frame interval graph is scaled to
+    // twice the target interval
+    StatsOverlay(const wgpu::Device& device, ObjectCache& objects, StagingRing& staging,
+                 wgpu::TextureFormat colorFormat, uint32_t width, uint32_t height, float targetFrameRate);
+
+    // compiles the shaders into the ShaderCache ahead of construction,
+    // callable from any thread
+    static void warmShaders();
+
+    bool isValid() const { return static_cast<bool>(mPipeline); }
+
+    // every frame recorded, at the time it started
+    void addFrame(Clock::time_point time);
+    bool due(Clock::time_point now) const;
+    // rebuilds the contents and queues them on the staging ring, the caller
+    // damages rect()
+    void update(Clock::time_point now, const GpuMemory::Stats& memory);
+
+    // the area drawn to, in pixels
+    DamageTracker::Rect rect() const { return mRect; }
+
+    // with the backbuffer's contents loaded, no depth attachment
+    void encode(const wgpu::RenderPassEncoder& pass) const;
+
+private:
+    struct Quad
+    {
+        // left, top, right, bottom in normalized device coordinates
+        glm::vec4 geometry;
+        glm::vec4 color;
+    };
+
+    // in pixels relative to the panel
+    void addRect(float x, float y, float w, float h, const glm::vec4& color);
+    // returns the width in pixels
+    float addText(float x, float y, const char* text, const glm::vec4& color);
+
+private:
+    wgpu::Device mDevice;
+    StagingRing& mStaging;
+    uint32_t mWidth, mHeight;
+    float mTargetInterval;
+    DamageTracker::Rect mRect;
+
+    wgpu::RenderPipeline mPipeline;
+    wgpu::Buffer mInstances;
+    uint32_t mCapacity { 0 };
+    uint32_t mCount { 0 };
+    // rebuilt on every update, the capacity stays around
+    std::vector<Quad> mQuads;
+
+    // frame intervals in milliseconds, oldest at mFrameNext once full
+    std::array<float, kStatsOverlayHistory> mFrameTimes {};
+    uint32_t mFrameNext { 0 };
+    uint32_t mFrameCount { 0 };
+    Clock::time_point mLastFrame;
+    uint64_t mFramesSinceUpdate { 0 };
+
+    // bytes per category at every update, oldest at mMemoryNext once full
+    std::array<std::array<uint64_t, GpuMemory::kCategoryCount>, kStatsOverlayHistory> mMemory {};
+    uint32_t mMemoryNext { 0 };
+    uint32_t mMemoryCount { 0 };
+
+    Clock::time_point mLastUpdate;
+};
+
+#endif // STATSOVERLAY_H
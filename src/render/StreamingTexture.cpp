@@ -0,0 +1,309 @@
+#include "StreamingTexture.h"
+#include "ObjectCache.h"
+#include "ShaderCache.h"
+#include "UniformArena.h"
+#include "Utils.h"
+#include <log/Log.h>
+#include <algorithm>
+#include <cassert>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static const char* kVertexSource = R"(
+    #version 450
+    layout(set = 0, binding = 0) uniform UniformBufferObject {
+        vec4 geometry;
+    } ubo;
+
+    layout(location = 0) out vec2 fragUV;
+
+    vec2 positions[4] = vec2[](
+        vec2(-1.0, +1.0),
+        vec2(+1.0, +1.0),
+        vec2(-1.0, -1.0),
+        vec2(+1.0, -1.0)
+    );
+
+    void main() {
+        vec2 position = positions[gl_VertexIndex];
+        int x = position.x == -1.0 ? 0 : 2;
+        int y = position.y == +1.0 ? 1 : 3;
+        gl_Position = vec4(ubo.geometry[x], ubo.geometry[y], 0.0, 1.0);
+        fragUV = vec2(position.x * 0.5 + 0.5, 0.5 - position.y * 0.5);
+    })";
+
+static const char* kFragmentSource = R"(
+    #version 450
+    layout(set = 0, binding = 1) uniform sampler mySampler;
+    layout(set = 0, binding = 2) uniform texture2D myTexture;
+
+    layout(location = 0) in vec2 fragUV;
+    layout(location = 0) out vec4 fragColor;
+    void main() {
+        fragColor = texture(sampler2D(myTexture, mySampler), fragUV);
+    })";
+
+static inline uint32_t alignUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void StreamingTexture::warmShaders()
+{
+    ShaderCache& cache = ShaderCache::instance();
+    cache.compile(SingleShaderStage::Vertex, kVertexSource);
+    cache.compile(SingleShaderStage::Fragment, kFragmentSource);
+}
+
+StreamingTexture::StreamingTexture(const wgpu::Device& device, ObjectCache& objects, const UniformArena& uniforms,
+                                   wgpu::TextureFormat colorFormat, wgpu::TextureFormat depthStencilFormat,
+                                   uint32_t width, uint32_t height, double frameDuration, FillFunction&& fill,
+                                   uint32_t slotCount)
+    : mWidth(width), mHeight(height), mRowPitch(alignUp(width * 4, kTextureRowPitchAlignment)),
+      mFrameDuration(frameDuration), mFill(std::move(fill))
+{
+    // one slot on screen, one on its way and one being filled
+    assert(slotCount >= 3);
+
+    wgpu::ShaderModule vsModule = objects.shaderModule(SingleShaderStage::Vertex, kVertexSource);
+    wgpu::ShaderModule fsModule = objects.shaderModule(SingleShaderStage::Fragment, kFragmentSource);
+
+    if (!vsModule || !fsModule) {
+        Log(Log::Error) << "streaming texture shaders failed to compile";
+        return;
+    }
+
+    wgpu::BindGroupLayout bgl = objects.bindGroupLayout({
+            {0, wgpu::ShaderStage::Vertex, wgpu::BindingType::UniformBuffer, true},
+            {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+            {2, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture}
+        });
+
+    wgpu::SamplerDescriptor samplerDescriptor = GetDefaultSamplerDescriptor();
+    samplerDescriptor.addressModeU = wgpu::AddressMode::ClampToEdge;
+    samplerDescriptor.addressModeV = wgpu::AddressMode::ClampToEdge;
+    wgpu::Sampler sampler = objects.sampler(samplerDescriptor);
+
+    wgpu::TextureDescriptor textureDescriptor;
+    textureDescriptor.dimension = wgpu::TextureDimension::e2D;
+    textureDescriptor.size.width = mWidth;
+    textureDescriptor.size.height = mHeight;
+    textureDescriptor.size.depth = 1;
+    textureDescriptor.arrayLayerCount = 1;
+    textureDescriptor.sampleCount = 1;
+    textureDescriptor.format = wgpu::TextureFormat::RGBA8Unorm;
+    textureDescriptor.mipLevelCount = 1;
+    textureDescriptor.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::Sampled;
+
+    wgpu::BufferDescriptor bufferDescriptor;
+    bufferDescriptor.size = static_cast<uint64_t>(mRowPitch) * mHeight;
+    bufferDescriptor.usage = wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc;
+
+    for (uint32_t i = 0; i < slotCount; ++i) {
+        auto slot = std::make_unique<Slot>();
+        slot->owner = this;
+        slot->texture = device.CreateTexture(&textureDescriptor);
+        slot->bindGroup = MakeBindGroup(device, bgl, {
+                {0, uniforms.buffer(), 0, uniforms.bindingSize()},
+                {1, sampler},
+                {2, slot->texture.CreateView()}
+            });
+        wgpu::CreateBufferMappedResult result = device.CreateBufferMapped(&bufferDescriptor);
+        slot->buffer = result.buffer;
+        slot->data = static_cast<uint8_t*>(result.data);
+        mSlots.push_back(std::move(slot));
+    }
+    mRetired.reserve(slotCount);
+
+    ComboRenderPipelineDescriptor descriptor(device);
+    descriptor.layout = objects.pipelineLayout(&bgl);
+    descriptor.vertexStage.module = vsModule;
+    descriptor.cFragmentStage.module = fsModule;
+    descriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleStrip;
+    descriptor.depthStencilState = &descriptor.cDepthStencilState;
+    descriptor.cDepthStencilState.format = depthStencilFormat;
+    descriptor.cColorStates[0].format = colorFormat;
+    descriptor.cColorStates[0].colorBlend.srcFactor = wgpu::BlendFactor::SrcAlpha;
+    descriptor.cColorStates[0].colorBlend.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+    mPipeline = objects.renderPipeline(descriptor);
+
+    mProducer = std::thread([this]() {
+        produce();
+    });
+}
+
+StreamingTexture::~StreamingTexture()
+{
+    {
+        std::lock_guard<std::mutex> locker(mMutex);
+        mStopped = true;
+    }
+    mCond.notify_one();
+    if (mProducer.joinable())
+        mProducer.join();
+    // outstanding map requests are cancelled when the buffers go away,
+    // onMapped() sees the stream stopped and ignores those
+    mSlots.clear();
+}
+
+void StreamingTexture::produce()
+{
+    uint64_t frame = 0;
+    for (;;) {
+        Slot* slot = nullptr;
+        {
+            std::unique_lock<std::mutex> locker(mMutex);
+            mCond.wait(locker, [this, &slot]() {
+                if (mStopped)
+                    return true;
+                for (auto& s : mSlots) {
+                    if (s->state == Slot::Free) {
+                        slot = s.get();
+                        return true;
+                    }
+                }
+                return false;
+            });
+            if (mStopped)
+                return;
+            slot->state = Slot::Filling;
+        }
+
+        // frames whose display interval is already over are never shown,
+        // don't spend a fill on them
+        const double time = mTime.load(std::memory_order_relaxed);
+        const uint64_t current = static_cast<uint64_t>(std::max(time, 0.0) / mFrameDuration);
+        if (current > frame) {
+            mDropped.fetch_add(current - frame, std::memory_order_relaxed);
+            frame = current;
+        }
+
+        const bool ok = mFill(frame, slot->data, mRowPitch);
+
+        std::lock_guard<std::mutex> locker(mMutex);
+        if (!ok) {
+            slot->state = Slot::Free;
+            return;
+        }
+        slot->frame = frame++;
+        slot->state = Slot::Ready;
+    }
+}
+
+bool StreamingTexture::advance(double time)
+{
+    mTime.store(time, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    // the newest frame that is due, anything older is overtaken by it
+    Slot* picked = nullptr;
+    for (auto& slot : mSlots) {
+        if (slot->state != Slot::Ready || slot->frame * mFrameDuration > time)
+            continue;
+        if (!picked || slot->frame > picked->frame)
+            picked = slot.get();
+    }
+    if (!picked)
+        return false;
+
+    bool dropped = false;
+    for (auto& slot : mSlots) {
+        if (slot->state == Slot::Ready && slot->frame < picked->frame) {
+            // still mapped, straight back to the producer
+            slot->state = Slot::Free;
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            dropped = true;
+        }
+    }
+    if (dropped)
+        mCond.notify_one();
+
+    if ((picked->frame + 1) * mFrameDuration <= time)
+        ++mLate;
+    ++mPresented;
+    picked->state = Slot::Current;
+    mPicked = picked;
+    return true;
+}
+
+void StreamingTexture::record(const wgpu::CommandEncoder& encoder, uint64_t retireValue)
+{
+    if (!mPicked)
+        return;
+
+    // the producer is done with it, the buffer is only touched here
+    mPicked->buffer.Unmap();
+    mPicked->data = nullptr;
+
+    wgpu::BufferCopyView source = CreateBufferCopyView(mPicked->buffer, 0, mRowPitch, 0);
+    wgpu::TextureCopyView destination = CreateTextureCopyView(mPicked->texture, 0, 0, {0, 0, 0});
+    wgpu::Extent3D extent = { mWidth, mHeight, 1 };
+    encoder.CopyBufferToTexture(&source, &destination, &extent);
+
+    std::lock_guard<std::mutex> locker(mMutex);
+    if (mCurrent) {
+        // sampled by frames up to and including this one
+        mCurrent->state = Slot::Released;
+        mCurrent->retireValue = retireValue;
+    }
+    mCurrent = mPicked;
+    mPicked = nullptr;
+}
+
+void StreamingTexture::retire(uint64_t completedValue)
+{
+    mRetired.clear();
+    {
+        std::lock_guard<std::mutex> locker(mMutex);
+        for (auto& slot : mSlots) {
+            if (slot->state != Slot::Released || slot->retireValue > completedValue)
+                continue;
+            slot->state = Slot::Mapping;
+            mRetired.push_back(slot.get());
+        }
+    }
+    for (Slot* slot : mRetired) {
+        slot->buffer.MapWriteAsync(onMapped, slot);
+    }
+}
+
+void StreamingTexture::onMapped(WGPUBufferMapAsyncStatus status, void* data, uint64_t dataLength, void* userdata)
+{
+    Slot* slot = static_cast<Slot*>(userdata);
+    StreamingTexture* owner = slot->owner;
+    if (status != WGPUBufferMapAsyncStatus_Success) {
+        // a slot that isn't mapped can't be filled again, rather than the
+        // ring running dry one slot at a time the stream ends here and the
+        // frames already filled still play
+        {
+            std::lock_guard<std::mutex> locker(owner->mMutex);
+            if (owner->mStopped)
+                return;
+            owner->mStopped = true;
+        }
+        owner->mCond.notify_one();
+        Log(Log::Error) << "streaming texture: unable to map frame" << slot->frame << "again, status"
+                        << static_cast<uint32_t>(status) << ", stopping";
+        return;
+    }
+
+    assert(dataLength >= static_cast<uint64_t>(owner->mRowPitch) * owner->mHeight);
+    (void)dataLength;
+    {
+        std::lock_guard<std::mutex> locker(owner->mMutex);
+        slot->data = static_cast<uint8_t*>(data);
+        slot->state = Slot::Free;
+    }
+    owner->mCond.notify_one();
+}
+
+void StreamingTexture::encode(const wgpu::RenderBundleEncoder& encoder, uint32_t geometryOffset) const
+{
+    assert(isValid());
+    if (!mCurrent)
+        return;
+    encoder.SetPipeline(mPipeline);
+    encoder.SetBindGroup(0, mCurrent->bindGroup, 1, &geometryOffset);
+    encoder.Draw(4, 1, 0, 0);
+}
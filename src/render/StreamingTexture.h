@@ -0,0 +1,118 @@
+#ifndef STREAMINGTEXTURE_H
+#define STREAMINGTEXTURE_H
+
+#include "Constants.h"
+#include <dawn/webgpu_cpp.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ObjectCache;
+class UniformArena;
+
+// Plays a sequence of equally sized RGBA8 frames through a ring of slots,
+// each a texture plus a map-write upload buffer. A producer thread fills
+// the mapped buffer of a free slot with the next frame while the gpu
+// samples the texture of the current one. The render thread presents the
+// newest filled frame whose timestamp has been reached, copying its buffer
+// into its texture as part of the frame. Slots are remapped and handed back
+// to the producer once the fence of the last frame sampling them has
+// passed, so nothing ever waits on the gpu.
+//
+// Frames that were filled but overtaken by a newer due frame, or skipped by
+// a producer that fell behind, count as dropped. Frames presented after
+// their display interval had already ended count as late.
+class StreamingTexture
+{
+public:
+    // called on the producer thread for every frame number in order, writes
+    // height rows of width * 4 bytes rowPitch apart. False ends the stream.
+    typedef std::function<bool(uint64_t frame, uint8_t* data, uint32_t rowPitch)> FillFunction;
+
+    StreamingTexture(const wgpu::Device& device, ObjectCache& objects, const UniformArena& uniforms,
+                     wgpu::TextureFormat colorFormat, wgpu::TextureFormat depthStencilFormat,
+                     uint32_t width, uint32_t height, double frameDuration, FillFunction&& fill,
+                     uint32_t slotCount = kStreamingTextureSlotCount);
+    ~StreamingTexture();
+
+    StreamingTexture(const StreamingTexture&) = delete;
+    StreamingTexture& operator=(const StreamingTexture&) = delete;
+
+    // compiles the shaders into the ShaderCache ahead of construction,
+    // callable from any thread
+    static void warmShaders();
+
+    bool isValid() const { return static_cast<bool>(mPipeline); }
+
+    uint32_t width() const { return mWidth; }
+    uint32_t height() const { return mHeight; }
+
+    // picks the frame to show at time, true when it differs from the one
+    // shown so far and record() has to be called for this frame
+    bool advance(double time);
+    // records the upload of the picked frame, the slot it replaces is
+    // released once the fence reaches retireValue
+    void record(const wgpu::CommandEncoder& encoder, uint64_t retireValue);
+    // hands released slots whose fence value has been reached back to the
+    // producer
+    void retire(uint64_t completedValue);
+
+    // draws the current frame, nothing before the first one arrived
+    void encode(const wgpu::RenderBundleEncoder& encoder, uint32_t geometryOffset) const;
+
+    uint64_t presentedCount() const { return mPresented; }
+    uint64_t droppedCount() const { return mDropped.load(std::memory_order_relaxed); }
+    uint64_t lateCount() const { return mLate; }
+
+private:
+    struct Slot
+    {
+        enum State { Free, Filling, Ready, Current, Released, Mapping };
+
+        StreamingTexture* owner { nullptr };
+        wgpu::Texture texture;
+        wgpu::BindGroup bindGroup;
+        wgpu::Buffer buffer;
+        uint8_t* data { nullptr };
+        uint64_t frame { 0 };
+        uint64_t retireValue { 0 };
+        State state { Free };
+    };
+
+    void produce();
+    static void onMapped(WGPUBufferMapAsyncStatus status, void* data, uint64_t dataLength, void* userdata);
+
+private:
+    uint32_t mWidth;
+    uint32_t mHeight;
+    uint32_t mRowPitch;
+    double mFrameDuration;
+    FillFunction mFill;
+    wgpu::RenderPipeline mPipeline;
+
+    // slot states are shared with the producer
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::vector<std::unique_ptr<Slot>> mSlots;
+    bool mStopped { false };
+    Slot* mCurrent { nullptr };
+    Slot* mPicked { nullptr };
+    // scratch for retire(), kept around so retiring doesn't allocate
+    std::vector<Slot*> mRetired;
+
+    // the render thread's clock as last seen, the producer skips frames
+    // that are already over
+    std::atomic<double> mTime { 0.0 };
+    std::atomic<uint64_t> mDropped { 0 };
+    uint64_t mPresented { 0 };
+    uint64_t mLate { 0 };
+
+    std::thread mProducer;
+};
+
+#endif // STREAMINGTEXTURE_H
@@ -0,0 +1,138 @@
+#include "TextureCache.h"
+#include <log/Log.h>
+#include <algorithm>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+TextureCache::TextureCache(uint64_t budget, uint32_t protectedFrames)
+    : mBudget(budget), mProtectedFrames(std::max(protectedFrames, 1u))
+{
+}
+
+void TextureCache::setReloadCallback(std::function<void(uint32_t id, const Source& source)>&& callback)
+{
+    mReloadCallback = std::move(callback);
+}
+
+void TextureCache::insert(uint32_t id, const wgpu::Texture& texture, uint64_t bytes, Source&& source)
+{
+    Entry& entry = mEntries[id];
+    if (entry.texture) {
+        // replaced in place
+        mResidentBytes -= entry.bytes;
+        mLru.erase(entry.lru);
+    } else if (entry.loading) {
+        ++mReloaded;
+    }
+
+    entry.texture = texture;
+    entry.bytes = bytes;
+    entry.source = std::move(source);
+    entry.loading = false;
+    entry.failed = false;
+    // counts as used now, or a texture bigger than what's free would be
+    // the first one to go again
+    entry.lastUsed = mFrame;
+    entry.lru = mLru.insert(mLru.end(), id);
+    mResidentBytes += bytes;
+
+    evict();
+}
+
+wgpu::Texture TextureCache::acquire(uint32_t id)
+{
+    auto it = mEntries.find(id);
+    if (it == mEntries.end())
+        return wgpu::Texture();
+
+    Entry& entry = it->second;
+    if (entry.texture) {
+        touch(id);
+        return entry.texture;
+    }
+    if (!entry.loading && !entry.failed) {
+        ++mMisses;
+        entry.loading = true;
+        if (mReloadCallback)
+            mReloadCallback(id, entry.source);
+    }
+    return wgpu::Texture();
+}
+
+void TextureCache::reloadFailed(uint32_t id)
+{
+    auto it = mEntries.find(id);
+    if (it == mEntries.end() || !it->second.loading)
+        return;
+    it->second.loading = false;
+    it->second.failed = true;
+    ++mFailed;
+}
+
+bool TextureCache::isResident(uint32_t id) const
+{
+    auto it = mEntries.find(id);
+    return it != mEntries.end() && it->second.texture;
+}
+
+bool TextureCache::isFailed(uint32_t id) const
+{
+    auto it = mEntries.find(id);
+    return it != mEntries.end() && it->second.failed;
+}
+
+void TextureCache::touch(uint32_t id)
+{
+    auto it = mEntries.find(id);
+    if (it == mEntries.end() || !it->second.texture)
+        return;
+    Entry& entry = it->second;
+    entry.lastUsed = mFrame;
+    mLru.splice(mLru.end(), mLru, entry.lru);
+}
+
+void TextureCache::endFrame()
+{
+    ++mFrame;
+    if (mResidentBytes > mBudget)
+        evict();
+}
+
+void TextureCache::evict()
+{
+    while (mResidentBytes > mBudget && !mLru.empty()) {
+        Entry& entry = mEntries[mLru.front()];
+        // everything after this one was used more recently still
+        if (entry.lastUsed + mProtectedFrames > mFrame)
+            break;
+
+        // bind groups and frames in flight that still reference the
+        // texture keep it alive until they're gone
+        mResidentBytes -= entry.bytes;
+        entry.texture = wgpu::Texture();
+        mLru.pop_front();
+        ++mEvicted;
+    }
+
+    const bool overBudget = mResidentBytes > mBudget;
+    if (overBudget && !mOverBudget) {
+        Log(Log::Warn) << "texture cache over budget," << mResidentBytes << "bytes of" << mBudget << "in use";
+    }
+    mOverBudget = overBudget;
+}
+
+void TextureCache::logStats() const
+{
+    Log(Log::Info) << "texture cache:" << residentCount() << "resident," << mResidentBytes << "of" << mBudget
+                   << "bytes," << mEvicted << "evicted," << mReloaded << "reloaded," << mMisses << "misses," << mFailed << "failed";
+}
+
+uint64_t TextureCache::textureSize(uint32_t width, uint32_t height, uint32_t mipLevelCount)
+{
+    uint64_t bytes = 0;
+    for (uint32_t level = 0; level < mipLevelCount; ++level) {
+        bytes += static_cast<uint64_t>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+    }
+    return bytes;
+}
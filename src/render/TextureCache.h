@@ -0,0 +1,101 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include "TexturePack.h"
+#include <dawn/webgpu_cpp.h>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Textures of loaded assets by asset id, kept within a byte budget. Usage
+// is reported per frame for the textures the executed bundles sample, and
+// when a new texture doesn't fit the least recently used ones are dropped.
+// Textures used by any of the last protectedFrames frames are never
+// evicted, so the budget may be exceeded while they're all in use. Evicted
+// textures remember where they came from and are loaded again through the
+// reload callback when acquired. A reload that fails marks its entry failed,
+// which isn't tried again.
+class TextureCache
+{
+public:
+    struct Source
+    {
+        std::string source;
+        // set for images out of a texture pack
+        std::shared_ptr<TexturePack> pack;
+        uint32_t packIndex { 0 };
+    };
+
+    TextureCache(uint64_t budget, uint32_t protectedFrames);
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    // called when an evicted texture is acquired, the result comes back
+    // through insert()
+    void setReloadCallback(std::function<void(uint32_t id, const Source& source)>&& callback);
+
+    // a newly loaded or reloaded texture, evicts until it fits the budget
+    void insert(uint32_t id, const wgpu::Texture& texture, uint64_t bytes, Source&& source);
+    // the texture when resident, otherwise starts a reload and returns null
+    wgpu::Texture acquire(uint32_t id);
+    // the reload of an evicted texture didn't come back
+    void reloadFailed(uint32_t id);
+    bool isResident(uint32_t id) const;
+    bool isFailed(uint32_t id) const;
+    // resident or evicted
+    bool contains(uint32_t id) const { return mEntries.count(id) != 0; }
+
+    // marks a texture as used by the frame being recorded
+    void touch(uint32_t id);
+    void endFrame();
+
+    uint64_t budget() const { return mBudget; }
+    uint64_t residentBytes() const { return mResidentBytes; }
+    uint32_t residentCount() const { return static_cast<uint32_t>(mLru.size()); }
+    uint64_t evictedCount() const { return mEvicted; }
+    uint64_t reloadedCount() const { return mReloaded; }
+    uint64_t missCount() const { return mMisses; }
+    uint64_t failedCount() const { return mFailed; }
+    void logStats() const;
+
+    // bytes of an rgba8 texture with the given mip chain
+    static uint64_t textureSize(uint32_t width, uint32_t height, uint32_t mipLevelCount);
+
+private:
+    void evict();
+
+private:
+    struct Entry
+    {
+        wgpu::Texture texture;
+        uint64_t bytes { 0 };
+        uint64_t lastUsed { 0 };
+        Source source;
+        bool loading { false };
+        bool failed { false };
+        // valid while resident
+        std::list<uint32_t>::iterator lru;
+    };
+
+    uint64_t mBudget;
+    uint32_t mProtectedFrames;
+    std::function<void(uint32_t, const Source&)> mReloadCallback;
+
+    std::unordered_map<uint32_t, Entry> mEntries;
+    // resident ids, least recently used first
+    std::list<uint32_t> mLru;
+    uint64_t mFrame { 0 };
+    uint64_t mResidentBytes { 0 };
+
+    uint64_t mEvicted { 0 };
+    uint64_t mReloaded { 0 };
+    uint64_t mMisses { 0 };
+    uint64_t mFailed { 0 };
+    bool mOverBudget { false };
+};
+
+#endif // TEXTURECACHE_H
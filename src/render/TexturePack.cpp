@@ -0,0 +1,182 @@
+#include "TexturePack.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::shared_ptr<TexturePack> TexturePack::open(const std::string& path)
+{
+    std::shared_ptr<MappedFile> file = MappedFile::open(path, MappedFile::Access::Random);
+    if (!file || file->size() < sizeof(TexturePackHeader))
+        return {};
+
+    const TexturePackHeader* header = reinterpret_cast<const TexturePackHeader*>(file->data());
+    if (header->magic != kTexturePackMagic || header->version != kTexturePackVersion)
+        return {};
+    if (file->size() - sizeof(TexturePackHeader) < static_cast<uint64_t>(header->imageCount) * sizeof(TexturePackEntry))
+        return {};
+
+    const TexturePackEntry* entries = reinterpret_cast<const TexturePackEntry*>(file->data() + sizeof(TexturePackHeader));
+    for (uint32_t i = 0; i < header->imageCount; ++i) {
+        const TexturePackEntry& entry = entries[i];
+        if (!entry.width || !entry.height || entry.width > kMaxTextureDimension || entry.height > kMaxTextureDimension
+            || !entry.mipLevelCount || entry.mipLevelCount > kTexturePackMaxLevels)
+            return {};
+        // names are used as C strings
+        if (!memchr(entry.name, 0, kTexturePackNameSize))
+            return {};
+        for (uint32_t level = 0; level < entry.mipLevelCount; ++level) {
+            // a level past the end of the file, written that way or
+            // wrapped around, would be read out of the mapping
+            const uint64_t offset = entry.levelOffsets[level];
+            const uint64_t size = static_cast<uint64_t>(entry.levelBytesPerRow[level]) * levelHeight(entry, level);
+            if (entry.levelBytesPerRow[level] % kTextureRowPitchAlignment != 0
+                || entry.levelBytesPerRow[level] < static_cast<uint64_t>(levelWidth(entry, level)) * 4
+                || offset > file->size() || size > file->size() - offset)
+                return {};
+        }
+    }
+
+    std::shared_ptr<TexturePack> pack(new TexturePack);
+    pack->mFile = std::move(file);
+    pack->mHeader = header;
+    pack->mEntries = entries;
+    return pack;
+}
+
+bool TexturePack::isPack(const std::string& path)
+{
+    static const std::string extension = ".dtpk";
+    return path.size() > extension.size()
+        && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+uint32_t TexturePack::find(const std::string& name) const
+{
+    for (uint32_t i = 0; i < count(); ++i) {
+        if (strncmp(mEntries[i].name, name.c_str(), kTexturePackNameSize) == 0)
+            return i;
+    }
+    return count();
+}
+
+const uint8_t* TexturePack::level(uint32_t index, uint32_t level) const
+{
+    return mFile->data() + mEntries[index].levelOffsets[level];
+}
+
+uint32_t TexturePack::levelWidth(const TexturePackEntry& entry, uint32_t level)
+{
+    return std::max(entry.width >> level, 1u);
+}
+
+uint32_t TexturePack::levelHeight(const TexturePackEntry& entry, uint32_t level)
+{
+    return std::max(entry.height >> level, 1u);
+}
+
+bool TexturePackWriter::add(const std::string& name, const uint8_t* pixels, uint32_t bytesPerRow,
+                            uint32_t width, uint32_t height, bool mipmaps)
+{
+    // open() refuses anything it couldn't create a texture for
+    if (!width || !height || width > kMaxTextureDimension || height > kMaxTextureDimension
+        || name.size() >= kTexturePackNameSize)
+        return false;
+
+    Image image;
+    image.name = name;
+
+    Level base;
+    base.width = width;
+    base.height = height;
+    base.bytesPerRow = static_cast<uint32_t>(alignUp(width * 4, kTextureRowPitchAlignment));
+    base.data.resize(static_cast<size_t>(base.bytesPerRow) * height);
+    for (uint32_t y = 0; y < height; ++y) {
+        memcpy(&base.data[static_cast<size_t>(y) * base.bytesPerRow],
+               pixels + static_cast<size_t>(y) * bytesPerRow, width * 4);
+    }
+    image.levels.push_back(std::move(base));
+
+    while (mipmaps && image.levels.size() < kTexturePackMaxLevels) {
+        const Level& source = image.levels.back();
+        if (source.width == 1 && source.height == 1)
+            break;
+
+        Level level;
+        level.width = std::max(source.width / 2, 1u);
+        level.height = std::max(source.height / 2, 1u);
+        level.bytesPerRow = static_cast<uint32_t>(alignUp(level.width * 4, kTextureRowPitchAlignment));
+        level.data.resize(static_cast<size_t>(level.bytesPerRow) * level.height);
+
+        // 2x2 box filter, clamped at the edges of odd sized levels
+        for (uint32_t y = 0; y < level.height; ++y) {
+            const uint32_t y0 = std::min(y * 2, source.height - 1);
+            const uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+            for (uint32_t x = 0; x < level.width; ++x) {
+                const uint32_t x0 = std::min(x * 2, source.width - 1);
+                const uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+                for (uint32_t c = 0; c < 4; ++c) {
+                    const uint32_t sum =
+                        source.data[static_cast<size_t>(y0) * source.bytesPerRow + x0 * 4 + c]
+                        + source.data[static_cast<size_t>(y0) * source.bytesPerRow + x1 * 4 + c]
+                        + source.data[static_cast<size_t>(y1) * source.bytesPerRow + x0 * 4 + c]
+                        + source.data[static_cast<size_t>(y1) * source.bytesPerRow + x1 * 4 + c];
+                    level.data[static_cast<size_t>(y) * level.bytesPerRow + x * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        image.levels.push_back(std::move(level));
+    }
+
+    mImages.push_back(std::move(image));
+    return true;
+}
+
+bool TexturePackWriter::write(const std::string& path) const
+{
+    TexturePackHeader header = {};
+    header.magic = kTexturePackMagic;
+    header.version = kTexturePackVersion;
+    header.imageCount = count();
+
+    std::vector<TexturePackEntry> entries(mImages.size());
+    uint64_t offset = alignUp(sizeof(TexturePackHeader) + entries.size() * sizeof(TexturePackEntry), kTextureRowPitchAlignment);
+    for (size_t i = 0; i < mImages.size(); ++i) {
+        const Image& image = mImages[i];
+        TexturePackEntry& entry = entries[i];
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.name, image.name.c_str(), kTexturePackNameSize - 1);
+        entry.width = image.levels[0].width;
+        entry.height = image.levels[0].height;
+        entry.mipLevelCount = static_cast<uint32_t>(image.levels.size());
+        for (size_t level = 0; level < image.levels.size(); ++level) {
+            entry.levelOffsets[level] = offset;
+            entry.levelBytesPerRow[level] = image.levels[level].bytesPerRow;
+            offset = alignUp(offset + image.levels[level].data.size(), kTextureRowPitchAlignment);
+        }
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (!entries.empty())
+        ok = ok && fwrite(entries.data(), sizeof(TexturePackEntry), entries.size(), f) == entries.size();
+
+    static const uint8_t zeros[kTextureRowPitchAlignment] = {};
+    for (size_t i = 0; ok && i < mImages.size(); ++i) {
+        for (size_t level = 0; ok && level < mImages[i].levels.size(); ++level) {
+            const long padding = static_cast<long>(entries[i].levelOffsets[level]) - ftell(f);
+            ok = padding >= 0 && fwrite(zeros, 1, padding, f) == static_cast<size_t>(padding);
+            const std::vector<uint8_t>& data = mImages[i].levels[level].data;
+            ok = ok && fwrite(data.data(), 1, data.size(), f) == data.size();
+        }
+    }
+
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,95 @@
+#ifndef TEXTUREPACK_H
+#define TEXTUREPACK_H
+
+#include "Constants.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// GPU ready container for many RGBA8 images. Every mip level is stored with
+// rows padded to kTextureRowPitchAlignment at an aligned offset, so loading
+// is a mapping plus one buffer to texture copy per level, without decoding.
+//
+// layout: TexturePackHeader, imageCount TexturePackEntry, level data
+static constexpr uint32_t kTexturePackMagic = 0x4b505444; // "DTPK"
+static constexpr uint32_t kTexturePackVersion = 1;
+static constexpr uint32_t kTexturePackMaxLevels = 16;
+static constexpr uint32_t kTexturePackNameSize = 64;
+
+struct TexturePackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t imageCount;
+    uint32_t reserved;
+};
+
+struct TexturePackEntry
+{
+    char name[kTexturePackNameSize];
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevelCount;
+    uint32_t reserved;
+    // offsets are from the start of the file
+    uint64_t levelOffsets[kTexturePackMaxLevels];
+    uint32_t levelBytesPerRow[kTexturePackMaxLevels];
+};
+
+class TexturePack
+{
+public:
+    // maps and validates a pack, returns nullptr on failure
+    static std::shared_ptr<TexturePack> open(const std::string& path);
+    static bool isPack(const std::string& path);
+
+    uint32_t count() const { return mHeader->imageCount; }
+    const TexturePackEntry& entry(uint32_t index) const { return mEntries[index]; }
+    // returns count() if there's no image called name
+    uint32_t find(const std::string& name) const;
+
+    const uint8_t* level(uint32_t index, uint32_t level) const;
+    static uint32_t levelWidth(const TexturePackEntry& entry, uint32_t level);
+    static uint32_t levelHeight(const TexturePackEntry& entry, uint32_t level);
+
+    const std::shared_ptr<MappedFile>& file() const { return mFile; }
+
+private:
+    TexturePack() = default;
+
+    std::shared_ptr<MappedFile> mFile;
+    const TexturePackHeader* mHeader { nullptr };
+    const TexturePackEntry* mEntries { nullptr };
+};
+
+// Builds packs, used by the dtpack tool.
+class TexturePackWriter
+{
+public:
+    // copies the image, mip levels are box filtered on the cpu when mipmaps
+    // is set. False for a name that doesn't fit or a size open() refuses.
+    bool add(const std::string& name, const uint8_t* pixels, uint32_t bytesPerRow,
+             uint32_t width, uint32_t height, bool mipmaps);
+    bool write(const std::string& path) const;
+
+    uint32_t count() const { return static_cast<uint32_t>(mImages.size()); }
+
+private:
+    struct Level
+    {
+        uint32_t width, height, bytesPerRow;
+        std::vector<uint8_t> data;
+    };
+
+    struct Image
+    {
+        std::string name;
+        std::vector<Level> levels;
+    };
+
+    std::vector<Image> mImages;
+};
+
+#endif // TEXTUREPACK_H
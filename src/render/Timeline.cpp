@@ -0,0 +1,195 @@
+#include "Timeline.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TIMELINE_USE_SSE
+#endif
+
+static constexpr float kForever = std::numeric_limits<float>::infinity();
+// the start of a hold before the first key, finite so that interpolating
+// with its zero inverse duration gives 0 and not inf * 0
+static constexpr float kLongAgo = -std::numeric_limits<float>::max();
+// how far times may get from the epoch before it's moved, floats around
+// this many seconds still resolve a tenth of a millisecond
+static constexpr double kRebaseInterval = 1024.0;
+
+uint32_t Timeline::addTrack(const std::vector<Keyframe>& keys, double startTime, bool loop)
+{
+    assert(!keys.empty());
+    const uint32_t index = trackCount();
+
+    mTracks.push_back({ static_cast<uint32_t>(mKeys.size()), static_cast<uint32_t>(keys.size()), local(startTime),
+                        loop && keys.size() > 1 && keys.back().time > 0.0f });
+    mKeys.insert(mKeys.end(), keys.begin(), keys.end());
+
+    mSegmentStart.push_back(0.0f);
+    // anything seeks on the first evaluate()
+    mSegmentEnd.push_back(-kForever);
+    mInverseDuration.push_back(0.0f);
+    mEaseA.push_back(0.0f);
+    mEaseB.push_back(0.0f);
+    mEaseC.push_back(0.0f);
+    for (int c = 0; c < 4; ++c) {
+        mFrom[c].push_back(0.0f);
+        mDelta[c].push_back(0.0f);
+    }
+    return index;
+}
+
+void Timeline::clear()
+{
+    mTracks.clear();
+    mKeys.clear();
+    mEpoch = 0.0;
+    mSegmentStart.clear();
+    mSegmentEnd.clear();
+    mInverseDuration.clear();
+    mEaseA.clear();
+    mEaseB.clear();
+    mEaseC.clear();
+    for (int c = 0; c < 4; ++c) {
+        mFrom[c].clear();
+        mDelta[c].clear();
+    }
+}
+
+void Timeline::rebase(double time)
+{
+    const float shift = local(time);
+    mEpoch += shift;
+    // infinite ends and kLongAgo stay what they are
+    const uint32_t count = trackCount();
+    for (uint32_t i = 0; i < count; ++i) {
+        mTracks[i].base -= shift;
+        mSegmentStart[i] -= shift;
+        mSegmentEnd[i] -= shift;
+    }
+}
+
+void Timeline::hold(uint32_t index, const glm::vec4& value, float start, float end)
+{
+    mSegmentStart[index] = start;
+    mSegmentEnd[index] = end;
+    mInverseDuration[index] = 0.0f;
+    mEaseA[index] = mEaseB[index] = mEaseC[index] = 0.0f;
+    for (int c = 0; c < 4; ++c) {
+        mFrom[c][index] = value[c];
+        mDelta[c][index] = 0.0f;
+    }
+}
+
+void Timeline::seek(uint32_t index, float time)
+{
+    Track& track = mTracks[index];
+    const Keyframe* keys = &mKeys[track.firstKey];
+    const Keyframe& last = keys[track.keyCount - 1];
+
+    float local = time - track.base;
+    if (track.loop && (local < 0.0f || local >= last.time)) {
+        track.base += std::floor(local / last.time) * last.time;
+        local = time - track.base;
+    }
+
+    if (local < keys[0].time) {
+        hold(index, keys[0].value, kLongAgo, track.base + keys[0].time);
+        return;
+    }
+    if (local >= last.time) {
+        hold(index, last.value, track.base + last.time, kForever);
+        return;
+    }
+
+    const Keyframe* next = std::upper_bound(keys, keys + track.keyCount, local,
+                                            [](float t, const Keyframe& key) { return t < key.time; });
+    const Keyframe& from = *(next - 1);
+    const Keyframe& to = *next;
+
+    mSegmentStart[index] = track.base + from.time;
+    mSegmentEnd[index] = track.base + to.time;
+    mInverseDuration[index] = 1.0f / (to.time - from.time);
+    // e(f) = ((a * f + b) * f + c) * f
+    static const float kEasing[][3] = {
+        { 0.0f, 0.0f, 1.0f },   // Linear, f
+        { 0.0f, 1.0f, 0.0f },   // EaseIn, f^2
+        { 0.0f, -1.0f, 2.0f },  // EaseOut, f * (2 - f)
+        { -2.0f, 3.0f, 0.0f }   // EaseInOut, f^2 * (3 - 2f)
+    };
+    const float* easing = kEasing[static_cast<int>(from.easing)];
+    mEaseA[index] = easing[0];
+    mEaseB[index] = easing[1];
+    mEaseC[index] = easing[2];
+    for (int c = 0; c < 4; ++c) {
+        mFrom[c][index] = from.value[c];
+        mDelta[c][index] = to.value[c] - from.value[c];
+    }
+}
+
+bool Timeline::idle(double at) const
+{
+    const float time = local(at);
+    const uint32_t count = trackCount();
+    for (uint32_t i = 0; i < count; ++i) {
+        if (time >= mSegmentEnd[i] || time < mSegmentStart[i] || mInverseDuration[i] != 0.0f)
+            return false;
+    }
+    return true;
+}
+
+bool Timeline::evaluate(double at, void* destination, size_t stride)
+{
+    if (at - mEpoch >= kRebaseInterval)
+        rebase(at);
+    const float time = local(at);
+    const uint32_t count = trackCount();
+
+    // segment changes are rare, this pass is mostly compares
+    bool changed = false;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (time >= mSegmentEnd[i] || time < mSegmentStart[i]) {
+            seek(i, time);
+            changed = true;
+        } else if (mInverseDuration[i] != 0.0f) {
+            changed = true;
+        }
+    }
+    if (!changed)
+        return false;
+
+    uint8_t* out = static_cast<uint8_t*>(destination);
+    uint32_t i = 0;
+#ifdef TIMELINE_USE_SSE
+    const __m128 t = _mm_set1_ps(time);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 f = _mm_mul_ps(_mm_sub_ps(t, _mm_loadu_ps(&mSegmentStart[i])), _mm_loadu_ps(&mInverseDuration[i]));
+        f = _mm_min_ps(_mm_max_ps(f, zero), one);
+        __m128 e = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&mEaseA[i]), f), _mm_loadu_ps(&mEaseB[i]));
+        e = _mm_add_ps(_mm_mul_ps(e, f), _mm_loadu_ps(&mEaseC[i]));
+        e = _mm_mul_ps(e, f);
+
+        __m128 x = _mm_add_ps(_mm_loadu_ps(&mFrom[0][i]), _mm_mul_ps(_mm_loadu_ps(&mDelta[0][i]), e));
+        __m128 y = _mm_add_ps(_mm_loadu_ps(&mFrom[1][i]), _mm_mul_ps(_mm_loadu_ps(&mDelta[1][i]), e));
+        __m128 z = _mm_add_ps(_mm_loadu_ps(&mFrom[2][i]), _mm_mul_ps(_mm_loadu_ps(&mDelta[2][i]), e));
+        __m128 w = _mm_add_ps(_mm_loadu_ps(&mFrom[3][i]), _mm_mul_ps(_mm_loadu_ps(&mDelta[3][i]), e));
+        // four tracks of xyzw each
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(reinterpret_cast<float*>(out + (i + 0) * stride), x);
+        _mm_storeu_ps(reinterpret_cast<float*>(out + (i + 1) * stride), y);
+        _mm_storeu_ps(reinterpret_cast<float*>(out + (i + 2) * stride), z);
+        _mm_storeu_ps(reinterpret_cast<float*>(out + (i + 3) * stride), w);
+    }
+#endif
+    for (; i < count; ++i) {
+        const float f = std::min(std::max((time - mSegmentStart[i]) * mInverseDuration[i], 0.0f), 1.0f);
+        const float e = ((mEaseA[i] * f + mEaseB[i]) * f + mEaseC[i]) * f;
+        float value[4];
+        for (int c = 0; c < 4; ++c)
+            value[c] = mFrom[c][i] + mDelta[c][i] * e;
+        memcpy(out + i * stride, value, sizeof(value));
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <glm/vec4.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Keyframed glm::vec4 tracks evaluated in bulk. The segment every track is
+// currently in is kept in structure of arrays form, so a frame is a single
+// pass interpolating four tracks at a time with SSE and writing each value
+// straight into the destination (sprite instances, uniform arena slots, ...)
+// at a fixed stride. Keyframes are only looked at when a track crosses into
+// another segment. Times come in as doubles and are kept as floats relative
+// to an epoch that moves along with them, so a track animates as smoothly
+// after days as it does in the first second.
+class Timeline
+{
+public:
+    enum class Easing
+    {
+        Linear,
+        EaseIn,
+        EaseOut,
+        EaseInOut
+    };
+
+    struct Keyframe
+    {
+        // seconds from the start of the track
+        float time;
+        glm::vec4 value;
+        // applies to the segment starting at this keyframe
+        Easing easing;
+    };
+
+    // keys have to be sorted by time. A looping track repeats with a period
+    // of its last keyframe's time, a non looping one holds its first and last
+    // value outside of the keys.
+    uint32_t addTrack(const std::vector<Keyframe>& keys, double startTime = 0.0, bool loop = false);
+    uint32_t trackCount() const { return static_cast<uint32_t>(mSegmentStart.size()); }
+    void clear();
+
+    // time in seconds, track i is written to destination + i * stride.
+    // Returns false when every track was holding a value it already had.
+    bool evaluate(double time, void* destination, size_t stride);
+    // true when evaluating at time wouldn't change anything
+    bool idle(double time) const;
+
+private:
+    // time relative to mEpoch
+    float local(double time) const { return static_cast<float>(time - mEpoch); }
+    // moves mEpoch up to time, everything relative to it along with it
+    void rebase(double time);
+    void seek(uint32_t track, float time);
+    void hold(uint32_t track, const glm::vec4& value, float start, float end);
+
+private:
+    struct Track
+    {
+        uint32_t firstKey;
+        uint32_t keyCount;
+        float base;
+        bool loop;
+    };
+
+    std::vector<Track> mTracks;
+    std::vector<Keyframe> mKeys;
+    double mEpoch { 0.0 };
+
+    // current segment of every track
+    std::vector<float> mSegmentStart;
+    std::vector<float> mSegmentEnd;
+    std::vector<float> mInverseDuration;
+    // easing as a cubic, e(f) = ((a * f + b) * f + c) * f
+    std::vector<float> mEaseA, mEaseB, mEaseC;
+    std::vector<float> mFrom[4];
+    std::vector<float> mDelta[4];
+};
+
+#endif // TIMELINE_H
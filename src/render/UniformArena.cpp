@@ -0,0 +1,73 @@
+#include "UniformArena.h"
+#include "StagingRing.h"
+#include <log/Log.h>
+#include <algorithm>
+#include <cassert>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+UniformArena::UniformArena(const wgpu::Device& device, StagingRing& staging, uint32_t slotCount)
+    : mStaging(staging),
+      mShadow(static_cast<size_t>(slotCount) * kUniformSlotSize)
+{
+    wgpu::BufferDescriptor descriptor;
+    descriptor.size = mShadow.size();
+    descriptor.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+    mBuffer = device.CreateBuffer(&descriptor);
+
+    // handed out from the front
+    mFree.reserve(slotCount);
+    for (uint32_t slot = slotCount; slot > 0; --slot)
+        mFree.push_back((slot - 1) * kUniformSlotSize);
+}
+
+uint32_t UniformArena::allocate()
+{
+    if (mFree.empty()) {
+        Log(Log::Error) << "uniform arena full," << slotCount() << "slots";
+        return kInvalidOffset;
+    }
+    const uint32_t offset = mFree.back();
+    mFree.pop_back();
+    // a released slot's old contents are still in the buffer, the zeroes
+    // go up with the next update()
+    memset(edit(offset, kUniformSlotSize), 0, kUniformSlotSize);
+    return offset;
+}
+
+void UniformArena::release(uint32_t offset)
+{
+    assert(offset % kUniformSlotSize == 0 && offset < mShadow.size());
+    mFree.push_back(offset);
+}
+
+void* UniformArena::edit(uint32_t offset, uint32_t size)
+{
+    assert(offset % kUniformSlotSize == 0 && size <= kUniformSlotSize && offset + size <= mShadow.size());
+    if (mDirtyFirst == mDirtyLast) {
+        mDirtyFirst = offset;
+        mDirtyLast = offset + size;
+    } else {
+        mDirtyFirst = std::min(mDirtyFirst, offset);
+        mDirtyLast = std::max(mDirtyLast, offset + size);
+    }
+    return &mShadow[offset];
+}
+
+void UniformArena::write(uint32_t offset, const void* data, uint32_t size)
+{
+    memcpy(edit(offset, size), data, size);
+}
+
+void UniformArena::update()
+{
+    if (mDirtyFirst == mDirtyLast)
+        return;
+
+    // copy sizes have to be a multiple of 4, slots are 256 byte aligned so
+    // rounding up stays inside the buffer
+    const uint32_t last = (mDirtyLast + 3u) & ~3u;
+    mStaging.uploadBuffer(&mShadow[mDirtyFirst], last - mDirtyFirst, mBuffer, mDirtyFirst);
+    mDirtyFirst = mDirtyLast = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef UNIFORMARENA_H
+#define UNIFORMARENA_H
+
+#include "Constants.h"
+#include <dawn/webgpu_cpp.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class StagingRing;
+
+// One uniform buffer shared by any number of objects. Every object gets a
+// slot of kUniformSlotSize bytes at a dynamic offset aligned offset, writes
+// land in a cpu side copy and the changed range is uploaded with a single
+// copy per frame. Objects bind the buffer through one bind group with a
+// dynamic offset instead of owning a buffer and bind group each.
+class UniformArena
+{
+public:
+    static constexpr uint32_t kInvalidOffset = 0xffffffffu;
+
+    UniformArena(const wgpu::Device& device, StagingRing& staging, uint32_t slotCount = kUniformArenaSlotCount);
+
+    UniformArena(const UniformArena&) = delete;
+    UniformArena& operator=(const UniformArena&) = delete;
+
+    // returns the dynamic offset of a new zeroed slot, kInvalidOffset when full
+    uint32_t allocate();
+    void release(uint32_t offset);
+
+    // direct access to a slot, marks the first size bytes of it as changed
+    void* edit(uint32_t offset, uint32_t size);
+    void write(uint32_t offset, const void* data, uint32_t size);
+    template<typename T>
+    void write(uint32_t offset, const T& value)
+    {
+        static_assert(sizeof(T) <= kUniformSlotSize, "uniform data doesn't fit in a slot");
+        write(offset, &value, sizeof(T));
+    }
+
+    // queues the changed part of the arena on the staging ring
+    void update();
+
+    // bind with size bindingSize() and the slot's offset as dynamic offset
+    wgpu::Buffer buffer() const { return mBuffer; }
+    uint32_t bindingSize() const { return kUniformSlotSize; }
+
+    uint32_t slotCount() const { return static_cast<uint32_t>(mShadow.size() / kUniformSlotSize); }
+    uint32_t slotsInUse() const { return slotCount() - static_cast<uint32_t>(mFree.size()); }
+
+private:
+    StagingRing& mStaging;
+    wgpu::Buffer mBuffer;
+    std::vector<uint8_t> mShadow;
+    std::vector<uint32_t> mFree;
+    uint32_t mDirtyFirst { 0 }, mDirtyLast { 0 };
+};
+
+#endif // UNIFORMARENA_H
@@ -1,5 +1,8 @@
 #include "Utils.h"
+#include "ShaderCache.h"
 #include <log/Log.h>
+#include <algorithm>
+#include <cassert>
 
 using namespace reckoning;
 using namespace reckoning::log;
@@ -91,16 +94,15 @@ wgpu::ShaderModule CreateShaderModuleFromResult(
 wgpu::ShaderModule CreateShaderModule(const wgpu::Device& device,
                                       SingleShaderStage stage,
                                       const std::string& source) {
-    shaderc_shader_kind kind = ShadercShaderKind(stage);
-
-    shaderc::Compiler compiler;
-    auto result = compiler.CompileGlslToSpv(source.c_str(), source.size(), kind, "myshader?");
-    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
-        Log(Log::Error) << result.GetErrorMessage();
+    const std::vector<uint32_t> spirv = ShaderCache::instance().compile(stage, source);
+    if (spirv.empty()) {
         return {};
     }
 
-    return CreateShaderModuleFromResult(device, result);
+    wgpu::ShaderModuleDescriptor descriptor;
+    descriptor.codeSize = static_cast<uint32_t>(spirv.size());
+    descriptor.code = spirv.data();
+    return device.CreateShaderModule(&descriptor);
 }
 
 wgpu::BindGroupLayout MakeBindGroupLayout(
@@ -121,6 +123,26 @@ wgpu::BindGroupLayout MakeBindGroupLayout(
     return device.CreateBindGroupLayout(&descriptor);
 }
 
+wgpu::BindGroupLayout MakeBindGroupLayout(
+    const wgpu::Device& device,
+    std::initializer_list<wgpu::BindGroupLayoutBinding> bindingsInitializer,
+    FrameArena& arena) {
+    constexpr wgpu::ShaderStage kNoStages{};
+
+    wgpu::BindGroupLayoutBinding* bindings = arena.allocate<wgpu::BindGroupLayoutBinding>(bindingsInitializer.size());
+    uint32_t count = 0;
+    for (const wgpu::BindGroupLayoutBinding& binding : bindingsInitializer) {
+        if (binding.visibility != kNoStages) {
+            bindings[count++] = binding;
+        }
+    }
+
+    wgpu::BindGroupLayoutDescriptor descriptor;
+    descriptor.bindingCount = count;
+    descriptor.bindings = bindings;
+    return device.CreateBindGroupLayout(&descriptor);
+}
+
 wgpu::TextureView CreateDefaultDepthStencilView(const wgpu::Device& device, uint32_t width, uint32_t height) {
     wgpu::TextureDescriptor descriptor;
     descriptor.dimension = wgpu::TextureDimension::e2D;
@@ -196,6 +218,76 @@ wgpu::BindGroup MakeBindGroup(
     return device.CreateBindGroup(&descriptor);
 }
 
+wgpu::BindGroup MakeBindGroup(
+    const wgpu::Device& device,
+    const wgpu::BindGroupLayout& layout,
+    std::initializer_list<BindingInitializationHelper> bindingsInitializer,
+    FrameArena& arena) {
+    // the C structs borrow the handles instead of referencing them, the
+    // helpers keep the objects alive for the duration of the call
+    WGPUBindGroupBinding* bindings = arena.allocate<WGPUBindGroupBinding>(bindingsInitializer.size());
+    uint32_t count = 0;
+    for (const BindingInitializationHelper& helper : bindingsInitializer) {
+        WGPUBindGroupBinding& binding = bindings[count++];
+        binding.binding = helper.binding;
+        binding.sampler = helper.sampler.Get();
+        binding.textureView = helper.textureView.Get();
+        binding.buffer = helper.buffer.Get();
+        binding.offset = helper.offset;
+        binding.size = helper.size;
+    }
+
+    WGPUBindGroupDescriptor descriptor = {};
+    descriptor.layout = layout.Get();
+    descriptor.bindingCount = count;
+    descriptor.bindings = bindings;
+    return wgpu::BindGroup::Acquire(wgpuDeviceCreateBindGroup(device.Get(), &descriptor));
+}
+
+bool SelectAdapter(dawn_native::Instance& instance, wgpu::BackendType backendType, bool preferCpu,
+                   dawn_native::Adapter* adapter) {
+    std::vector<dawn_native::Adapter> adapters = instance.GetAdapters();
+    auto matches = [backendType](const dawn_native::Adapter candidate, bool cpuOnly) -> bool {
+        wgpu::AdapterProperties properties;
+        candidate.GetProperties(&properties);
+        if (properties.backendType != backendType)
+            return false;
+        return !cpuOnly || properties.adapterType == wgpu::AdapterType::CPU;
+    };
+    auto adapterIt = adapters.end();
+    if (preferCpu) {
+        adapterIt = std::find_if(adapters.begin(), adapters.end(),
+                                 [&matches](const dawn_native::Adapter candidate) -> bool {
+                                     return matches(candidate, true);
+                                 });
+    }
+    if (adapterIt == adapters.end()) {
+        adapterIt = std::find_if(adapters.begin(), adapters.end(),
+                                 [&matches](const dawn_native::Adapter candidate) -> bool {
+                                     return matches(candidate, false);
+                                 });
+    }
+    if (adapterIt == adapters.end()) {
+        Log(Log::Error) << "no adapter found for backend" << static_cast<int>(backendType);
+        return false;
+    }
+    *adapter = *adapterIt;
+
+    wgpu::AdapterProperties properties;
+    adapter->GetProperties(&properties);
+    Log(Log::Info) << "using adapter" << properties.name;
+    return true;
+}
+
+uint64_t Fnv1aHash(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 ComboVertexStateDescriptor::ComboVertexStateDescriptor() {
     wgpu::VertexStateDescriptor* descriptor = this;
 
@@ -295,7 +387,9 @@ ComboRenderPipelineDescriptor::ComboRenderPipelineDescriptor(const wgpu::Device&
 ComboRenderPassDescriptor::ComboRenderPassDescriptor(
     std::initializer_list<wgpu::TextureView> colorAttachmentInfo,
     wgpu::TextureView depthStencil) {
-    for (uint32_t i = 0; i < kMaxColorAttachments; ++i) {
+    // only the attachments in use are set up, the rest is never read
+    assert(colorAttachmentInfo.size() <= kMaxColorAttachments);
+    for (uint32_t i = 0; i < colorAttachmentInfo.size(); ++i) {
         cColorAttachments[i].loadOp = wgpu::LoadOp::Clear;
         cColorAttachments[i].storeOp = wgpu::StoreOp::Store;
         cColorAttachments[i].clearColor = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -2,7 +2,9 @@
 #define UTILS_H
 
 #include "Constants.h"
+#include "FrameArena.h"
 #include <dawn/webgpu_cpp.h>
+#include <dawn_native/DawnNative.h>
 #include <shaderc/shaderc.hpp>
 #include <array>
 #include <cstdint>
@@ -107,6 +109,10 @@ wgpu::ShaderModule CreateShaderModule(const wgpu::Device& device,
 
 wgpu::BindGroupLayout MakeBindGroupLayout(const wgpu::Device& device,
                                           std::initializer_list<wgpu::BindGroupLayoutBinding> bindingsInitializer);
+// same, with the binding array in arena instead of on the heap
+wgpu::BindGroupLayout MakeBindGroupLayout(const wgpu::Device& device,
+                                          std::initializer_list<wgpu::BindGroupLayoutBinding> bindingsInitializer,
+                                          FrameArena& arena);
 
 wgpu::TextureView CreateDefaultDepthStencilView(const wgpu::Device& device, uint32_t width, uint32_t height);
 
@@ -116,6 +122,20 @@ wgpu::PipelineLayout MakeBasicPipelineLayout(const wgpu::Device& device,
 wgpu::BindGroup MakeBindGroup(const wgpu::Device& device,
                               const wgpu::BindGroupLayout& layout,
                               std::initializer_list<BindingInitializationHelper> bindingsInitializer);
+// same, with the binding array in arena instead of on the heap
+wgpu::BindGroup MakeBindGroup(const wgpu::Device& device,
+                              const wgpu::BindGroupLayout& layout,
+                              std::initializer_list<BindingInitializationHelper> bindingsInitializer,
+                              FrameArena& arena);
+
+// picks an adapter of the given backend, a CPU one first when preferCpu is set
+bool SelectAdapter(dawn_native::Instance& instance, wgpu::BackendType backendType, bool preferCpu,
+                   dawn_native::Adapter* adapter);
+
+static constexpr uint64_t kFnv1aOffsetBasis = 0xcbf29ce484222325ull;
+
+// 64 bit FNV-1a, chain calls by passing the previous result as hash
+uint64_t Fnv1aHash(const void* data, size_t size, uint64_t hash = kFnv1aOffsetBasis);
 
 
 #endif // UTILS_H
@@ -0,0 +1,209 @@
+#include "VideoTexture.h"
+#include "ObjectCache.h"
+#include "ShaderCache.h"
+#include "StagingRing.h"
+#include "UniformArena.h"
+#include "Utils.h"
+#include <log/Log.h>
+#include <cassert>
+
+using namespace reckoning;
+using namespace reckoning::log;
+
+static const char* kVertexSource = R"(
+    #version 450
+    layout(set = 0, binding = 0) uniform UniformBufferObject {
+        vec4 geometry;
+    } ubo;
+
+    layout(location = 0) out vec2 fragUV;
+
+    vec2 positions[4] = vec2[](
+        vec2(-1.0, +1.0),
+        vec2(+1.0, +1.0),
+        vec2(-1.0, -1.0),
+        vec2(+1.0, -1.0)
+    );
+
+    void main() {
+        vec2 position = positions[gl_VertexIndex];
+        int x = position.x == -1.0 ? 0 : 2;
+        int y = position.y == +1.0 ? 1 : 3;
+        gl_Position = vec4(ubo.geometry[x], ubo.geometry[y], 0.0, 1.0);
+        fragUV = vec2(position.x * 0.5 + 0.5, 0.5 - position.y * 0.5);
+    })";
+
+// BT.709 limited range, y in [16, 235] and uv in [16, 240]
+static const char* kNV12FragmentSource = R"(
+    #version 450
+    layout(set = 0, binding = 1) uniform sampler mySampler;
+    layout(set = 0, binding = 2) uniform texture2D lumaTexture;
+    layout(set = 0, binding = 3) uniform texture2D chromaTexture;
+
+    layout(location = 0) in vec2 fragUV;
+    layout(location = 0) out vec4 fragColor;
+    void main() {
+        float y = (texture(sampler2D(lumaTexture, mySampler), fragUV).r - 16.0 / 255.0) * 1.164384;
+        vec2 uv = texture(sampler2D(chromaTexture, mySampler), fragUV).rg - vec2(128.0 / 255.0);
+        fragColor = vec4(clamp(vec3(y + 1.792741 * uv.y,
+                                    y - 0.213249 * uv.x - 0.532909 * uv.y,
+                                    y + 2.112402 * uv.x), 0.0, 1.0), 1.0);
+    })";
+
+static const char* kI420FragmentSource = R"(
+    #version 450
+    layout(set = 0, binding = 1) uniform sampler mySampler;
+    layout(set = 0, binding = 2) uniform texture2D lumaTexture;
+    layout(set = 0, binding = 3) uniform texture2D uTexture;
+    layout(set = 0, binding = 4) uniform texture2D vTexture;
+
+    layout(location = 0) in vec2 fragUV;
+    layout(location = 0) out vec4 fragColor;
+    void main() {
+        float y = (texture(sampler2D(lumaTexture, mySampler), fragUV).r - 16.0 / 255.0) * 1.164384;
+        vec2 uv = vec2(texture(sampler2D(uTexture, mySampler), fragUV).r,
+                       texture(sampler2D(vTexture, mySampler), fragUV).r) - vec2(128.0 / 255.0);
+        fragColor = vec4(clamp(vec3(y + 1.792741 * uv.y,
+                                    y - 0.213249 * uv.x - 0.532909 * uv.y,
+                                    y + 2.112402 * uv.x), 0.0, 1.0), 1.0);
+    })";
+
+static const char* fragmentSource(VideoTexture::Format format)
+{
+    return format == VideoTexture::Format::NV12 ? kNV12FragmentSource : kI420FragmentSource;
+}
+
+void VideoTexture::warmShaders(Format format)
+{
+    ShaderCache& cache = ShaderCache::instance();
+    cache.compile(SingleShaderStage::Vertex, kVertexSource);
+    cache.compile(SingleShaderStage::Fragment, fragmentSource(format));
+}
+
+uint64_t VideoTexture::frameSize(Format format, uint32_t width, uint32_t height)
+{
+    const uint64_t luma = static_cast<uint64_t>(width) * height;
+    const uint64_t chroma = static_cast<uint64_t>((width + 1) / 2) * ((height + 1) / 2);
+    // nv12 interleaves u and v in one plane, i420 has one plane for each
+    return luma + chroma * 2;
+}
+
+bool VideoTexture::parseFormat(const std::string& name, Format* format)
+{
+    if (name == "nv12") {
+        *format = Format::NV12;
+        return true;
+    }
+    if (name == "i420") {
+        *format = Format::I420;
+        return true;
+    }
+    return false;
+}
+
+VideoTexture::VideoTexture(const wgpu::Device& device, ObjectCache& objects, StagingRing& staging, const UniformArena& uniforms,
+                           wgpu::TextureFormat colorFormat, wgpu::TextureFormat depthStencilFormat,
+                           Format format, uint32_t width, uint32_t height)
+    : mStaging(staging), mFormat(format), mWidth(width), mHeight(height)
+{
+    const uint32_t chromaWidth = (width + 1) / 2;
+    const uint32_t chromaHeight = (height + 1) / 2;
+
+    auto addPlane = [this, &device](wgpu::TextureFormat textureFormat, uint32_t w, uint32_t h, uint32_t bytesPerPixel) {
+        wgpu::TextureDescriptor descriptor;
+        descriptor.dimension = wgpu::TextureDimension::e2D;
+        descriptor.size.width = w;
+        descriptor.size.height = h;
+        descriptor.size.depth = 1;
+        descriptor.arrayLayerCount = 1;
+        descriptor.sampleCount = 1;
+        descriptor.format = textureFormat;
+        descriptor.mipLevelCount = 1;
+        descriptor.usage = wgpu::TextureUsage::CopyDst | wgpu::TextureUsage::Sampled;
+        mPlanes.push_back({ device.CreateTexture(&descriptor), w, h, w * bytesPerPixel });
+    };
+    addPlane(wgpu::TextureFormat::R8Unorm, width, height, 1);
+    if (mFormat == Format::NV12) {
+        addPlane(wgpu::TextureFormat::RG8Unorm, chromaWidth, chromaHeight, 2);
+    } else {
+        addPlane(wgpu::TextureFormat::R8Unorm, chromaWidth, chromaHeight, 1);
+        addPlane(wgpu::TextureFormat::R8Unorm, chromaWidth, chromaHeight, 1);
+    }
+
+    wgpu::ShaderModule vsModule = objects.shaderModule(SingleShaderStage::Vertex, kVertexSource);
+    wgpu::ShaderModule fsModule = objects.shaderModule(SingleShaderStage::Fragment, fragmentSource(mFormat));
+
+    if (!vsModule || !fsModule) {
+        Log(Log::Error) << "video shaders failed to compile";
+        return;
+    }
+
+    wgpu::BindGroupLayout bgl;
+    if (mFormat == Format::NV12) {
+        bgl = objects.bindGroupLayout({
+                {0, wgpu::ShaderStage::Vertex, wgpu::BindingType::UniformBuffer, true},
+                {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+                {2, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture},
+                {3, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture}
+            });
+    } else {
+        bgl = objects.bindGroupLayout({
+                {0, wgpu::ShaderStage::Vertex, wgpu::BindingType::UniformBuffer, true},
+                {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+                {2, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture},
+                {3, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture},
+                {4, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture}
+            });
+    }
+
+    ComboRenderPipelineDescriptor descriptor(device);
+    descriptor.layout = objects.pipelineLayout(&bgl);
+    descriptor.vertexStage.module = vsModule;
+    descriptor.cFragmentStage.module = fsModule;
+    descriptor.primitiveTopology = wgpu::PrimitiveTopology::TriangleStrip;
+    descriptor.depthStencilState = &descriptor.cDepthStencilState;
+    descriptor.cDepthStencilState.format = depthStencilFormat;
+    descriptor.cColorStates[0].format = colorFormat;
+    mPipeline = objects.renderPipeline(descriptor);
+
+    // the chroma planes are half the size of the luma plane, linear
+    // filtering upsamples them
+    wgpu::SamplerDescriptor samplerDescriptor = GetDefaultSamplerDescriptor();
+    samplerDescriptor.addressModeU = wgpu::AddressMode::ClampToEdge;
+    samplerDescriptor.addressModeV = wgpu::AddressMode::ClampToEdge;
+    wgpu::Sampler sampler = objects.sampler(samplerDescriptor);
+    if (mFormat == Format::NV12) {
+        mBindGroup = MakeBindGroup(device, bgl, {
+                {0, uniforms.buffer(), 0, uniforms.bindingSize()},
+                {1, sampler},
+                {2, mPlanes[0].texture.CreateView()},
+                {3, mPlanes[1].texture.CreateView()}
+            });
+    } else {
+        mBindGroup = MakeBindGroup(device, bgl, {
+                {0, uniforms.buffer(), 0, uniforms.bindingSize()},
+                {1, sampler},
+                {2, mPlanes[0].texture.CreateView()},
+                {3, mPlanes[1].texture.CreateView()},
+                {4, mPlanes[2].texture.CreateView()}
+            });
+    }
+}
+
+void VideoTexture::upload(const uint8_t* frame)
+{
+    // copies into the planes are ordered after the draws of frames already
+    // submitted, nothing has to wait for them
+    for (const Plane& plane : mPlanes) {
+        mStaging.uploadTexture(frame, plane.bytesPerRow, plane.width, plane.height, plane.texture);
+        frame += static_cast<uint64_t>(plane.bytesPerRow) * plane.height;
+    }
+}
+
+void VideoTexture::encode(const wgpu::RenderBundleEncoder& encoder, uint32_t geometryOffset) const
+{
+    assert(isValid());
+    encoder.SetPipeline(mPipeline);
+    encoder.SetBindGroup(0, mBindGroup, 1, &geometryOffset);
+    encoder.Draw(4, 1, 0, 0);
+}
@@ -0,0 +1,65 @@
+#ifndef VIDEOTEXTURE_H
+#define VIDEOTEXTURE_H
+
+#include <dawn/webgpu_cpp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ObjectCache;
+class StagingRing;
+class UniformArena;
+
+// Video frame kept as its YUV planes, one R8 texture per plane for I420 and
+// a luma plus an interleaved RG8 chroma texture for NV12. Frames are uploaded
+// as decoded and the fragment shader samples the planes and converts to rgb
+// (BT.709, limited range), so no colorspace work is done on the cpu. The
+// quad's geometry comes out of the uniform arena like the image quad's.
+class VideoTexture
+{
+public:
+    enum class Format { NV12, I420 };
+
+    VideoTexture(const wgpu::Device& device, ObjectCache& objects, StagingRing& staging, const UniformArena& uniforms,
+                 wgpu::TextureFormat colorFormat, wgpu::TextureFormat depthStencilFormat,
+                 Format format, uint32_t width, uint32_t height);
+
+    // compiles the shaders into the ShaderCache ahead of construction,
+    // callable from any thread
+    static void warmShaders(Format format);
+
+    bool isValid() const { return static_cast<bool>(mPipeline); }
+
+    Format format() const { return mFormat; }
+    uint32_t width() const { return mWidth; }
+    uint32_t height() const { return mHeight; }
+
+    // queues the planes of a frame laid out the way raw yuv files and most
+    // decoders hand them out: the planes back to back, tightly packed
+    void upload(const uint8_t* frame);
+
+    void encode(const wgpu::RenderBundleEncoder& encoder, uint32_t geometryOffset) const;
+
+    // bytes of one tightly packed frame
+    static uint64_t frameSize(Format format, uint32_t width, uint32_t height);
+    static bool parseFormat(const std::string& name, Format* format);
+
+private:
+    struct Plane
+    {
+        wgpu::Texture texture;
+        uint32_t width;
+        uint32_t height;
+        uint32_t bytesPerRow;
+    };
+
+    StagingRing& mStaging;
+    Format mFormat;
+    uint32_t mWidth;
+    uint32_t mHeight;
+    std::vector<Plane> mPlanes;
+    wgpu::RenderPipeline mPipeline;
+    wgpu::BindGroup mBindGroup;
+};
+
+#endif // VIDEOTEXTURE_H
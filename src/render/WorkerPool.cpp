@@ -0,0 +1,70 @@
+#include "WorkerPool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+using namespace reckoning;
+using namespace std::chrono_literals;
+
+uint32_t WorkerPool::defaultThreadCount()
+{
+    // leave a core for the render thread
+    const uint32_t cores = std::thread::hardware_concurrency();
+    return std::max(cores, 2u) - 1;
+}
+
+WorkerPool::WorkerPool(uint32_t threadCount)
+{
+    if (!threadCount)
+        threadCount = defaultThreadCount();
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint32_t started = 0;
+
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        auto worker = std::make_unique<Worker>();
+        Worker* w = worker.get();
+        w->thread = std::thread([w, &mutex, &cond, &started]() {
+            std::shared_ptr<event::Loop> loop = event::Loop::create();
+            {
+                // notified under the lock, once the constructor sees the
+                // count its mutex and cond go out of scope
+                std::lock_guard<std::mutex> locker(mutex);
+                w->loop = loop;
+                ++started;
+                cond.notify_one();
+            }
+
+            while (!loop->stopped()) {
+                loop->execute(100ms);
+            }
+        });
+        mWorkers.push_back(std::move(worker));
+    }
+
+    std::unique_lock<std::mutex> locker(mutex);
+    cond.wait(locker, [&started, threadCount]() { return started == threadCount; });
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::stop()
+{
+    for (auto& worker : mWorkers) {
+        worker->loop->exit();
+    }
+    for (auto& worker : mWorkers) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+void WorkerPool::post(std::function<void()>&& job)
+{
+    const uint32_t index = mNext.fetch_add(1, std::memory_order_relaxed) % mWorkers.size();
+    mWorkers[index]->loop->send(std::move(job));
+}
@@ -0,0 +1,43 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <event/Loop.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads each running its own event loop, so jobs can use
+// reckoning facilities (decoders, thens) that need a loop on the current
+// thread. Jobs are handed out round robin.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(uint32_t threadCount = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void post(std::function<void()>&& job);
+    // exits and joins every worker, pending jobs are dropped
+    void stop();
+
+    uint32_t size() const { return static_cast<uint32_t>(mWorkers.size()); }
+
+    static uint32_t defaultThreadCount();
+
+private:
+    struct Worker
+    {
+        std::thread thread;
+        std::shared_ptr<reckoning::event::Loop> loop;
+    };
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<uint32_t> mNext { 0 };
+};
+
+#endif // WORKERPOOL_H
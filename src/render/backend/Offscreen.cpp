@@ -0,0 +1,63 @@
+#include "Offscreen.h"
+#include <cassert>
+
+OffscreenBinding::OffscreenBinding(WGPUDevice device, uint32_t textureCount)
+    : BackendBinding(nullptr, device), mTextureCount(textureCount)
+{
+    assert(mTextureCount > 0);
+}
+
+uint64_t OffscreenBinding::GetSwapChainImplementation()
+{
+    // there is no native swapchain, Animation presents through Present() below
+    return 0;
+}
+
+WGPUTextureFormat OffscreenBinding::GetPreferredSwapChainTextureFormat()
+{
+    return WGPUTextureFormat_RGBA8Unorm;
+}
+
+void OffscreenBinding::Configure(wgpu::TextureFormat format, wgpu::TextureUsage usage, uint32_t width, uint32_t height)
+{
+    assert(width > 0);
+    assert(height > 0);
+
+    wgpu::Device device(mDevice);
+
+    wgpu::TextureDescriptor descriptor;
+    descriptor.dimension = wgpu::TextureDimension::e2D;
+    descriptor.size.width = width;
+    descriptor.size.height = height;
+    descriptor.size.depth = 1;
+    descriptor.arrayLayerCount = 1;
+    descriptor.sampleCount = 1;
+    descriptor.format = format;
+    descriptor.mipLevelCount = 1;
+    descriptor.usage = usage;
+
+    mTextures.clear();
+    mViews.clear();
+    for (uint32_t i = 0; i < mTextureCount; ++i) {
+        mTextures.push_back(device.CreateTexture(&descriptor));
+        mViews.push_back(mTextures.back().CreateView());
+    }
+    mCurrent = 0;
+}
+
+wgpu::Texture OffscreenBinding::GetCurrentTexture() const
+{
+    assert(!mTextures.empty());
+    return mTextures[mCurrent];
+}
+
+wgpu::TextureView OffscreenBinding::GetCurrentTextureView() const
+{
+    assert(!mViews.empty());
+    return mViews[mCurrent];
+}
+
+void OffscreenBinding::Present()
+{
+    mCurrent = (mCurrent + 1) % mTextureCount;
+}
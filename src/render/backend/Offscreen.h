@@ -0,0 +1,35 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include "Backend.h"
+#include <dawn/webgpu_cpp.h>
+#include <cstdint>
+#include <vector>
+
+// Backend binding without a window. Instead of handing a
+// DawnSwapChainImplementation to dawn we render into a small ring of plain
+// textures, which lets us run the render loop on machines without a display
+// (dawn's Null backend or a CPU vulkan ICD such as SwiftShader/lavapipe).
+class OffscreenBinding : public BackendBinding {
+public:
+    OffscreenBinding(WGPUDevice device, uint32_t textureCount);
+
+    uint64_t GetSwapChainImplementation() override;
+    WGPUTextureFormat GetPreferredSwapChainTextureFormat() override;
+
+    void Configure(wgpu::TextureFormat format, wgpu::TextureUsage usage, uint32_t width, uint32_t height);
+
+    wgpu::Texture GetCurrentTexture() const;
+    wgpu::TextureView GetCurrentTextureView() const;
+    // textures keep their contents, so this tells what a frame draws over
+    uint32_t GetCurrentIndex() const { return mCurrent; }
+    void Present();
+
+private:
+    std::vector<wgpu::Texture> mTextures;
+    std::vector<wgpu::TextureView> mViews;
+    uint32_t mTextureCount = 0;
+    uint32_t mCurrent = 0;
+};
+
+#endif // OFFSCREEN_H
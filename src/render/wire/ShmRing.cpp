@@ -0,0 +1,197 @@
+#include "ShmRing.h"
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+static inline size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+ShmRing::~ShmRing()
+{
+    closeReader();
+    closeWriter();
+    if (mHeader)
+        munmap(mHeader, mMappingSize);
+}
+
+ShmRing* ShmRing::create(size_t capacity)
+{
+    ShmRing* ring = new ShmRing;
+    ring->mCapacity = alignUp(capacity, 4096);
+    ring->mMappingSize = 4096 + ring->mCapacity;
+
+    void* mapping = mmap(nullptr, ring->mMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED || pipe(ring->mPipe) != 0) {
+        if (mapping != MAP_FAILED)
+            munmap(mapping, ring->mMappingSize);
+        ring->mMappingSize = 0;
+        delete ring;
+        return nullptr;
+    }
+
+    // the reader drains wakeups without blocking, and a writer finding the
+    // pipe full moves on, the reader has wakeups pending already
+    fcntl(ring->mPipe[0], F_SETFL, fcntl(ring->mPipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(ring->mPipe[1], F_SETFL, fcntl(ring->mPipe[1], F_GETFL) | O_NONBLOCK);
+    fcntl(ring->mPipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ring->mPipe[1], F_SETFD, FD_CLOEXEC);
+
+    ring->mHeader = new (mapping) Header;
+    ring->mHeader->head.store(0);
+    ring->mHeader->tail.store(0);
+    ring->mData = static_cast<char*>(mapping) + 4096;
+    return ring;
+}
+
+void ShmRing::closeReader()
+{
+    if (mPipe[0] != -1) {
+        close(mPipe[0]);
+        mPipe[0] = -1;
+    }
+}
+
+void ShmRing::closeWriter()
+{
+    if (mPipe[1] != -1) {
+        close(mPipe[1]);
+        mPipe[1] = -1;
+    }
+}
+
+bool ShmRing::write(const void* data, size_t size, const std::function<bool()>& wait)
+{
+    if (mPipe[1] == -1)
+        return false;
+
+    const char* bytes = static_cast<const char*>(data);
+    const size_t maxSize = maxChunkSize();
+    while (size > maxSize) {
+        if (!writePiece(bytes, maxSize, kContinued, wait))
+            return false;
+        bytes += maxSize;
+        size -= maxSize;
+    }
+    return writePiece(bytes, size, 0, wait);
+}
+
+bool ShmRing::writePiece(const char* data, size_t size, uint32_t flags, const std::function<bool()>& wait)
+{
+    const size_t needed = kChunkHeaderSize + alignUp(size, kChunkHeaderSize);
+    uint64_t head = mHeader->head.load(std::memory_order_relaxed);
+
+    // chunks never straddle the end, skip the remainder if it's too short
+    const size_t index = head % mCapacity;
+    const size_t remaining = mCapacity - index;
+    const size_t total = remaining < needed ? remaining + needed : needed;
+
+    while (mCapacity - (head - mHeader->tail.load(std::memory_order_acquire)) < total) {
+        if (!wait)
+            std::this_thread::yield();
+        else if (!wait())
+            return false;
+    }
+
+    if (remaining < needed) {
+        // there is always room for a header, chunks are multiples of it
+        const uint32_t marker = kWrapMarker;
+        memcpy(mData + index, &marker, sizeof(marker));
+        head += remaining;
+    }
+
+    char* chunk = mData + head % mCapacity;
+    const uint32_t chunkSize = static_cast<uint32_t>(size);
+    memcpy(chunk, &chunkSize, sizeof(chunkSize));
+    memcpy(chunk + sizeof(chunkSize), &flags, sizeof(flags));
+    memcpy(chunk + kChunkHeaderSize, data, size);
+    mHeader->head.store(head + needed, std::memory_order_release);
+
+    const char wakeup = 1;
+    ssize_t written;
+    do {
+        written = ::write(mPipe[1], &wakeup, 1);
+    } while (written < 0 && errno == EINTR);
+    // a full pipe already has wakeups pending
+    return written == 1 || errno == EAGAIN;
+}
+
+const volatile char* ShmRing::peek(size_t* size)
+{
+    if (mAssembled) {
+        *size = mAssembly.size();
+        return mAssembly.data();
+    }
+
+    for (;;) {
+        uint64_t tail = mHeader->tail.load(std::memory_order_relaxed);
+        const uint64_t head = mHeader->head.load(std::memory_order_acquire);
+        if (tail == head)
+            return nullptr;
+
+        uint32_t chunkSize;
+        memcpy(&chunkSize, mData + tail % mCapacity, sizeof(chunkSize));
+        if (chunkSize == kWrapMarker) {
+            tail += mCapacity - tail % mCapacity;
+            mHeader->tail.store(tail, std::memory_order_release);
+            if (tail == head)
+                return nullptr;
+            memcpy(&chunkSize, mData + tail % mCapacity, sizeof(chunkSize));
+        }
+
+        uint32_t flags;
+        memcpy(&flags, mData + tail % mCapacity + sizeof(chunkSize), sizeof(flags));
+        const char* data = mData + tail % mCapacity + kChunkHeaderSize;
+        const uint64_t pieceSize = kChunkHeaderSize + alignUp(chunkSize, kChunkHeaderSize);
+
+        if (!(flags & kContinued) && mAssembly.empty()) {
+            mPeeked = pieceSize;
+            *size = chunkSize;
+            return data;
+        }
+
+        // pieces are copied out and released right away, the writer needs
+        // the room for the ones after them
+        mAssembly.insert(mAssembly.end(), data, data + chunkSize);
+        mHeader->tail.store(tail + pieceSize, std::memory_order_release);
+        if (!(flags & kContinued)) {
+            mAssembled = true;
+            *size = mAssembly.size();
+            return mAssembly.data();
+        }
+    }
+}
+
+void ShmRing::pop()
+{
+    if (mAssembled) {
+        // a split chunk is rare and large, don't hold on to its memory
+        std::vector<char>().swap(mAssembly);
+        mAssembled = false;
+        return;
+    }
+    mHeader->tail.fetch_add(mPeeked, std::memory_order_release);
+    mPeeked = 0;
+}
+
+bool ShmRing::wait(int timeoutMs)
+{
+    pollfd fd = { mPipe[0], POLLIN, 0 };
+    const int ret = poll(&fd, 1, timeoutMs);
+    if (ret > 0) {
+        char buffer[256];
+        ssize_t r;
+        while ((r = read(mPipe[0], buffer, sizeof(buffer))) > 0) {
+        }
+        // every writer end is closed
+        if (r == 0)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Single producer, single consumer ring of variable sized chunks in memory
+// shared between two processes. Chunks are contiguous, so the reader can
+// hand them to a consumer in place. A pipe carries wakeups, one byte per
+// written chunk, which lets the reader block in poll() when idle.
+// Writes larger than maxChunkSize() go across in pieces, the reader puts
+// them back together and hands them out as one chunk.
+//
+// Create it before fork(), each process then keeps one end.
+class ShmRing
+{
+public:
+    ~ShmRing();
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    // returns nullptr if the mapping or the pipe can't be created
+    static ShmRing* create(size_t capacity);
+
+    // after fork(), close the end this process doesn't use
+    void closeReader();
+    void closeWriter();
+
+    // largest chunk that goes across in place, larger ones are split
+    size_t maxChunkSize() const { return mCapacity / 2 - kChunkHeaderSize; }
+
+    // copies a chunk in, calling wait while the ring is full. Returns false
+    // when the reader is gone or wait returned false.
+    bool write(const void* data, size_t size, const std::function<bool()>& wait = nullptr);
+
+    // the next chunk or nullptr, valid until pop()
+    const volatile char* peek(size_t* size);
+    void pop();
+
+    // bytes the reader has consumed so far, for telling a slow reader from
+    // one that stopped
+    uint64_t readPosition() const { return mHeader->tail.load(std::memory_order_acquire); }
+
+    // blocks until written to, false when the writer has gone away
+    bool wait(int timeoutMs);
+
+    int readerFd() const { return mPipe[0]; }
+
+private:
+    ShmRing() = default;
+
+    static constexpr size_t kChunkHeaderSize = 16;
+    static constexpr uint32_t kWrapMarker = 0xffffffffu;
+    // in the second word of the chunk header, more pieces follow
+    static constexpr uint32_t kContinued = 1u;
+
+    bool writePiece(const char* data, size_t size, uint32_t flags, const std::function<bool()>& wait);
+
+    struct Header
+    {
+        // monotonically increasing byte positions
+        alignas(64) std::atomic<uint64_t> head;
+        alignas(64) std::atomic<uint64_t> tail;
+    };
+
+    Header* mHeader { nullptr };
+    char* mData { nullptr };
+    size_t mCapacity { 0 };
+    size_t mMappingSize { 0 };
+    int mPipe[2] { -1, -1 };
+    uint64_t mPeeked { 0 };
+    // pieces of a split chunk read so far
+    std::vector<char> mAssembly;
+    bool mAssembled { false };
+};
+
+#endif // SHMRING_H
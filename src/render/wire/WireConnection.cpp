@@ -0,0 +1,219 @@
+#include "WireConnection.h"
+#include "Constants.h"
+#include "Utils.h"
+#include <log/Log.h>
+#include <dawn_native/DawnNative.h>
+#include <dawn_wire/WireServer.h>
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace reckoning;
+using namespace reckoning::log;
+using namespace std::chrono_literals;
+
+// Batches serialized commands in a buffer and writes the batch to the ring
+// as one chunk. Space handed out by GetCmdSpace() doesn't move until the
+// next call, a command larger than the batch (the inline data of a large
+// mapped buffer) gets a batch of its own and the ring splits it up.
+class RingSerializer : public dawn_wire::CommandSerializer
+{
+public:
+    RingSerializer(ShmRing& ring, std::function<bool()>&& wait)
+        : mRing(ring), mWait(std::move(wait)), mBatchSize(ring.maxChunkSize()), mBuffer(mBatchSize)
+    {
+    }
+
+    void* GetCmdSpace(size_t size) override
+    {
+        if (mSize + size > mBuffer.size() && !Flush())
+            return nullptr;
+        // nothing is pending after a flush, growing can't move commands
+        if (size > mBuffer.size())
+            mBuffer.resize(size);
+        void* space = mBuffer.data() + mSize;
+        mSize += size;
+        return space;
+    }
+
+    bool Flush() override
+    {
+        if (!mSize)
+            return true;
+        const bool ok = mRing.write(mBuffer.data(), mSize, mWait);
+        mFlushed += mSize;
+        mSize = 0;
+        if (mBuffer.size() > mBatchSize)
+            std::vector<char>(mBatchSize).swap(mBuffer);
+        return ok;
+    }
+
+    size_t pending() const { return mSize; }
+    uint64_t flushed() const { return mFlushed; }
+
+private:
+    ShmRing& mRing;
+    std::function<bool()> mWait;
+    const size_t mBatchSize;
+    std::vector<char> mBuffer;
+    size_t mSize { 0 };
+    uint64_t mFlushed { 0 };
+};
+
+// how long the server waits on a client that stopped reading returns
+static constexpr auto kServerStallTimeout = 10s;
+
+static void PrintServerError(WGPUErrorType, const char* message, void*)
+{
+    Log(Log::Error) << "wire server error:" << message;
+}
+
+// child process, never returns
+[[noreturn]] static void runServer(ShmRing& commands, ShmRing& returns, wgpu::BackendType backendType, bool preferCpuAdapter)
+{
+    commands.closeWriter();
+    returns.closeReader();
+
+    dawn_native::Instance instance;
+    instance.DiscoverDefaultAdapters();
+    dawn_native::Adapter adapter;
+    if (!SelectAdapter(instance, backendType, preferCpuAdapter, &adapter))
+        _exit(1);
+
+    WGPUDevice device = adapter.CreateDevice();
+    DawnProcTable procs = dawn_native::GetProcs();
+    procs.deviceSetUncapturedErrorCallback(device, PrintServerError, nullptr);
+
+    // A full returns ring means the client isn't reading. It may just be
+    // busy, but if it died without its end of the command ring closing
+    // (the pipe is inherited by anything else it forked) nothing ever
+    // drains the ring again, so check on it and give up after a while.
+    const pid_t client = getppid();
+    uint64_t readPosition = returns.readPosition();
+    auto progress = std::chrono::steady_clock::now();
+
+    {
+        RingSerializer serializer(returns, [&]() -> bool {
+            const auto now = std::chrono::steady_clock::now();
+            if (returns.readPosition() != readPosition) {
+                readPosition = returns.readPosition();
+                progress = now;
+            }
+            if (!commands.wait(1) || getppid() != client || now - progress > kServerStallTimeout) {
+                Log(Log::Error) << "wire server: client stopped reading returns";
+                _exit(1);
+            }
+            return true;
+        });
+
+        dawn_wire::WireServerDescriptor descriptor = {};
+        descriptor.device = device;
+        descriptor.procs = &procs;
+        descriptor.serializer = &serializer;
+        dawn_wire::WireServer server(descriptor);
+
+        // wake up at least every tick interval so fences make progress
+        for (;;) {
+            const bool connected = commands.wait(1);
+            progress = std::chrono::steady_clock::now();
+            size_t size;
+            while (const volatile char* chunk = commands.peek(&size)) {
+                if (!server.HandleCommands(chunk, size)) {
+                    Log(Log::Error) << "wire server: invalid commands";
+                    _exit(1);
+                }
+                commands.pop();
+            }
+            procs.deviceTick(device);
+            serializer.Flush();
+            if (!connected)
+                break;
+        }
+    }
+
+    procs.deviceRelease(device);
+    _exit(0);
+}
+
+WireConnection::~WireConnection()
+{
+    mClient.reset();
+    mSerializer.reset();
+    if (mCommands)
+        mCommands->closeWriter();
+    if (mServer > 0) {
+        int status;
+        while (waitpid(mServer, &status, 0) < 0 && errno == EINTR) {
+        }
+    }
+}
+
+std::unique_ptr<WireConnection> WireConnection::spawn(wgpu::BackendType backendType, bool preferCpuAdapter)
+{
+    std::unique_ptr<WireConnection> connection(new WireConnection);
+    connection->mCommands.reset(ShmRing::create(kWireRingSize));
+    connection->mReturns.reset(ShmRing::create(kWireRingSize));
+    if (!connection->mCommands || !connection->mReturns) {
+        Log(Log::Error) << "unable to create wire rings";
+        return {};
+    }
+
+    // a server that died shows up as failed writes, not as a signal
+    signal(SIGPIPE, SIG_IGN);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        Log(Log::Error) << "unable to fork wire server" << errno;
+        return {};
+    }
+    if (pid == 0)
+        runServer(*connection->mCommands, *connection->mReturns, backendType, preferCpuAdapter);
+
+    connection->mServer = pid;
+    connection->mCommands->closeReader();
+    connection->mReturns->closeWriter();
+
+    // a full command ring means the server is waiting on us, keep its
+    // returns moving
+    WireConnection* self = connection.get();
+    connection->mSerializer = std::make_unique<RingSerializer>(*connection->mCommands, [self]() -> bool {
+        self->handleReturns();
+        std::this_thread::yield();
+        return !self->mServerGone;
+    });
+
+    dawn_wire::WireClientDescriptor descriptor = {};
+    descriptor.serializer = connection->mSerializer.get();
+    connection->mClient = std::make_unique<dawn_wire::WireClient>(descriptor);
+    connection->mDevice = connection->mClient->GetDevice();
+    connection->mProcs = connection->mClient->GetProcs();
+    return connection;
+}
+
+void WireConnection::flush()
+{
+    if (!mSerializer->pending())
+        return;
+    ++mFlushCount;
+    mBytesSent += mSerializer->pending();
+    if (!mSerializer->Flush())
+        Log(Log::Error) << "wire server went away";
+}
+
+void WireConnection::handleReturns()
+{
+    // drains wakeups, the ring is what counts
+    if (!mReturns->wait(0) && !mServerGone) {
+        Log(Log::Error) << "wire server exited";
+        mServerGone = true;
+    }
+    size_t size;
+    while (const volatile char* chunk = mReturns->peek(&size)) {
+        mClient->HandleCommands(chunk, size);
+        mReturns->pop();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef WIRECONNECTION_H
+#define WIRECONNECTION_H
+
+#include "ShmRing.h"
+#include <dawn/dawn_proc_table.h>
+#include <dawn/webgpu.h>
+#include <dawn/webgpu_cpp.h>
+#include <dawn_wire/WireClient.h>
+#include <cstdint>
+#include <memory>
+#include <sys/types.h>
+#include <vector>
+
+class RingSerializer;
+
+// Runs the gpu device in a child process behind a dawn_wire::WireServer and
+// hands out the client side device and procs. Commands are batched locally
+// and go across in one chunk per flush() over a shared memory ring, return
+// commands (fence completions, map callbacks, errors) come back over a
+// second one and are handled in handleReturns().
+class WireConnection
+{
+public:
+    ~WireConnection();
+
+    // forks the server, call this before any other threads are started
+    static std::unique_ptr<WireConnection> spawn(wgpu::BackendType backendType, bool preferCpuAdapter);
+
+    WGPUDevice device() const { return mDevice; }
+    const DawnProcTable& procs() const { return mProcs; }
+
+    void flush();
+    void handleReturns();
+
+    uint64_t flushCount() const { return mFlushCount; }
+    uint64_t bytesSent() const { return mBytesSent; }
+
+private:
+    WireConnection() = default;
+
+    pid_t mServer { -1 };
+    std::unique_ptr<ShmRing> mCommands;
+    std::unique_ptr<ShmRing> mReturns;
+    std::unique_ptr<RingSerializer> mSerializer;
+    std::unique_ptr<dawn_wire::WireClient> mClient;
+    WGPUDevice mDevice { nullptr };
+    DawnProcTable mProcs {};
+
+    bool mServerGone { false };
+    uint64_t mFlushCount { 0 };
+    uint64_t mBytesSent { 0 };
+};
+
+#endif // WIRECONNECTION_H
@@ -0,0 +1,783 @@
+#include "render/Animation.h"
+#include "render/FrameArena.h"
+#include "render/MappedFile.h"
+#include "render/Profiler.h"
+#include "render/ResolutionScaler.h"
+#include "render/ObjectCache.h"
+#include "render/SceneRecorder.h"
+#include "render/ShaderCache.h"
+#include "render/SpriteBatch.h"
+#include "render/StagingRing.h"
+#include "render/Timeline.h"
+#include "render/Utils.h"
+#include "render/wire/WireConnection.h"
+#include <args/Args.h>
+#include <args/Parser.h>
+#include <event/Loop.h>
+#include <log/Log.h>
+#include <dawn/dawn_proc.h>
+#include <dawn_native/DawnNative.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <unistd.h>
+
+using namespace reckoning;
+using namespace reckoning::log;
+using namespace std::chrono_literals;
+
+// Microbenchmarks for the render helpers and the frame submit path, run on
+// dawn's null backend so the numbers are cpu cost only. Results are written
+// as json to stdout (or --output) for tracking across releases.
+
+typedef std::chrono::steady_clock Clock;
+
+// frames an animation runs before it's checked and timed, and the frames
+// it's checked for allocations in
+static const uint32_t kWarmupFrames = 120;
+static const uint32_t kCheckedFrames = 200;
+
+// every heap allocation in the process, dawn's included
+static std::atomic<uint64_t> allocationCount { 0 };
+
+// While attributing, every allocation walks the stack to find out where it
+// was made. Steady state frames may only allocate inside the calls listed
+// below, everything else counts against them, out of dawn or not. The
+// executable exports its symbols so frames can be told apart by name.
+// Dawn's C++ wrappers tail call into the shared libraries and leave no
+// frame of their own, a call is also known by the target of the call
+// instruction its caller's return address follows.
+//
+// Library calls that allocate on every frame by design. An allocation
+// counts as theirs when they're the first of the listed calls or our own
+// functions up the stack, so our code they call back into still counts.
+struct Exclusion
+{
+    const char* symbol;
+    const char* reason;
+};
+static const Exclusion libraryCalls[] = {
+    { "_ZNK4wgpu6Device20CreateCommandEncoder", "dawn allocates every encoder and its command blocks" },
+    { "_ZNK4wgpu14CommandEncoder", "recording grows dawn's command blocks, passes and Finish() allocate objects" },
+    { "_ZNK4wgpu17RenderPassEncoder", "recording grows dawn's command blocks" },
+    { "_ZNK4wgpu6Device25CreateRenderBundleEncoder", "invalidated layers are re-recorded into new bundles" },
+    { "_ZNK4wgpu19RenderBundleEncoder", "recording grows dawn's command blocks, Finish() allocates the bundle" },
+    { "_ZNK4wgpu5Queue6Submit", "the backend tracks every submit" },
+    { "_ZNK4wgpu5Queue6Signal", "dawn queues every fence signal" },
+    { "_ZNK4wgpu5Fence12OnCompletion", "dawn queues every completion request" },
+    { "_ZNK4wgpu6Device4Tick", "dawn's deferred work and callbacks" },
+    { "_ZNK4wgpu6Buffer13MapWriteAsync", "staging blocks are remapped once their frame retires" },
+    { "_ZNK4wgpu6Buffer12MapReadAsync", "captured frames are mapped for reading" },
+    { "_ZN9reckoning5event4Loop4send", "the fence completion wakes up the loop with a posted task" },
+    { "_ZN9reckoning5event4Loop7execute", "the loop's own bookkeeping around the tasks it runs" },
+    { "_ZN9dawn_wire10WireClient14HandleCommands", "the wire client allocates the data of every mapped buffer" },
+    { nullptr, nullptr }
+};
+// Our own calls that allocate on every frame by design, everything they
+// call included.
+static const Exclusion ownCalls[] = {
+    { "_ZN12FrameCapture8onMapped", "each captured frame is handed to the writer thread as a posted job" },
+    { nullptr, nullptr }
+};
+
+static std::atomic<bool> attributing { false };
+static std::atomic<uint64_t> counted { 0 };
+static std::atomic<void*> firstCounted { nullptr };
+static const void* executableBase = nullptr;
+static thread_local bool walkingStack = false;
+
+static bool hasPrefix(const char* name, const char* const* prefixes)
+{
+    for (; *prefixes; ++prefixes) {
+        if (!strncmp(name, *prefixes, strlen(*prefixes)))
+            return true;
+    }
+    return false;
+}
+
+static bool matches(const char* name, const Exclusion* exclusions)
+{
+    if (!name)
+        return false;
+    for (; exclusions->symbol; ++exclusions) {
+        if (!strncmp(name, exclusions->symbol, strlen(exclusions->symbol)))
+            return true;
+    }
+    return false;
+}
+
+// where the call before a return address went, null when it can't be told
+static void* callTarget(void* returnAddress)
+{
+#if defined(__x86_64__)
+    // only direct calls, e8 and a 32 bit displacement
+    const unsigned char* code = static_cast<const unsigned char*>(returnAddress);
+    if (code[-5] != 0xe8)
+        return nullptr;
+    int32_t displacement;
+    memcpy(&displacement, code - 4, sizeof(displacement));
+    return const_cast<unsigned char*>(code) + displacement;
+#else
+    (void)returnAddress;
+    return nullptr;
+#endif
+}
+
+static const char* symbolName(void* address)
+{
+    Dl_info info;
+    return address && dladdr(address, &info) ? info.dli_sname : nullptr;
+}
+
+// Whether the allocation counts, and the frame to blame for it: our first
+// function on the stack, null when there is none.
+static bool counts(void** caller)
+{
+    // the standard library, inlined into or instantiated in the executable
+    static const char* const runtimePrefixes[] = { "_Znw", "_Zna", "_ZSt", "_ZNSt", "_ZNKSt", "_ZNSa",
+                                                   "_ZN9__gnu_cxx", "_ZNK9__gnu_cxx", nullptr };
+
+    void* frames[64];
+    const int count = backtrace(frames, 64);
+    *caller = nullptr;
+    // past this function, operator new is skipped by its name whether or
+    // not this was inlined into it
+    for (int i = 1; i < count; ++i) {
+        Dl_info info;
+        if (!dladdr(frames[i], &info))
+            continue;
+        if (!*caller && (matches(info.dli_sname, libraryCalls)
+                         || matches(symbolName(callTarget(frames[i])), libraryCalls)))
+            return false;
+        if (matches(info.dli_sname, ownCalls))
+            return false;
+        // file local functions have no symbol and are ours
+        if (!*caller && info.dli_fbase == executableBase
+            && !(info.dli_sname && hasPrefix(info.dli_sname, runtimePrefixes)))
+            *caller = frames[i];
+    }
+    return true;
+}
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (attributing.load(std::memory_order_relaxed) && !walkingStack) {
+        walkingStack = true;
+        void* caller;
+        if (counts(&caller)) {
+            counted.fetch_add(1, std::memory_order_relaxed);
+            void* none = nullptr;
+            firstCounted.compare_exchange_strong(none, caller ? caller : reinterpret_cast<void*>(&counts));
+        }
+        walkingStack = false;
+    }
+    if (void* ptr = malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+static uint64_t allocations()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+static void initAttribution()
+{
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(&initAttribution), &info))
+        executableBase = info.dli_fbase;
+    // the first backtrace() loads the unwinder, which allocates
+    void* frames[1];
+    backtrace(frames, 1);
+}
+
+// runs function with every allocation attributed, returns how many of them
+// counted and logs where the first one came from
+template<typename Function>
+static uint64_t countedAllocations(Function&& function)
+{
+    counted.store(0);
+    firstCounted.store(nullptr);
+    attributing.store(true);
+    function();
+    attributing.store(false);
+
+    const uint64_t count = counted.load();
+    if (void* caller = firstCounted.load()) {
+        Dl_info info;
+        const char* name = "a file local function";
+        if (caller == reinterpret_cast<void*>(&counts))
+            name = "outside of our code and the excluded calls";
+        else if (dladdr(caller, &info) && info.dli_sname)
+            name = info.dli_sname;
+        Log(Log::Error) << "first allocation from" << name << "at" << caller;
+    }
+    return count;
+}
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations { 0 };
+    double mean { 0.0 };
+    double p50 { 0.0 };
+    double p99 { 0.0 };
+    // heap allocations per iteration
+    double allocs { 0.0 };
+};
+
+// times every call on its own, which adds the cost of reading the clock
+// (tens of nanoseconds) to each sample
+template<typename Function>
+static Result run(const std::string& name, uint32_t iterations, const wgpu::Device& device, Function&& function)
+{
+    std::vector<int64_t> samples(iterations);
+    uint64_t allocs = 0;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        const uint64_t allocsBefore = allocations();
+        const Clock::time_point start = Clock::now();
+        function(i);
+        samples[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        allocs += allocations() - allocsBefore;
+        // lets dawn release whatever the iterations dropped
+        if (i % 1024 == 1023)
+            device.Tick();
+    }
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    if (!iterations)
+        return result;
+
+    int64_t total = 0;
+    for (int64_t sample : samples)
+        total += sample;
+    std::sort(samples.begin(), samples.end());
+    result.mean = static_cast<double>(total) / iterations;
+    result.p50 = samples[iterations / 2];
+    result.p99 = samples[std::min<size_t>(iterations * 99 / 100, iterations - 1)];
+    result.allocs = static_cast<double>(allocs) / iterations;
+    return result;
+}
+
+static wgpu::Device createNullDevice(dawn_native::Instance& instance)
+{
+    instance.DiscoverDefaultAdapters();
+    for (const dawn_native::Adapter& adapter : instance.GetAdapters()) {
+        wgpu::AdapterProperties properties;
+        adapter.GetProperties(&properties);
+        if (properties.backendType != wgpu::BackendType::Null)
+            continue;
+
+        DawnProcTable procs = dawn_native::GetProcs();
+        dawnProcSetProcs(&procs);
+        return wgpu::Device::Acquire(adapter.CreateDevice());
+    }
+    return {};
+}
+
+// removes the file once main() returns, whichever way it does
+class TemporaryFile
+{
+public:
+    explicit TemporaryFile(std::string&& path)
+        : mPath(std::move(path))
+    {
+    }
+    ~TemporaryFile()
+    {
+        if (!mPath.empty())
+            unlink(mPath.c_str());
+    }
+
+    TemporaryFile(const TemporaryFile&) = delete;
+    TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+    const std::string& path() const { return mPath; }
+
+private:
+    std::string mPath;
+};
+
+// A mapped buffer's contents cross the wire inline in a single command,
+// each way. Sends one larger than a ring chunk to the server, copies it and
+// maps the copy back, so both rings split and reassemble a command.
+static bool checkWireTransfer()
+{
+    constexpr uint32_t size = 48u * 1024u * 1024u;
+    std::unique_ptr<WireConnection> wire = WireConnection::spawn(wgpu::BackendType::Null, false);
+    if (!wire)
+        return false;
+    DawnProcTable procs = wire->procs();
+    dawnProcSetProcs(&procs);
+
+    bool ok = false;
+    {
+        wgpu::Device device = wgpu::Device::Acquire(wire->device());
+        wgpu::Queue queue = device.CreateQueue();
+
+        wgpu::BufferDescriptor descriptor;
+        descriptor.size = size;
+        descriptor.usage = wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc;
+        wgpu::CreateBufferMappedResult source = device.CreateBufferMapped(&descriptor);
+        uint32_t* words = static_cast<uint32_t*>(source.data);
+        for (uint32_t i = 0; i < size / 4; ++i)
+            words[i] = i * 2654435761u;
+        source.buffer.Unmap();
+
+        descriptor.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+        wgpu::Buffer readback = device.CreateBuffer(&descriptor);
+        wgpu::CommandEncoder encoder = device.CreateCommandEncoder();
+        encoder.CopyBufferToBuffer(source.buffer, 0, readback, 0, size);
+        wgpu::CommandBuffer commands = encoder.Finish();
+        queue.Submit(1, &commands);
+
+        struct Readback
+        {
+            bool done { false };
+            bool ok { false };
+        } result;
+        readback.MapReadAsync([](WGPUBufferMapAsyncStatus status, const void* data, uint64_t dataLength, void* userdata) {
+            Readback* result = static_cast<Readback*>(userdata);
+            result->done = true;
+            if (status != WGPUBufferMapAsyncStatus_Success || dataLength < size)
+                return;
+            const uint32_t* words = static_cast<const uint32_t*>(data);
+            result->ok = true;
+            for (uint32_t i = 0; i < size / 4 && result->ok; ++i)
+                result->ok = words[i] == i * 2654435761u;
+        }, &result);
+
+        const Clock::time_point deadline = Clock::now() + 10s;
+        while (!result.done && Clock::now() < deadline) {
+            wire->flush();
+            wire->handleReturns();
+            std::this_thread::sleep_for(1ms);
+        }
+        if (!result.done)
+            Log(Log::Error) << "timed out waiting for the wire readback";
+        else if (!result.ok)
+            Log(Log::Error) << "wire readback doesn't match what was sent";
+        ok = result.ok;
+    }
+    wire->flush();
+    return ok;
+}
+
+// Feeds the scaler frames timed the way Animation times them, on a
+// simulated 60Hz FIFO swapchain with two frames in flight: the backbuffer
+// acquire blocks until the next refresh and the gpu time ends at the
+// fence's completion. A gpu bound stretch has to scale down, a light one
+// after it has to scale back up to full resolution even though presenting
+// keeps every frame at the refresh interval.
+static bool checkResolutionScaling()
+{
+    const std::chrono::nanoseconds refresh(16666667);
+    ResolutionScaler scaler(refresh);
+
+    Clock::time_point now;
+    Clock::time_point completed[2];
+    uint32_t frame = 0;
+    auto runFrames = [&](uint32_t count, std::chrono::nanoseconds gpuWork) {
+        for (uint32_t i = 0; i < count; ++i, ++frame) {
+            // the slot is free once the frame two back has completed
+            now = std::max(now, completed[frame % 2]);
+            const Clock::time_point frameStart = now;
+            now += 2ms;
+            const auto sinceRefresh = now.time_since_epoch() % refresh;
+            const auto backbufferWait = sinceRefresh.count() ? refresh - sinceRefresh : std::chrono::nanoseconds::zero();
+            now += backbufferWait + 100us;
+
+            const float scale = scaler.scale();
+            const auto work = std::chrono::duration_cast<std::chrono::nanoseconds>(gpuWork * scale * scale);
+            const Clock::time_point previous = completed[(frame + 1) % 2];
+            completed[frame % 2] = std::max(now, previous) + work;
+            const auto cpuTime = std::chrono::duration_cast<std::chrono::nanoseconds>(now - frameStart) - backbufferWait;
+            scaler.addFrame(ResolutionScaler::frameTime(cpuTime, now, previous, completed[frame % 2]));
+        }
+    };
+
+    runFrames(kResolutionScaleWindow * 10, 30ms);
+    if (scaler.scale() > 0.9f) {
+        Log(Log::Error) << "resolution scale stayed at" << scaler.scale() << "with the gpu twice over budget";
+        return false;
+    }
+    runFrames(kResolutionScaleWindow * 20, 8ms);
+    if (scaler.scale() != 1.0f) {
+        Log(Log::Error) << "resolution scale stuck at" << scaler.scale() << "once the gpu had half its budget";
+        return false;
+    }
+    return true;
+}
+
+// a raw image for the animation to load without touching the network
+static std::string writeRawImage(uint32_t width, uint32_t height)
+{
+    const std::string path = "/tmp/dt_bench_" + std::to_string(getpid()) + ".raw";
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return std::string();
+
+    const RawImageHeader header = { RawImageHeader::kMagic, width, height, width * 4 };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    std::vector<uint8_t> row(width * 4);
+    for (uint32_t y = 0; ok && y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            row[x * 4 + 0] = static_cast<uint8_t>(x);
+            row[x * 4 + 1] = static_cast<uint8_t>(y);
+            row[x * 4 + 2] = static_cast<uint8_t>(x ^ y);
+            row[x * 4 + 3] = 0xff;
+        }
+        ok = fwrite(row.data(), 1, row.size(), f) == row.size();
+    }
+    if (fclose(f) != 0 || !ok) {
+        unlink(path.c_str());
+        return std::string();
+    }
+    return path;
+}
+
+static std::vector<Result> benchHelpers(const wgpu::Device& device, uint32_t iterations)
+{
+    std::vector<Result> results;
+
+    static const char* vertexSource = R"(
+    #version 450
+    void main() {
+        gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+    })";
+
+    const uint8_t data[256] = {};
+    results.push_back(run("CreateBufferFromData", iterations, device, [&](uint32_t) {
+        CreateBufferFromData(device, data, sizeof(data), wgpu::BufferUsage::Uniform);
+    }));
+
+    results.push_back(run("MakeBindGroupLayout", iterations, device, [&](uint32_t) {
+        MakeBindGroupLayout(device, {
+            {0, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+            {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture},
+            {2, wgpu::ShaderStage::Vertex, wgpu::BindingType::UniformBuffer}
+        });
+    }));
+
+    FrameArena arena;
+    results.push_back(run("MakeBindGroupLayout/arena", iterations, device, [&](uint32_t) {
+        arena.reset();
+        MakeBindGroupLayout(device, {
+            {0, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+            {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture},
+            {2, wgpu::ShaderStage::Vertex, wgpu::BindingType::UniformBuffer}
+        }, arena);
+    }));
+
+    wgpu::BindGroupLayout layout = MakeBindGroupLayout(device, {
+        {0, wgpu::ShaderStage::Fragment, wgpu::BindingType::Sampler},
+        {1, wgpu::ShaderStage::Fragment, wgpu::BindingType::SampledTexture},
+        {2, wgpu::ShaderStage::Vertex, wgpu::BindingType::UniformBuffer}
+    });
+    wgpu::SamplerDescriptor samplerDesc = GetDefaultSamplerDescriptor();
+    wgpu::Sampler sampler = device.CreateSampler(&samplerDesc);
+
+    wgpu::TextureDescriptor textureDesc;
+    textureDesc.dimension = wgpu::TextureDimension::e2D;
+    textureDesc.size = { 256, 256, 1 };
+    textureDesc.arrayLayerCount = 1;
+    textureDesc.sampleCount = 1;
+    textureDesc.format = wgpu::TextureFormat::RGBA8Unorm;
+    textureDesc.mipLevelCount = 1;
+    textureDesc.usage = wgpu::TextureUsage::Sampled | wgpu::TextureUsage::OutputAttachment;
+    wgpu::TextureView view = device.CreateTexture(&textureDesc).CreateView();
+    wgpu::Buffer ubo = CreateBufferFromData(device, data, sizeof(data), wgpu::BufferUsage::Uniform);
+
+    results.push_back(run("MakeBindGroup", iterations, device, [&](uint32_t) {
+        MakeBindGroup(device, layout, {
+            {0, sampler},
+            {1, view},
+            {2, ubo}
+        });
+    }));
+
+    results.push_back(run("MakeBindGroup/arena", iterations, device, [&](uint32_t) {
+        arena.reset();
+        MakeBindGroup(device, layout, {
+            {0, sampler},
+            {1, view},
+            {2, ubo}
+        }, arena);
+    }));
+
+    // every iteration is a different source, so this is shaderc plus dawn
+    const uint32_t coldIterations = std::max(iterations / 100, 1u);
+    results.push_back(run("CreateShaderModule/cold", coldIterations, device, [&](uint32_t i) {
+        CreateShaderModule(device, SingleShaderStage::Vertex, std::string(vertexSource) + "// " + std::to_string(i) + "\n");
+    }));
+    // and this is the shader cache's memory layer plus dawn
+    results.push_back(run("CreateShaderModule/warm", iterations, device, [&](uint32_t) {
+        CreateShaderModule(device, SingleShaderStage::Vertex, vertexSource);
+    }));
+
+    wgpu::TextureView depthStencil = CreateDefaultDepthStencilView(device, 256, 256);
+    results.push_back(run("ComboRenderPassDescriptor", iterations, device, [&](uint32_t) {
+        ComboRenderPassDescriptor renderPass({view}, depthStencil);
+        (void)renderPass;
+    }));
+
+    return results;
+}
+
+static Result benchTimeline(const wgpu::Device& device, uint32_t trackCount, uint32_t iterations)
+{
+    Timeline timeline;
+    for (uint32_t i = 0; i < trackCount; ++i) {
+        timeline.addTrack({
+            { 0.0f, { -1.0f, 1.0f, 1.0f, -1.0f }, Timeline::Easing::EaseOut },
+            { 0.5f, { -1.0f, 1.5f, 1.0f, -0.5f }, Timeline::Easing::EaseIn },
+            { 1.0f, { -1.0f, 1.0f, 1.0f, -1.0f }, Timeline::Easing::Linear }
+        }, i * 0.001f, true);
+    }
+
+    // same layout the sprite batch gets written in
+    std::vector<SpriteBatch::Sprite> sprites(trackCount);
+    return run("Timeline::evaluate/" + std::to_string(trackCount), iterations, device, [&](uint32_t i) {
+        timeline.evaluate(i * (1.0f / 60.0f), &sprites[0].geometry, sizeof(SpriteBatch::Sprite));
+    });
+}
+
+// re-records every layer of a big sprite scene, on the calling thread only
+// and spread over the default number of threads
+static std::vector<Result> benchRecorder(const wgpu::Device& device, uint32_t layerCount, uint32_t iterations)
+{
+    ObjectCache objects(device);
+    StagingRing staging(device);
+    SpriteBatch batch(device, objects, staging, wgpu::TextureFormat::RGBA8Unorm,
+                      wgpu::TextureFormat::Depth24PlusStencil8, 16, 16, 1);
+    const uint32_t spritesPerLayer = 64;
+    for (uint32_t i = 0; i < layerCount * spritesPerLayer; ++i) {
+        batch.add({ { -1.0f, 1.0f, 1.0f, -1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f }, { 0.0f, 1.0f, 0.0f, 0.0f } });
+    }
+    batch.update();
+
+    std::vector<Result> results;
+    for (uint32_t threads : { 1u, 0u }) {
+        SceneRecorder recorder(device, wgpu::TextureFormat::RGBA8Unorm, wgpu::TextureFormat::Depth24PlusStencil8, threads);
+        for (uint32_t first = 0; first < batch.count(); first += spritesPerLayer) {
+            recorder.addLayer([&batch, first, spritesPerLayer](const wgpu::RenderBundleEncoder& encoder) {
+                batch.encode(encoder, first, spritesPerLayer);
+            });
+        }
+        const std::string name = "SceneRecorder::bundles/" + std::to_string(layerCount) + "/"
+            + std::to_string(recorder.threadCount()) + (recorder.threadCount() > 1 ? " threads" : " thread");
+        results.push_back(run(name, iterations, device, [&](uint32_t) {
+            recorder.invalidateAll();
+            recorder.bundles();
+        }));
+    }
+    return results;
+}
+
+static bool benchFrame(const AnimationOptions& options, uint32_t frames, Result& result)
+{
+    Animation animation;
+    if (!animation.create(nullptr, 1280, 720, options))
+        return false;
+
+    std::shared_ptr<event::Loop> loop = event::Loop::create();
+    animation.init(loop);
+    if (!animation.start())
+        return false;
+
+    const Clock::time_point deadline = Clock::now() + 10s;
+    while (!animation.contentReady()) {
+        if (Clock::now() > deadline) {
+            Log(Log::Error) << "timed out waiting for content";
+            return false;
+        }
+        loop->execute(1ms);
+        animation.tick();
+    }
+
+    auto runFrames = [&](uint64_t count) {
+        const uint64_t first = animation.frameCount();
+        while (animation.frameCount() - first < count) {
+            loop->execute(0ms);
+            animation.tick();
+        }
+    };
+
+    result.name = options.spriteCount ? "Animation::frame/sprites" : "Animation::frame";
+    if (options.wire)
+        result.name += "/wire";
+    if (!options.capturePath.empty())
+        result.name += "/capture";
+    if (options.statsOverlay)
+        result.name += "/overlay";
+
+    // Once every pool, ring and window has grown to fit, frames may only
+    // allocate inside the excluded calls. Walking the stack on every
+    // allocation is slow, the timed frames run without it.
+    runFrames(kWarmupFrames);
+    const uint64_t steadyAllocs = countedAllocations([&]() { runFrames(kCheckedFrames); });
+    if (steadyAllocs) {
+        Log(Log::Error) << result.name + ":" << steadyAllocs << "heap allocations in" << kCheckedFrames << "steady state frames";
+        return false;
+    }
+
+    // the frame marker covers Animation::frame() as a whole
+    Profiler& profiler = Profiler::instance();
+    profiler.reset();
+    const uint64_t first = animation.frameCount();
+    const uint64_t allocsBefore = allocations();
+    const Clock::time_point start = Clock::now();
+    runFrames(frames);
+    const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    const uint64_t allocs = allocations() - allocsBefore;
+
+    const Profiler::Percentiles percentiles = profiler.percentiles("frame");
+    result.iterations = percentiles.count;
+    result.mean = elapsed.count() / (animation.frameCount() - first);
+    result.p50 = percentiles.p50.count();
+    result.p99 = percentiles.p99.count();
+    result.allocs = static_cast<double>(allocs) / (animation.frameCount() - first);
+    return true;
+}
+
+static void writeResults(FILE* f, const std::vector<Result>& results)
+{
+    fprintf(f, "{\n  \"backend\": \"null\",\n  \"unit\": \"ns\",\n  \"benchmarks\": [");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        fprintf(f, "%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"allocs\": %.2f}",
+                i ? "," : "", r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.mean, r.p50, r.p99, r.allocs);
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+    auto args = args::Parser::parse(argc, argv);
+
+    uint32_t iterations = 10000;
+    uint32_t frames = 1000;
+    std::string output;
+    if (args.has<int>("iterations"))
+        iterations = std::max(args.value<int>("iterations"), 1);
+    if (args.has<int>("frames"))
+        frames = std::max(args.value<int>("frames"), 1);
+    if (args.has<std::string>("output"))
+        output = args.value<std::string>("output");
+
+    // results go to stdout, keep the log out of the way
+    Log::initialize(Log::Error);
+    initAttribution();
+    // a cold compile should stay cold across runs
+    ShaderCache::instance().setDirectory(std::string());
+
+    const TemporaryFile image(writeRawImage(256, 256));
+    if (image.path().empty()) {
+        Log(Log::Error) << "unable to write benchmark image";
+        return 1;
+    }
+
+    Profiler::instance().setEnabled(true);
+    AnimationOptions options;
+    options.headless = true;
+    options.backendType = wgpu::BackendType::Null;
+    options.onDemand = false;
+    options.assets.push_back(image.path());
+
+    // The wire runs fork the server, so they go first, while this process
+    // is still single threaded: a fork after the in-process animations
+    // would copy whatever locks their decode, record and device threads
+    // held at that moment. Their results are listed after the others.
+    if (!checkResolutionScaling() || !checkWireTransfer())
+        return 1;
+    std::vector<Result> wireResults;
+    options.wire = true;
+    for (uint32_t spriteCount : { 0u, 1024u }) {
+        options.spriteCount = spriteCount;
+        Result result;
+        if (!benchFrame(options, frames, result))
+            return 1;
+        wireResults.push_back(result);
+    }
+    options.wire = false;
+
+    std::vector<Result> results;
+    {
+        dawn_native::Instance instance;
+        wgpu::Device device = createNullDevice(instance);
+        if (!device) {
+            Log(Log::Error) << "no null backend adapter";
+            return 1;
+        }
+        results = benchHelpers(device, iterations);
+        results.push_back(benchTimeline(device, 10000, std::max(iterations / 10, 1u)));
+        for (const Result& result : benchRecorder(device, 1024, std::max(iterations / 100, 1u))) {
+            results.push_back(result);
+        }
+    }
+
+    bool ok = true;
+    for (uint32_t spriteCount : { 0u, 1024u }) {
+        options.spriteCount = spriteCount;
+        Result result;
+        ok = benchFrame(options, frames, result);
+        if (!ok)
+            break;
+        results.push_back(result);
+    }
+    results.insert(results.end(), wireResults.begin(), wireResults.end());
+    if (ok) {
+        // every frame read back and streamed out, should stay close to
+        // the uncaptured run
+        options.spriteCount = 0;
+        options.capturePath = "/dev/null";
+        Result result;
+        ok = benchFrame(options, frames, result);
+        if (ok)
+            results.push_back(result);
+    }
+    if (ok) {
+        // the overlay's rebuilds are spread out, most frames only draw it
+        options.capturePath.clear();
+        options.statsOverlay = true;
+        Result result;
+        ok = benchFrame(options, frames, result);
+        if (ok)
+            results.push_back(result);
+    }
+    if (!ok)
+        return 1;
+
+    FILE* f = output.empty() ? stdout : fopen(output.c_str(), "w");
+    if (!f) {
+        Log(Log::Error) << "unable to open" << output;
+        return 1;
+    }
+    writeResults(f, results);
+    if (f != stdout)
+        fclose(f);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "render/Constants.h"
+#include "render/MappedFile.h"
+#include "render/TexturePack.h"
+#include <buffer/Buffer.h>
+#include <event/Loop.h>
+#include <image/Decoder.h>
+#include <log/Log.h>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace reckoning;
+using namespace reckoning::log;
+using namespace std::chrono_literals;
+
+// Offline packer for TexturePack. Inputs are raw images (see RawImageHeader)
+// or anything the image decoder understands, images are named after the file.
+//
+// usage: dtpack [--mipmaps] <output.dtpk> <input>...
+
+static std::string baseName(const std::string& path)
+{
+    const size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+int main(int argc, char** argv)
+{
+    bool mipmaps = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--mipmaps")) {
+            mipmaps = true;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.size() < 2) {
+        Log(Log::Error) << "usage: dtpack [--mipmaps] <output.dtpk> <input>...";
+        return 1;
+    }
+
+    std::shared_ptr<event::Loop> loop = event::Loop::create();
+    std::shared_ptr<image::Decoder> decoder = image::Decoder::create();
+
+    TexturePackWriter writer;
+    bool ok = true;
+    for (size_t i = 1; ok && i < paths.size(); ++i) {
+        const std::string& path = paths[i];
+        const std::string name = baseName(path);
+
+        std::shared_ptr<MappedFile> file = MappedFile::open(path);
+        if (!file) {
+            Log(Log::Error) << "unable to map" << path;
+            ok = false;
+            break;
+        }
+
+        if (const RawImageHeader* header = rawImageHeader(*file)) {
+            ok = writer.add(name, file->data() + sizeof(RawImageHeader), header->bytesPerRow,
+                            header->width, header->height, mipmaps);
+            if (!ok)
+                Log(Log::Error) << "unable to add" << path;
+            continue;
+        }
+
+        std::shared_ptr<buffer::Buffer> buffer = buffer::Buffer::create(file->size());
+        if (!readFile(path, static_cast<uint8_t*>(buffer->data()), file->size())) {
+            Log(Log::Error) << "unable to read" << path;
+            ok = false;
+            break;
+        }
+
+        bool done = false;
+        decoder->decode(std::move(buffer), kTextureRowPitchAlignment).then([&](image::Decoder::Image&& image) -> void {
+            if (image.data) {
+                ok = writer.add(name, static_cast<const uint8_t*>(image.data->data()), image.bpl,
+                                image.width, image.height, mipmaps);
+            } else {
+                ok = false;
+            }
+            done = true;
+        });
+        while (!done && !loop->stopped())
+            loop->execute(100ms);
+        ok = ok && done;
+        if (!ok)
+            Log(Log::Error) << "unable to decode" << path;
+    }
+
+    if (!ok)
+        return 1;
+
+    if (!writer.write(paths[0])) {
+        Log(Log::Error) << "unable to write" << paths[0];
+        return 1;
+    }
+
+    Log(Log::Info) << "packed" << writer.count() << "images into" << paths[0];
+    return 0;
+}